@@ -0,0 +1,64 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief A block of memory handed out by an arena
+ */
+typedef struct ArenaBlock ArenaBlock;
+
+/**
+ * @brief Bump allocator whose allocations are all released together
+ *
+ * Memory comes from large blocks, so allocating is a pointer increment and
+ * freeing the arena costs one free per block instead of one per allocation.
+ */
+typedef struct
+{
+    ArenaBlock *blocks;
+} Arena;
+
+/**
+ * @brief Initialize an empty arena
+ *
+ * @param arena The arena
+ */
+void arena_init(Arena *arena);
+
+/**
+ * @brief Allocate memory from an arena, aligned for any type
+ *
+ * @param arena The arena
+ * @param size The number of bytes
+ * @return void* The memory or NULL if memory allocation failed
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Copy a string into an arena
+ *
+ * @param arena The arena
+ * @param str The string to copy
+ * @return char* The copy or NULL if memory allocation failed
+ */
+char *arena_strdup(Arena *arena, const char *str);
+
+/**
+ * @brief Move every allocation of another arena into an arena
+ *
+ * The other arena is left empty and its allocations are freed with the arena.
+ *
+ * @param arena The arena receiving the allocations
+ * @param other The arena giving its allocations
+ */
+void arena_take(Arena *arena, Arena *other);
+
+/**
+ * @brief Free every allocation of an arena, leaving it empty
+ *
+ * @param arena The arena
+ */
+void arena_free(Arena *arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,54 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief A unit of work run by parallel_for or parallel_steal
+ *
+ * @param context The context given to parallel_for or parallel_steal
+ * @param index The index of the item to process
+ */
+typedef void (*ParallelTask)(void *context, size_t index);
+
+/**
+ * @brief Get the number of threads the machine can run at once
+ *
+ * @return int The number of online processors, at least 1
+ */
+int parallel_available_threads(void);
+
+/**
+ * @brief Run a task for every index in [0, count) on several threads
+ *
+ * Threads take the next pending index as soon as they finish one, so items
+ * of uneven cost are balanced. The calling thread works too, and the items
+ * still run if no thread can be created. Returns when all items are done.
+ *
+ * @param count The number of items
+ * @param num_threads The maximum number of threads, including the caller
+ * @param task The task to run for each item
+ * @param context Opaque pointer passed to every task
+ */
+void parallel_for(size_t count, int num_threads, ParallelTask task, void *context);
+
+/**
+ * @brief Run a task for every item in [0, count) on threads that steal items
+ *
+ * Each thread starts with a contiguous range of items and takes them in
+ * order from the end of its own queue, so neighbouring items run on the
+ * same thread. A thread that runs out takes half of the queue of another
+ * from its far end, and stops once every queue is empty. The calling thread
+ * works too, and the items still run if no thread can be created. Returns
+ * when all items are done.
+ *
+ * @param count The number of initial items
+ * @param num_threads The maximum number of threads, including the caller
+ * @param task The task to run for each item
+ * @param context Opaque pointer passed to every task
+ * @return bool true once all items are done, false if memory allocation failed and none ran
+ */
+bool parallel_steal(size_t count, int num_threads, ParallelTask task, void *context);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,468 @@
+#define _GNU_SOURCE
+
+#include "io_uring_file_system.h"
+#include "unix_file_system.h"
+#include "../../../include/common/logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Room for the description of an error
+#define ERROR_TEXT_SIZE 128
+
+// Operations in flight at once on a ring
+#define RING_ENTRIES 256
+
+// What a completion is for, in the low bits of its user data
+#define OPERATION_MKDIR 0
+#define OPERATION_OPEN 1
+#define OPERATION_CLOSE 2
+#define OPERATION_BITS 2
+
+/**
+ * @brief An io_uring with its submission and completion queues mapped
+ */
+typedef struct
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned num_entries;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Ring;
+
+/**
+ * @brief Describe an error in a buffer of the caller, as strerror may share one between threads
+ *
+ * @param error The error number
+ * @param text The buffer
+ * @return const char* The description
+ */
+static const char *error_text(int error, char text[ERROR_TEXT_SIZE])
+{
+    return strerror_r(error, text, ERROR_TEXT_SIZE);
+}
+
+static pthread_once_t setup_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static bool io_uring_available = false;
+static FileSystemPort io_uring_file_system;
+
+static void ring_destroy(Ring *ring)
+{
+    if (ring->sqes)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+static void ring_destroy_key(void *ring)
+{
+    ring_destroy(ring);
+}
+
+static Ring *ring_create(void)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    Ring *ring = calloc(1, sizeof(Ring));
+    if (!ring)
+    {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->num_entries = params.sq_entries;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Recent kernels map both queues at once
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size)
+    {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    void *sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING);
+    void *cq_ring = single_mmap ? sq_ring
+                                : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQES);
+
+    ring->sq_ring = (sq_ring == MAP_FAILED) ? NULL : sq_ring;
+    ring->cq_ring = (cq_ring == MAP_FAILED) ? NULL : cq_ring;
+    ring->sqes = (sqes == MAP_FAILED) ? NULL : sqes;
+    if (!ring->sq_ring || !ring->cq_ring || !ring->sqes)
+    {
+        ring_destroy(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return ring;
+}
+
+/**
+ * @brief Check that the kernel supports the operations used
+ *
+ * @param ring A ring
+ * @return bool true if mkdirat, openat and close are supported, false otherwise
+ */
+static bool ring_supports_operations(const Ring *ring)
+{
+    size_t num_ops = 256;
+    struct io_uring_probe *probe = calloc(1, sizeof(*probe) + num_ops * sizeof(struct io_uring_probe_op));
+    if (!probe)
+    {
+        return false;
+    }
+
+    bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, num_ops) == 0;
+    const int needed[] = {IORING_OP_MKDIRAT, IORING_OP_OPENAT, IORING_OP_CLOSE};
+    for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]) && supported; i++)
+    {
+        supported = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+    return supported;
+}
+
+/**
+ * @brief Get the ring of the calling thread, creating it on first use
+ *
+ * @return Ring* The ring or NULL if it could not be created
+ */
+static Ring *thread_ring(void)
+{
+    Ring *ring = pthread_getspecific(ring_key);
+    if (!ring)
+    {
+        ring = ring_create();
+        if (ring && pthread_setspecific(ring_key, ring) != 0)
+        {
+            ring_destroy(ring);
+            ring = NULL;
+        }
+    }
+
+    return ring;
+}
+
+/**
+ * @brief Queue an operation, the ring having room for it
+ *
+ * @param ring The ring
+ * @param opcode The operation
+ * @param fd The directory or file operated on
+ * @param path The path of the entry, NULL for close
+ * @param user_data What the completion is for
+ */
+static void ring_queue(Ring *ring, int opcode, int fd, const char *path, uint64_t user_data)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->user_data = user_data;
+    if (opcode == IORING_OP_MKDIRAT)
+    {
+        sqe->len = 0755;
+    }
+    else if (opcode == IORING_OP_OPENAT)
+    {
+        // Without O_TRUNC an existing file is kept as it is
+        sqe->len = 0666;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    }
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Submit the queued operations and wait until all of them complete
+ *
+ * @param ring The ring
+ * @param count The number of operations queued
+ * @return bool true if they were submitted, false otherwise
+ */
+static bool ring_submit_and_wait(Ring *ring, unsigned count)
+{
+    unsigned submitted = 0;
+
+    while (submitted < count)
+    {
+        int done = (int)syscall(__NR_io_uring_enter, ring->fd, count - submitted, count - submitted,
+                                IORING_ENTER_GETEVENTS, NULL, 0);
+        if (done < 0 && errno != EINTR)
+        {
+            char text[ERROR_TEXT_SIZE];
+            logger_error("Failed to submit to io_uring: %s", error_text(errno, text));
+            return false;
+        }
+        submitted += (done > 0) ? (unsigned)done : 0;
+    }
+
+    // Submitting may return before the last completions when it is interrupted
+    while (__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *ring->cq_head < count)
+    {
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, count, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+        {
+            char text[ERROR_TEXT_SIZE];
+            logger_error("Failed to wait for io_uring: %s", error_text(errno, text));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief A file opened by a batch, to be closed by the next one
+ */
+typedef struct
+{
+    int fd;
+    size_t entry;
+} OpenedFile;
+
+/**
+ * @brief Read completions of the ring, reporting failures
+ *
+ * @param ring The ring
+ * @param entries The entries being created
+ * @param count The number of completions to read
+ * @param opened Array of count files, to store the files opened
+ * @param error The error of the entries, updated
+ * @return unsigned The number of files opened
+ */
+static unsigned ring_reap(
+    Ring *ring,
+    const FileSystemEntry *entries,
+    unsigned count,
+    OpenedFile *opened,
+    StatusCode *error)
+{
+    unsigned num_opened = 0;
+    unsigned head = *ring->cq_head;
+
+    for (unsigned i = 0; i < count; i++, head++)
+    {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        unsigned operation = (unsigned)(cqe->user_data & ((1u << OPERATION_BITS) - 1));
+        size_t index = (size_t)(cqe->user_data >> OPERATION_BITS);
+        const FileSystemEntry *entry = &entries[index];
+
+        if (operation == OPERATION_MKDIR && cqe->res < 0 && cqe->res != -EEXIST)
+        {
+            char text[ERROR_TEXT_SIZE];
+            logger_error("Failed to create directory %s: %s", entry->name, error_text(-cqe->res, text));
+            *error = ERROR_DIRECTORY_CREATION;
+        }
+        else if (operation == OPERATION_OPEN && cqe->res < 0)
+        {
+            char text[ERROR_TEXT_SIZE];
+            logger_error("Failed to create file %s: %s", entry->name, error_text(-cqe->res, text));
+            *error = (*error == SUCCESS) ? ERROR_FILE_CREATION : *error;
+        }
+        else if (operation == OPERATION_OPEN)
+        {
+            opened[num_opened].fd = cqe->res;
+            opened[num_opened].entry = index;
+            num_opened++;
+        }
+        else if (operation == OPERATION_CLOSE && cqe->res < 0)
+        {
+            char text[ERROR_TEXT_SIZE];
+            logger_error("Failed to close file %s: %s", entry->name, error_text(-cqe->res, text));
+            *error = (*error == SUCCESS) ? ERROR_FILE_CREATION : *error;
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return num_opened;
+}
+
+/**
+ * @brief Drop the ring of the thread after a batch failed
+ *
+ * Nothing is known of the operations still in flight, and a ring in that
+ * state cannot be reused. Files opened by the completions already posted
+ * are closed first, and so are those the batch was to close whose close
+ * was never taken by the kernel; closes taken end with the ring.
+ *
+ * @param ring The ring
+ * @param entries The entries being created
+ * @param closes The files the batch was to close, queued first
+ * @param num_closes The number of files the batch was to close
+ * @param batch_start The submission queue tail before the batch was queued
+ */
+static void ring_abandon(
+    Ring *ring,
+    const FileSystemEntry *entries,
+    const OpenedFile *closes,
+    unsigned num_closes,
+    unsigned batch_start)
+{
+    OpenedFile opened[RING_ENTRIES];
+    StatusCode error = SUCCESS;
+    unsigned posted = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *ring->cq_head;
+    unsigned taken = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) - batch_start;
+
+    unsigned num_opened = ring_reap(ring, entries, posted < RING_ENTRIES ? posted : RING_ENTRIES, opened, &error);
+    for (unsigned i = 0; i < num_opened; i++)
+    {
+        close(opened[i].fd);
+    }
+    for (unsigned i = taken; i < num_closes; i++)
+    {
+        close(closes[i].fd);
+    }
+
+    pthread_setspecific(ring_key, NULL);
+    ring_destroy(ring);
+}
+
+static StatusCode io_uring_create_entries_at(const FileSystemEntry *entries, size_t num_entries)
+{
+    Ring *ring = thread_ring();
+    if (!ring)
+    {
+        // Without a ring of its own, the thread creates entries one at a time
+        const FileSystemPort *unix_file_system = get_unix_file_system();
+        StatusCode error = SUCCESS;
+        for (size_t i = 0; i < num_entries && error == SUCCESS; i++)
+        {
+            error = entries[i].is_directory
+                        ? unix_file_system->create_directory_at(entries[i].parent, entries[i].name, NULL)
+                        : unix_file_system->create_file_at(entries[i].parent, entries[i].name);
+        }
+        return error;
+    }
+
+    // Files opened by a batch are closed by the next one
+    OpenedFile closes[2][RING_ENTRIES];
+    unsigned num_closes = 0;
+    int pending = 0;
+    StatusCode error = SUCCESS;
+    size_t next = 0;
+
+    while ((next < num_entries && error == SUCCESS) || num_closes > 0)
+    {
+        unsigned batch_start = *ring->sq_tail;
+        unsigned count = 0;
+        const OpenedFile *closing = closes[pending];
+        unsigned num_closing = num_closes;
+
+        for (unsigned i = 0; i < num_closing; i++)
+        {
+            uint64_t user_data = ((uint64_t)closing[i].entry << OPERATION_BITS) | OPERATION_CLOSE;
+            ring_queue(ring, IORING_OP_CLOSE, closing[i].fd, NULL, user_data);
+            count++;
+        }
+        pending ^= 1;
+
+        for (; next < num_entries && error == SUCCESS && count < ring->num_entries; next++, count++)
+        {
+            const FileSystemEntry *entry = &entries[next];
+            uint64_t user_data = ((uint64_t)next << OPERATION_BITS) |
+                                 (entry->is_directory ? OPERATION_MKDIR : OPERATION_OPEN);
+            ring_queue(ring, entry->is_directory ? IORING_OP_MKDIRAT : IORING_OP_OPENAT, entry->parent, entry->name,
+                       user_data);
+        }
+
+        if (!ring_submit_and_wait(ring, count))
+        {
+            ring_abandon(ring, entries, closing, num_closing, batch_start);
+            return ERROR_DIRECTORY_CREATION;
+        }
+
+        num_closes = ring_reap(ring, entries, count, closes[pending], &error);
+    }
+
+    return error;
+}
+
+static void setup(void)
+{
+    io_uring_file_system = *get_unix_file_system();
+
+    Ring *probe_ring = ring_create();
+    if (!probe_ring)
+    {
+        char text[ERROR_TEXT_SIZE];
+        logger_info("io_uring is unavailable (%s), creating entries one at a time", error_text(errno, text));
+        return;
+    }
+
+    io_uring_available = ring_supports_operations(probe_ring) && pthread_key_create(&ring_key, ring_destroy_key) == 0;
+    ring_destroy(probe_ring);
+
+    if (io_uring_available)
+    {
+        io_uring_file_system.create_entries_at = io_uring_create_entries_at;
+    }
+    else
+    {
+        logger_info("io_uring lacks the operations needed, creating entries one at a time");
+    }
+}
+
+const FileSystemPort *get_io_uring_file_system(void)
+{
+    pthread_once(&setup_once, setup);
+
+    return io_uring_available ? &io_uring_file_system : get_unix_file_system();
+}
@@ -0,0 +1,19 @@
+#ifndef IO_URING_FILE_SYSTEM_H
+#define IO_URING_FILE_SYSTEM_H
+
+#include "../../core/ports/file_system_port.h"
+
+/**
+ * @brief Get the io_uring file system implementation
+ *
+ * Works as the Unix implementation, except that entries created together
+ * are submitted to the kernel in batches through an io_uring per thread,
+ * waiting once per batch instead of once per entry. When the kernel lacks
+ * io_uring or its mkdirat, openat and close operations, the Unix
+ * implementation is returned instead.
+ *
+ * @return const FileSystemPort* The file system implementation
+ */
+const FileSystemPort *get_io_uring_file_system(void);
+
+#endif /* IO_URING_FILE_SYSTEM_H */
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "unix_file_system.h"
 #include "../../../include/common/logger.h"
 
@@ -8,6 +10,29 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+
+// Room for the description of an error
+#define ERROR_TEXT_SIZE 128
+
+/**
+ * @brief Describe an error in a buffer of the caller
+ *
+ * strerror may share one buffer between threads, so it is not used.
+ *
+ * @param error The error number
+ * @param text The buffer
+ * @return const char* The description
+ */
+static const char *error_text(int error, char text[ERROR_TEXT_SIZE])
+{
+    if (strerror_r(error, text, ERROR_TEXT_SIZE) != 0)
+    {
+        snprintf(text, ERROR_TEXT_SIZE, "error %d", error);
+    }
+
+    return text;
+}
 
 static StatusCode unix_create_directory(const char *path)
 {
@@ -20,7 +45,8 @@ static StatusCode unix_create_directory(const char *path)
             return SUCCESS;
         }
 
-        logger_error("Failed to create directory %s: %s", path, strerror(errno));
+        char text[ERROR_TEXT_SIZE];
+        logger_error("Failed to create directory %s: %s", path, error_text(errno, text));
         return ERROR_DIRECTORY_CREATION;
     }
 
@@ -29,14 +55,22 @@ static StatusCode unix_create_directory(const char *path)
 
 static StatusCode unix_create_file(const char *path)
 {
-    FILE *file = fopen(path, "w");
-    if (!file)
+    // Without O_TRUNC an existing file is kept as it is
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        char text[ERROR_TEXT_SIZE];
+        logger_error("Failed to create file %s: %s", path, error_text(errno, text));
+        return ERROR_FILE_CREATION;
+    }
+
+    if (close(fd) != 0)
     {
-        logger_error("Failed to create file %s: %s", path, strerror(errno));
+        char text[ERROR_TEXT_SIZE];
+        logger_error("Failed to close file %s: %s", path, error_text(errno, text));
         return ERROR_FILE_CREATION;
     }
 
-    fclose(file);
     return SUCCESS;
 }
 
@@ -62,11 +96,77 @@ static bool unix_file_exists(const char *path)
     return S_ISREG(st.st_mode);
 }
 
+static StatusCode unix_open_directory(const char *path, int *directory)
+{
+    *directory = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (*directory < 0)
+    {
+        char text[ERROR_TEXT_SIZE];
+        logger_error("Failed to open directory %s: %s", path, error_text(errno, text));
+        return ERROR_DIRECTORY_CREATION;
+    }
+
+    return SUCCESS;
+}
+
+static StatusCode unix_create_directory_at(int parent, const char *name, int *directory)
+{
+    if (mkdirat(parent, name, 0755) != 0 && errno != EEXIST)
+    {
+        char text[ERROR_TEXT_SIZE];
+        logger_error("Failed to create directory %s: %s", name, error_text(errno, text));
+        return ERROR_DIRECTORY_CREATION;
+    }
+
+    if (directory)
+    {
+        *directory = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (*directory < 0)
+        {
+            char text[ERROR_TEXT_SIZE];
+            logger_error("Failed to open directory %s: %s", name, error_text(errno, text));
+            return ERROR_DIRECTORY_CREATION;
+        }
+    }
+
+    return SUCCESS;
+}
+
+static StatusCode unix_create_file_at(int parent, const char *name)
+{
+    // Without O_TRUNC an existing file is kept as it is
+    int fd = openat(parent, name, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        char text[ERROR_TEXT_SIZE];
+        logger_error("Failed to create file %s: %s", name, error_text(errno, text));
+        return ERROR_FILE_CREATION;
+    }
+
+    if (close(fd) != 0)
+    {
+        char text[ERROR_TEXT_SIZE];
+        logger_error("Failed to close file %s: %s", name, error_text(errno, text));
+        return ERROR_FILE_CREATION;
+    }
+
+    return SUCCESS;
+}
+
+static void unix_close_directory(int directory)
+{
+    close(directory);
+}
+
 static const FileSystemPort unix_file_system = {
     .create_directory = unix_create_directory,
     .create_file = unix_create_file,
     .directory_exists = unix_directory_exists,
-    .file_exists = unix_file_exists};
+    .file_exists = unix_file_exists,
+    .open_directory = unix_open_directory,
+    .create_directory_at = unix_create_directory_at,
+    .create_file_at = unix_create_file_at,
+    .close_directory = unix_close_directory};
 
 const FileSystemPort *get_unix_file_system(void)
 {
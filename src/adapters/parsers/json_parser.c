@@ -1,15 +1,35 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "json_parser.h"
+#include "json_scanner.h"
 #include "../../../include/common/utils.h"
 #include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Simple JSON parser implementation
 // In a real project, you would use a library like cJSON or jansson
 
+// Initial size of the input window when streaming
+#define STREAM_WINDOW_SIZE (64 * 1024)
+
+// Key of the NDJSON line that starts a tree
+#define NDJSON_TREE_KEY "tree"
+
+// Chunks of species handed out per parsing thread, so threads that finish
+// early can take work from slower ones
+#define CHUNKS_PER_THREAD 4
+
 typedef enum
 {
     TOKEN_NONE,
@@ -27,109 +47,1402 @@ typedef enum
     TOKEN_EOF
 } TokenType;
 
+// Tokens are slices of the input buffer. Strings are unescaped in place and
+// terminated where their closing quote was, so reading a token never allocates
 typedef struct
 {
     TokenType type;
     char *value;
+    size_t length;
 } Token;
 
+// The parser reads either a range of a whole buffer (fd < 0) or a window over
+// a stream that is refilled on demand. In streaming mode bytes before `mark`,
+// the start of the token being read, are dropped on refill, so token values
+// are only valid until the next token. Whole buffers are walked through the
+// positions found by a structural scanner instead of byte by byte
 typedef struct
 {
-    const char *json;
+    char *json;
     size_t pos;
     size_t len;
     Token current_token;
+    JsonScanner *scanner;
+    int fd;
+    size_t capacity;
+    size_t mark;
+    char *held;
+    size_t held_capacity;
 } JsonParser;
 
 // Forward declarations
-static void parser_init(JsonParser *parser, const char *json);
+static void parser_init(JsonParser *parser, char *json, size_t start, size_t end, JsonScanner *scanner);
+static bool parser_init_stream(JsonParser *parser, int fd);
 static void parser_free(JsonParser *parser);
+static bool parser_available(JsonParser *parser, size_t count);
 static void parser_next_token(JsonParser *parser);
 static bool parser_expect(JsonParser *parser, TokenType type);
 static char *parser_parse_string(JsonParser *parser);
+static const char *parser_hold_string(JsonParser *parser);
 static bool parser_parse_boolean(JsonParser *parser);
-static DicotomicTree *parser_parse_tree(JsonParser *parser);
-static Species *parser_parse_species(JsonParser *parser, const char *name);
+static StatusCode parser_parse_document(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_tree_open(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_tree_close(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_head(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_between(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_species_list(JsonParser *parser, TokenType end, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_species_chunk(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_tail(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_species(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+static StatusCode parser_parse_record(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context, bool *tree_open);
+
+// Parses the tokens of a range of a key
+typedef StatusCode (*RangeParse)(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context);
+
+static void release_mapped_key(void *source, size_t source_size)
+{
+    munmap(source, source_size);
+}
+
+static void release_read_key(void *source, size_t source_size)
+{
+    (void)source_size;
+    free(source);
+}
+
+/**
+ * @brief A key buffer borrowed by several trees
+ *
+ * Each tree of a key holds one reference and the buffer is released with the
+ * last one, whatever the order the trees are freed in.
+ */
+typedef struct
+{
+    char *json;
+    size_t json_size;
+    TreeSourceRelease release;
+    int references;
+} SharedKey;
+
+static void release_shared_key(void *source, size_t source_size)
+{
+    SharedKey *key = source;
+    (void)source_size;
+
+    if (__atomic_sub_fetch(&key->references, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        key->release(key->json, key->json_size);
+        free(key);
+    }
+}
+
+/**
+ * @brief Read a whole key from a file descriptor that cannot be mapped
+ *
+ * @param fd The file descriptor
+ * @param size Pointer to store the number of bytes read
+ * @return char* The buffer or NULL if reading failed
+ */
+static char *read_key_fd(int fd, size_t *size)
+{
+    size_t capacity = STREAM_WINDOW_SIZE;
+    size_t len = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer)
+    {
+        logger_error("Failed to allocate memory for file content");
+        return NULL;
+    }
+
+    while (true)
+    {
+        if (len == capacity)
+        {
+            char *new_buffer = realloc(buffer, capacity * 2);
+            if (!new_buffer)
+            {
+                logger_error("Failed to allocate memory for file content");
+                free(buffer);
+                return NULL;
+            }
+            buffer = new_buffer;
+            capacity *= 2;
+        }
+
+        ssize_t read_size = read(fd, buffer + len, capacity - len);
+        if (read_size < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            logger_error("Failed to read key file: %s", strerror(errno));
+            free(buffer);
+            return NULL;
+        }
+        if (read_size == 0)
+        {
+            break;
+        }
+        len += (size_t)read_size;
+    }
+
+    *size = len;
+    return buffer;
+}
+
+/**
+ * @brief Builds the DicotomicTrees of a key from parser events
+ *
+ * The whole key is in one buffer, so every species name the parser reports
+ * lives in it and is borrowed by the trees. Species go to the last tree
+ * started, which interns their questions.
+ */
+typedef struct
+{
+    DicotomicTree **trees;
+    int num_trees;
+} TreeBuilder;
+
+static void builder_free(TreeBuilder *builder)
+{
+    for (int i = 0; i < builder->num_trees; i++)
+    {
+        dicotomic_tree_free(builder->trees[i]);
+    }
+    free(builder->trees);
+
+    builder->trees = NULL;
+    builder->num_trees = 0;
+}
+
+static StatusCode builder_on_tree_start(void *context, const char *tree_name)
+{
+    TreeBuilder *builder = context;
+
+    DicotomicTree **new_trees = realloc(builder->trees, (builder->num_trees + 1) * sizeof(DicotomicTree *));
+    if (!new_trees)
+    {
+        logger_error("Failed to resize trees array");
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    builder->trees = new_trees;
+
+    builder->trees[builder->num_trees] = dicotomic_tree_create(tree_name);
+    if (!builder->trees[builder->num_trees])
+    {
+        logger_error("Failed to create dicotomic tree");
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    builder->num_trees++;
+
+    return SUCCESS;
+}
+
+static StatusCode builder_on_species_start(void *context, const char *species_name)
+{
+    TreeBuilder *builder = context;
+
+    if (!dicotomic_tree_add_species_view(builder->trees[builder->num_trees - 1], (char *)species_name))
+    {
+        logger_error("Failed to add species to tree");
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    return SUCCESS;
+}
+
+static StatusCode builder_on_characteristic(void *context, const char *question, bool answer)
+{
+    TreeBuilder *builder = context;
+    DicotomicTree *tree = builder->trees[builder->num_trees - 1];
+    QuestionId id;
+
+    if (!dicotomic_tree_intern_question(tree, question, &id) ||
+        !dicotomic_tree_add_characteristic(tree, id, answer))
+    {
+        logger_error("Failed to add characteristic to species");
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    return SUCCESS;
+}
+
+static const JsonParserCallbacks tree_builder_callbacks = {
+    .on_tree_start = builder_on_tree_start,
+    .on_species_start = builder_on_species_start,
+    .on_characteristic = builder_on_characteristic,
+    .on_species_end = NULL,
+    .on_tree_end = NULL};
+
+/**
+ * @brief Load a whole key in memory
+ *
+ * Regular files are mapped privately so strings can be terminated in place
+ * without touching the file; anything else (pipes, empty files) is read.
+ *
+ * @param file_path The path of the key
+ * @param json Pointer to store the buffer
+ * @param json_size Pointer to store the size of the buffer
+ * @param release Pointer to store the function that releases the buffer
+ * @return bool true if successful, false otherwise
+ */
+static bool load_key(const char *file_path, char **json, size_t *json_size, TreeSourceRelease *release)
+{
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+    {
+        logger_error("Failed to open file: %s", file_path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        logger_error("Failed to stat file: %s", file_path);
+        close(fd);
+        return false;
+    }
+
+    // Off_t is 64 bits wide, the address space may not be
+    if ((uintmax_t)st.st_size > SIZE_MAX)
+    {
+        logger_error("File too large to be loaded: %s", file_path);
+        close(fd);
+        return false;
+    }
+
+    *json = NULL;
+    *json_size = 0;
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        *json_size = (size_t)st.st_size;
+        void *mapped = mmap(NULL, *json_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+            posix_madvise(mapped, *json_size, POSIX_MADV_SEQUENTIAL);
+            *json = mapped;
+            *release = release_mapped_key;
+        }
+    }
+
+    if (!*json)
+    {
+        *json = read_key_fd(fd, json_size);
+        *release = release_read_key;
+    }
+    close(fd);
+
+    return *json != NULL;
+}
+
+/**
+ * @brief Parse a range of a key with its own parser
+ *
+ * @param json The key
+ * @param start The offset where the range starts
+ * @param end The offset where the range ends
+ * @param kernel The kernel used to find structural characters
+ * @param parse The grammar rule the range must match
+ * @param context The TreeBuilder receiving the parsed elements
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode parse_key_range(
+    char *json,
+    size_t start,
+    size_t end,
+    JsonScannerKernel kernel,
+    RangeParse parse,
+    void *context)
+{
+    // Find structural characters ahead of the parser; without memory for the
+    // scanner the parser still works byte by byte
+    JsonScanner *scanner = malloc(sizeof(JsonScanner));
+    if (scanner)
+    {
+        json_scanner_init(scanner, json, start, end, kernel);
+    }
+
+    JsonParser parser;
+    parser_init(&parser, json, start, end, scanner);
+
+    StatusCode error = parse(&parser, &tree_builder_callbacks, context);
+
+    parser_free(&parser);
+    free(scanner);
+
+    return error;
+}
+
+/**
+ * @brief The species array of a tree, found before parsing it
+ */
+typedef struct
+{
+    size_t start;
+    size_t end;
+    size_t first_species;
+    size_t num_species;
+} SpeciesArray;
+
+/**
+ * @brief Offsets of the species arrays of a key and of each species in them
+ */
+typedef struct
+{
+    SpeciesArray *arrays;
+    size_t num_arrays;
+    size_t *starts;
+    size_t count;
+} SpeciesBoundaries;
+
+static void species_boundaries_free(SpeciesBoundaries *boundaries)
+{
+    free(boundaries->arrays);
+    free(boundaries->starts);
+}
+
+/**
+ * @brief Append a value to an array grown by doubling
+ */
+static bool append_offset(size_t **values, size_t *count, size_t *capacity, size_t value)
+{
+    if (*count == *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+        size_t *new_values = realloc(*values, new_capacity * sizeof(size_t));
+        if (!new_values)
+        {
+            return false;
+        }
+        *values = new_values;
+        *capacity = new_capacity;
+    }
+
+    (*values)[(*count)++] = value;
+    return true;
+}
+
+/**
+ * @brief Find where the species arrays and each species object start
+ *
+ * Only brackets are looked at, which the scanner finds without reading
+ * strings; the parse of each range checks everything else.
+ *
+ * @param json The key
+ * @param json_size The size of the key
+ * @param kernel The kernel used to find structural characters
+ * @param boundaries Where to store the offsets, freed by the caller
+ * @return bool true if the key has the shape of a list of trees, false otherwise
+ */
+static bool find_species_boundaries(
+    const char *json,
+    size_t json_size,
+    JsonScannerKernel kernel,
+    SpeciesBoundaries *boundaries)
+{
+    boundaries->arrays = NULL;
+    boundaries->num_arrays = 0;
+    boundaries->starts = NULL;
+    boundaries->count = 0;
+
+    JsonScanner *scanner = malloc(sizeof(JsonScanner));
+    if (!scanner)
+    {
+        return false;
+    }
+    json_scanner_init(scanner, json, 0, json_size, kernel);
+
+    size_t capacity = 0;
+    size_t arrays_capacity = 0;
+    int depth = 0;
+    bool valid = true;
+    bool found = false;
+    size_t pos;
+
+    while (valid && !found && (pos = json_scanner_next(scanner)) < json_size)
+    {
+        switch (json[pos])
+        {
+        case '{':
+        case '[':
+            // Every member of the key is a species array, and species are
+            // the objects directly inside one
+            if (depth == 0)
+            {
+                valid = json[pos] == '{';
+            }
+            else if (depth == 1)
+            {
+                valid = json[pos] == '[';
+                if (valid && boundaries->num_arrays == arrays_capacity)
+                {
+                    arrays_capacity = arrays_capacity ? arrays_capacity * 2 : 16;
+                    SpeciesArray *new_arrays = realloc(boundaries->arrays, arrays_capacity * sizeof(SpeciesArray));
+                    valid = new_arrays != NULL;
+                    if (valid)
+                    {
+                        boundaries->arrays = new_arrays;
+                    }
+                }
+                if (valid)
+                {
+                    SpeciesArray *array = &boundaries->arrays[boundaries->num_arrays++];
+                    array->start = pos;
+                    array->end = pos;
+                    array->first_species = boundaries->count;
+                    array->num_species = 0;
+                }
+            }
+            else if (depth == 2 && json[pos] == '{')
+            {
+                valid = append_offset(&boundaries->starts, &boundaries->count, &capacity, pos);
+                boundaries->arrays[boundaries->num_arrays - 1].num_species++;
+            }
+            depth++;
+            break;
+        case '}':
+        case ']':
+            depth--;
+            if (depth == 1)
+            {
+                valid = json[pos] == ']';
+                boundaries->arrays[boundaries->num_arrays - 1].end = pos;
+            }
+            else if (depth == 0)
+            {
+                valid = json[pos] == '}';
+                found = true;
+            }
+            else if (depth < 0)
+            {
+                valid = false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    free(scanner);
+    return valid && found && boundaries->num_arrays > 0;
+}
+
+/**
+ * @brief A run of consecutive species parsed by one thread
+ *
+ * In JSON keys a chunk holds species of one tree, whose index is kept.
+ */
+typedef struct
+{
+    size_t start;
+    size_t end;
+    int tree;
+    TreeBuilder builder;
+    StatusCode error;
+} SpeciesChunk;
+
+/**
+ * @brief Work shared by the threads parsing the species of a key
+ */
+typedef struct
+{
+    char *json;
+    JsonScannerKernel kernel;
+    SpeciesChunk *chunks;
+} ChunkedParse;
+
+/**
+ * @brief Check that a chunk ends with the comma separating it from the next one
+ */
+static bool chunk_ends_with_comma(const char *json, const SpeciesChunk *chunk)
+{
+    size_t pos = chunk->end;
+
+    while (pos > chunk->start && isspace((unsigned char)json[pos - 1]))
+    {
+        pos--;
+    }
+
+    return pos > chunk->start && json[pos - 1] == ',';
+}
+
+static void parse_species_chunk_task(void *context, size_t index)
+{
+    ChunkedParse *parse = context;
+    SpeciesChunk *chunk = &parse->chunks[index];
+
+    chunk->error = parse_key_range(
+        parse->json,
+        chunk->start,
+        chunk->end,
+        parse->kernel,
+        parser_parse_species_chunk,
+        &chunk->builder);
+}
+
+/**
+ * @brief Cut a species array into chunks at species boundaries
+ *
+ * The chunks have similar sizes in bytes. The first one starts right after
+ * '[' and the last one ends before ']' so that nothing between species
+ * escapes the parse. An array without species still gets one chunk, which
+ * checks that it is empty.
+ *
+ * @param array The species array
+ * @param starts The offsets of every species of the key
+ * @param tree The index of the tree of the array
+ * @param num_chunks The number of chunks, between 1 and the number of species
+ * @param chunks Where to store the chunks
+ */
+static void cut_species_array(
+    const SpeciesArray *array,
+    const size_t *starts,
+    int tree,
+    size_t num_chunks,
+    SpeciesChunk *chunks)
+{
+    const size_t *species = starts + array->first_species;
+    size_t array_size = array->end - array->start;
+    size_t next = 1;
+
+    chunks[0].start = array->start + 1;
+    for (size_t i = 1; i < num_chunks; i++)
+    {
+        size_t target = array->start + array_size / num_chunks * i;
+        while (next < array->num_species - (num_chunks - i) && species[next] < target)
+        {
+            next++;
+        }
+        chunks[i].start = species[next++];
+        chunks[i - 1].end = chunks[i].start;
+    }
+    chunks[num_chunks - 1].end = array->end;
+
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        chunks[i].tree = tree;
+    }
+}
+
+/**
+ * @brief Parse the species of a key on several threads
+ *
+ * Every species array is cut at species boundaries into chunks, a number
+ * proportional to its species. Each chunk fills its own list and the lists
+ * are appended to their trees in key order, so the trees are the same as the
+ * ones of a sequential parse. The ranges parsed cover the whole key, so any
+ * malformed input is still rejected.
+ *
+ * @param json The key
+ * @param json_size The size of the key
+ * @param kernel The kernel used to find structural characters
+ * @param boundaries The offsets of the species arrays and of each species
+ * @param num_threads The number of threads
+ * @param builder The builder receiving the trees, freed by the caller
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode parse_key_parallel(
+    char *json,
+    size_t json_size,
+    JsonScannerKernel kernel,
+    const SpeciesBoundaries *boundaries,
+    int num_threads,
+    TreeBuilder *builder)
+{
+    const SpeciesArray *arrays = boundaries->arrays;
+    size_t num_arrays = boundaries->num_arrays;
+
+    // Everything outside the species arrays creates the trees in key order
+    StatusCode error = parse_key_range(json, 0, arrays[0].start + 1, kernel, parser_parse_head, builder);
+    for (size_t i = 1; i < num_arrays && error == SUCCESS; i++)
+    {
+        error = parse_key_range(json, arrays[i - 1].end, arrays[i].start + 1, kernel, parser_parse_between, builder);
+    }
+    if (error == SUCCESS)
+    {
+        error = parse_key_range(json, arrays[num_arrays - 1].end, json_size, kernel, parser_parse_tail, builder);
+    }
+    if (error != SUCCESS)
+    {
+        return error;
+    }
+
+    // Share the chunks among arrays by number of species
+    size_t target_chunks = (size_t)num_threads * CHUNKS_PER_THREAD;
+    size_t *array_chunks = malloc(num_arrays * sizeof(size_t));
+    if (!array_chunks)
+    {
+        logger_error("Failed to allocate memory for species chunks");
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t num_chunks = 0;
+    for (size_t i = 0; i < num_arrays; i++)
+    {
+        size_t share = (boundaries->count > 0) ? target_chunks * arrays[i].num_species / boundaries->count : 0;
+        if (share > arrays[i].num_species)
+        {
+            share = arrays[i].num_species;
+        }
+        array_chunks[i] = (share > 0) ? share : 1;
+        num_chunks += array_chunks[i];
+    }
+
+    SpeciesChunk *chunks = calloc(num_chunks, sizeof(SpeciesChunk));
+    if (!chunks)
+    {
+        logger_error("Failed to allocate memory for species chunks");
+        free(array_chunks);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t first_chunk = 0;
+    for (size_t i = 0; i < num_arrays; i++)
+    {
+        cut_species_array(&arrays[i], boundaries->starts, (int)i, array_chunks[i], chunks + first_chunk);
+        first_chunk += array_chunks[i];
+    }
+    free(array_chunks);
+
+    // Chunks are parsed apart, so the commas between them are checked here
+    for (size_t i = 0; i + 1 < num_chunks && error == SUCCESS; i++)
+    {
+        if (chunks[i].tree == chunks[i + 1].tree && !chunk_ends_with_comma(json, &chunks[i]))
+        {
+            logger_error("Expected comma or array end");
+            error = ERROR_INVALID_JSON;
+        }
+    }
+
+    for (size_t i = 0; i < num_chunks && error == SUCCESS; i++)
+    {
+        error = builder_on_tree_start(&chunks[i].builder, "");
+    }
+
+    if (error == SUCCESS)
+    {
+        ChunkedParse parse = {.json = json, .kernel = kernel, .chunks = chunks};
+        parallel_for(num_chunks, num_threads, parse_species_chunk_task, &parse);
+    }
+
+    // Merge in key order; the first chunk that failed decides the error
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        if (error == SUCCESS && chunks[i].error != SUCCESS)
+        {
+            error = chunks[i].error;
+        }
+        if (error == SUCCESS &&
+            !dicotomic_tree_take_species(builder->trees[chunks[i].tree], chunks[i].builder.trees[0]))
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+        }
+        builder_free(&chunks[i].builder);
+    }
+    free(chunks);
+
+    return error;
+}
+
+/**
+ * @brief Hand the trees of a parsed key to the caller, or free them on error
+ *
+ * Every tree must hold species. Species names point into the buffer, so the
+ * trees keep it; a buffer shared by several trees is released with the last
+ * one.
+ *
+ * @param builder The builder holding the trees
+ * @param json The key
+ * @param json_size The size of the key
+ * @param release The function that releases the key
+ * @param error The result of the parse
+ * @param trees Pointer to store the array of trees, freed by the caller
+ * @param num_trees Pointer to store the number of trees
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode finish_key_trees(
+    TreeBuilder *builder,
+    char *json,
+    size_t json_size,
+    TreeSourceRelease release,
+    StatusCode error,
+    DicotomicTree ***trees,
+    int *num_trees)
+{
+    if (error == SUCCESS && builder->num_trees == 0)
+    {
+        logger_error("Invalid key or no trees");
+        error = ERROR_INVALID_JSON;
+    }
+
+    for (int i = 0; i < builder->num_trees && error == SUCCESS; i++)
+    {
+        if (builder->trees[i]->num_species == 0)
+        {
+            logger_error("Tree '%s' has no species", builder->trees[i]->name);
+            error = ERROR_INVALID_JSON;
+        }
+    }
+
+    SharedKey *shared = NULL;
+    if (error == SUCCESS && builder->num_trees > 1)
+    {
+        shared = malloc(sizeof(SharedKey));
+        if (!shared)
+        {
+            logger_error("Failed to allocate memory for shared key");
+            error = ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    if (error != SUCCESS)
+    {
+        builder_free(builder);
+        release(json, json_size);
+        return error;
+    }
+
+    if (shared)
+    {
+        shared->json = json;
+        shared->json_size = json_size;
+        shared->release = release;
+        shared->references = builder->num_trees;
+        for (int i = 0; i < builder->num_trees; i++)
+        {
+            dicotomic_tree_attach_source(builder->trees[i], shared, sizeof(SharedKey), release_shared_key);
+        }
+    }
+    else
+    {
+        dicotomic_tree_attach_source(builder->trees[0], json, json_size, release);
+    }
+
+    *trees = builder->trees;
+    *num_trees = builder->num_trees;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Parse every tree of a key file, on several threads when it holds enough species
+ *
+ * @param file_path The path of the key
+ * @param num_threads The number of threads, 0 for one per processor
+ * @param trees Pointer to store the array of trees, freed by the caller
+ * @param num_trees Pointer to store the number of trees
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode parse_json_file_trees(const char *file_path, int num_threads, DicotomicTree ***trees, int *num_trees)
+{
+    char *json = NULL;
+    size_t json_size = 0;
+    TreeSourceRelease release = NULL;
+
+    *trees = NULL;
+    *num_trees = 0;
+
+    if (!load_key(file_path, &json, &json_size, &release))
+    {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = parallel_available_threads();
+    }
+
+    JsonScannerKernel kernel = json_scanner_detect_kernel();
+    TreeBuilder builder = {.trees = NULL, .num_trees = 0};
+    StatusCode error;
+
+    // Keys that cannot be cut into species are parsed sequentially, which
+    // also reports their errors
+    SpeciesBoundaries boundaries = {.arrays = NULL, .num_arrays = 0, .starts = NULL, .count = 0};
+    if (num_threads > 1 &&
+        find_species_boundaries(json, json_size, kernel, &boundaries) &&
+        boundaries.count > 1)
+    {
+        error = parse_key_parallel(json, json_size, kernel, &boundaries, num_threads, &builder);
+    }
+    else
+    {
+        error = parse_key_range(json, 0, json_size, kernel, parser_parse_document, &builder);
+    }
+    species_boundaries_free(&boundaries);
+
+    return finish_key_trees(&builder, json, json_size, release, error, trees, num_trees);
+}
+
+/**
+ * @brief Take the only tree of a key, freeing the trees if there are more
+ *
+ * @param file_path The path of the key
+ * @param trees The trees of the key, freed
+ * @param num_trees The number of trees
+ * @return DicotomicTree* The tree or NULL if the key holds several trees
+ */
+static DicotomicTree *single_tree(const char *file_path, DicotomicTree **trees, int num_trees)
+{
+    DicotomicTree *tree = trees[0];
+    if (num_trees > 1)
+    {
+        logger_error("Key %s holds %d trees instead of one", file_path, num_trees);
+        for (int i = 0; i < num_trees; i++)
+        {
+            dicotomic_tree_free(trees[i]);
+        }
+        tree = NULL;
+    }
+    free(trees);
+
+    return tree;
+}
+
+/**
+ * @brief Parse a key file that holds a single tree
+ *
+ * @param file_path The path of the key
+ * @param num_threads The number of threads, 0 for one per processor
+ * @return DicotomicTree* The parsed tree or NULL if parsing failed
+ */
+static DicotomicTree *parse_json_file_parallel(const char *file_path, int num_threads)
+{
+    DicotomicTree **trees;
+    int num_trees;
+
+    if (parse_json_file_trees(file_path, num_threads, &trees, &num_trees) != SUCCESS)
+    {
+        return NULL;
+    }
+
+    return single_tree(file_path, trees, num_trees);
+}
+
+static DicotomicTree *parse_json_file(const char *file_path)
+{
+    return parse_json_file_parallel(file_path, 1);
+}
+
+static StatusCode parse_json_stream(const char *file_path, const JsonParserCallbacks *callbacks, void *context)
+{
+    bool from_stdin = strcmp(file_path, "-") == 0;
+    int fd = from_stdin ? STDIN_FILENO : open(file_path, O_RDONLY);
+    if (fd < 0)
+    {
+        logger_error("Failed to open file: %s", file_path);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    JsonParser parser;
+    if (!parser_init_stream(&parser, fd))
+    {
+        if (!from_stdin)
+        {
+            close(fd);
+        }
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    StatusCode error = parser_parse_document(&parser, callbacks, context);
+
+    parser_free(&parser);
+    if (!from_stdin)
+    {
+        close(fd);
+    }
+
+    return error;
+}
+
+/**
+ * @brief Parse the NDJSON records of a range, one per line
+ *
+ * Blank lines are skipped. Each line gets its own parser, so a record that
+ * does not end with its line is rejected.
+ *
+ * @param json The input
+ * @param start The offset where the range starts, at the start of a line
+ * @param end The offset where the range ends, at the end of a line
+ * @param scanner The scanner reused for every line, or NULL
+ * @param kernel The kernel used to find structural characters
+ * @param callbacks The callbacks to invoke
+ * @param context Opaque pointer passed to every callback
+ * @param tree_open Whether a tree is open, updated as headers are read
+ * @param first_line The number of the line at the start of json, for errors
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode parse_ndjson_lines(
+    char *json,
+    size_t start,
+    size_t end,
+    JsonScanner *scanner,
+    JsonScannerKernel kernel,
+    const JsonParserCallbacks *callbacks,
+    void *context,
+    bool *tree_open,
+    size_t first_line)
+{
+    size_t line_start = start;
+
+    while (line_start < end)
+    {
+        const char *newline = memchr(json + line_start, '\n', end - line_start);
+        size_t line_end = newline ? (size_t)(newline - json) : end;
+
+        if (scanner)
+        {
+            json_scanner_init(scanner, json, line_start, line_end, kernel);
+        }
+
+        JsonParser parser;
+        parser_init(&parser, json, line_start, line_end, scanner);
+
+        StatusCode error = SUCCESS;
+        if (parser.current_token.type != TOKEN_EOF)
+        {
+            error = parser_parse_record(&parser, callbacks, context, tree_open);
+        }
+        parser_free(&parser);
+
+        if (error != SUCCESS)
+        {
+            // Lines are only counted when something went wrong
+            size_t line = first_line;
+            for (const char *c = json; (c = memchr(c, '\n', (size_t)(json + line_start - c))) != NULL; c++)
+            {
+                line++;
+            }
+            logger_error("Invalid record on line %zu", line);
+            return error;
+        }
+
+        line_start = line_end + 1;
+    }
+
+    return SUCCESS;
+}
+
+static void parse_ndjson_chunk_task(void *context, size_t index)
+{
+    ChunkedParse *parse = context;
+    SpeciesChunk *chunk = &parse->chunks[index];
+
+    // Chunks after the first one continue the tree open where they start;
+    // without memory for the scanner the parser still works byte by byte
+    bool tree_open = index > 0;
+    JsonScanner *scanner = malloc(sizeof(JsonScanner));
+
+    chunk->error = parse_ndjson_lines(
+        parse->json,
+        chunk->start,
+        chunk->end,
+        scanner,
+        parse->kernel,
+        &tree_builder_callbacks,
+        &chunk->builder,
+        &tree_open,
+        1);
+
+    free(scanner);
+}
+
+/**
+ * @brief Move the trees of a builder from an index on to the end of another
+ *
+ * @param builder The builder receiving the trees
+ * @param other The builder giving its trees, left with the ones before first
+ * @param first The index of the first tree moved
+ * @return bool true if successful, false otherwise
+ */
+static bool builder_take_trees(TreeBuilder *builder, TreeBuilder *other, int first)
+{
+    int count = other->num_trees - first;
+    if (count <= 0)
+    {
+        return true;
+    }
+
+    DicotomicTree **new_trees = realloc(builder->trees, (builder->num_trees + count) * sizeof(DicotomicTree *));
+    if (!new_trees)
+    {
+        logger_error("Failed to resize trees array");
+        return false;
+    }
+
+    builder->trees = new_trees;
+    memcpy(builder->trees + builder->num_trees, other->trees + first, count * sizeof(DicotomicTree *));
+    builder->num_trees += count;
+    other->num_trees = first;
+
+    return true;
+}
+
+/**
+ * @brief Parse every tree of an NDJSON key file, on several threads when asked
+ *
+ * The file is cut at line boundaries into chunks of similar size. Each chunk
+ * collects the species that continue the tree open where it starts, then the
+ * trees whose headers it holds. Merging the chunks in order yields the trees
+ * of a sequential parse.
+ *
+ * @param file_path The path of the key
+ * @param num_threads The number of threads, 0 for one per processor
+ * @param trees Pointer to store the array of trees, freed by the caller
+ * @param num_trees Pointer to store the number of trees
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode parse_ndjson_file_trees(const char *file_path, int num_threads, DicotomicTree ***trees, int *num_trees)
+{
+    char *json = NULL;
+    size_t json_size = 0;
+    TreeSourceRelease release = NULL;
+
+    *trees = NULL;
+    *num_trees = 0;
+
+    if (!load_key(file_path, &json, &json_size, &release))
+    {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = parallel_available_threads();
+    }
+
+    size_t target_chunks = (num_threads > 1) ? (size_t)num_threads * CHUNKS_PER_THREAD : 1;
+    SpeciesChunk *chunks = calloc(target_chunks, sizeof(SpeciesChunk));
+    if (!chunks)
+    {
+        logger_error("Failed to allocate memory for species chunks");
+        release(json, json_size);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Cut after the first newline past each share of the file
+    size_t num_chunks = 0;
+    size_t start = 0;
+    for (size_t i = 1; i <= target_chunks && start < json_size; i++)
+    {
+        size_t end = json_size;
+        if (i < target_chunks)
+        {
+            size_t target = json_size / target_chunks * i;
+            const char *newline = (target > start) ? memchr(json + target, '\n', json_size - target) : NULL;
+            end = newline ? (size_t)(newline - json) + 1 : json_size;
+            if (target <= start)
+            {
+                continue;
+            }
+        }
+
+        chunks[num_chunks].start = start;
+        chunks[num_chunks].end = end;
+        num_chunks++;
+        start = end;
+    }
+
+    StatusCode error = SUCCESS;
+    for (size_t i = 0; i < num_chunks && error == SUCCESS; i++)
+    {
+        error = builder_on_tree_start(&chunks[i].builder, "");
+    }
+
+    if (error == SUCCESS)
+    {
+        ChunkedParse parse = {.json = json, .kernel = json_scanner_detect_kernel(), .chunks = chunks};
+        parallel_for(num_chunks, num_threads, parse_ndjson_chunk_task, &parse);
+    }
+
+    // Merge in file order; the first chunk that failed decides the error
+    TreeBuilder builder = {.trees = NULL, .num_trees = 0};
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        TreeBuilder *chunk_builder = &chunks[i].builder;
+
+        if (error == SUCCESS && chunks[i].error != SUCCESS)
+        {
+            error = chunks[i].error;
+        }
+
+        if (error == SUCCESS && chunk_builder->num_trees > 0 && chunk_builder->trees[0]->num_species > 0)
+        {
+            if (builder.num_trees == 0)
+            {
+                logger_error("Species before the first tree header");
+                error = ERROR_INVALID_JSON;
+            }
+            else if (!dicotomic_tree_take_species(builder.trees[builder.num_trees - 1], chunk_builder->trees[0]))
+            {
+                error = ERROR_MEMORY_ALLOCATION;
+            }
+        }
+
+        if (error == SUCCESS && !builder_take_trees(&builder, chunk_builder, 1))
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+        }
+
+        builder_free(chunk_builder);
+    }
+    free(chunks);
+
+    return finish_key_trees(&builder, json, json_size, release, error, trees, num_trees);
+}
+
+static DicotomicTree *parse_ndjson_file_parallel(const char *file_path, int num_threads)
+{
+    DicotomicTree **trees;
+    int num_trees;
+
+    if (parse_ndjson_file_trees(file_path, num_threads, &trees, &num_trees) != SUCCESS)
+    {
+        return NULL;
+    }
+
+    return single_tree(file_path, trees, num_trees);
+}
+
+static DicotomicTree *parse_ndjson_file(const char *file_path)
+{
+    return parse_ndjson_file_parallel(file_path, 1);
+}
+
+/**
+ * @brief Stream an NDJSON key line by line
+ *
+ * Only the line being parsed is kept in memory.
+ */
+static StatusCode parse_ndjson_stream(const char *file_path, const JsonParserCallbacks *callbacks, void *context)
+{
+    bool from_stdin = strcmp(file_path, "-") == 0;
+    FILE *file = from_stdin ? stdin : fopen(file_path, "r");
+    if (!file)
+    {
+        logger_error("Failed to open file: %s", file_path);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    JsonScanner *scanner = malloc(sizeof(JsonScanner));
+    JsonScannerKernel kernel = json_scanner_detect_kernel();
+    StatusCode error = SUCCESS;
+    bool tree_open = false;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    size_t line_number = 1;
+    ssize_t line_size;
+
+    while (error == SUCCESS && (line_size = getline(&line, &line_capacity, file)) >= 0)
+    {
+        error = parse_ndjson_lines(line, 0, (size_t)line_size, scanner, kernel, callbacks, context, &tree_open, line_number);
+        line_number++;
+    }
+
+    if (error == SUCCESS && ferror(file))
+    {
+        logger_error("Failed to read key file: %s", file_path);
+        error = ERROR_FILE_NOT_FOUND;
+    }
+
+    if (error == SUCCESS && tree_open && callbacks->on_tree_end)
+    {
+        error = callbacks->on_tree_end(context);
+    }
+
+    free(line);
+    free(scanner);
+    if (!from_stdin)
+    {
+        fclose(file);
+    }
+
+    return error;
+}
+
+static void parser_init(JsonParser *parser, char *json, size_t start, size_t end, JsonScanner *scanner)
+{
+    parser->json = json;
+    parser->pos = start;
+    parser->len = end;
+    parser->current_token.type = TOKEN_NONE;
+    parser->current_token.value = NULL;
+    parser->current_token.length = 0;
+    parser->scanner = scanner;
+    parser->fd = -1;
+    parser->capacity = end;
+    parser->mark = start;
+    parser->held = NULL;
+    parser->held_capacity = 0;
+
+    parser_next_token(parser);
+}
+
+static bool parser_init_stream(JsonParser *parser, int fd)
+{
+    char *window = malloc(STREAM_WINDOW_SIZE);
+    if (!window)
+    {
+        logger_error("Failed to allocate memory for input window");
+        return false;
+    }
+
+    parser->json = window;
+    parser->pos = 0;
+    parser->len = 0;
+    parser->current_token.type = TOKEN_NONE;
+    parser->current_token.value = NULL;
+    parser->current_token.length = 0;
+    parser->scanner = NULL;
+    parser->fd = fd;
+    parser->capacity = STREAM_WINDOW_SIZE;
+    parser->mark = 0;
+    parser->held = NULL;
+    parser->held_capacity = 0;
+
+    parser_next_token(parser);
+    return true;
+}
 
-static DicotomicTree *parse_json_file(const char *file_path)
+static void parser_free(JsonParser *parser)
 {
-    FILE *file = fopen(file_path, "r");
-    if (!file)
+    free(parser->held);
+    parser->held = NULL;
+    parser->held_capacity = 0;
+
+    // The window belongs to the parser only when streaming
+    if (parser->fd >= 0)
     {
-        logger_error("Failed to open file: %s", file_path);
-        return NULL;
+        free(parser->json);
+        parser->json = NULL;
     }
+}
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+/**
+ * @brief Read more input into the window, dropping what was already consumed
+ *
+ * @param parser The parser
+ * @return bool true if new bytes were read, false at end of input
+ */
+static bool parser_fill(JsonParser *parser)
+{
+    if (parser->fd < 0)
+    {
+        return false;
+    }
 
-    // Read file content
-    char *json = malloc(file_size + 1);
-    if (!json)
+    // Drop everything before the token being read
+    if (parser->mark > 0)
     {
-        logger_error("Failed to allocate memory for file content");
-        fclose(file);
-        return NULL;
+        memmove(parser->json, parser->json + parser->mark, parser->len - parser->mark);
+        parser->len -= parser->mark;
+        parser->pos -= parser->mark;
+        parser->mark = 0;
     }
 
-    size_t read_size = fread(json, 1, file_size, file);
-    json[read_size] = '\0';
-    fclose(file);
+    // Grow only when a single token does not fit in the window
+    if (parser->len == parser->capacity)
+    {
+        char *new_window = realloc(parser->json, parser->capacity * 2);
+        if (!new_window)
+        {
+            logger_error("Failed to resize input window");
+            return false;
+        }
+        parser->json = new_window;
+        parser->capacity *= 2;
+    }
 
-    // Parse JSON
-    JsonParser parser;
-    parser_init(&parser, json);
-    DicotomicTree *tree = parser_parse_tree(&parser);
+    ssize_t read_size;
+    do
+    {
+        read_size = read(parser->fd, parser->json + parser->len, parser->capacity - parser->len);
+    } while (read_size < 0 && errno == EINTR);
 
-    // Clean up
-    parser_free(&parser);
-    free(json);
+    if (read_size < 0)
+    {
+        logger_error("Failed to read key: %s", strerror(errno));
+        return false;
+    }
 
-    return tree;
+    parser->len += (size_t)read_size;
+    return read_size > 0;
 }
 
-static void parser_init(JsonParser *parser, const char *json)
+/**
+ * @brief Make sure count bytes are available from the current position
+ *
+ * @param parser The parser
+ * @param count The number of bytes needed
+ * @return bool true if they are available, false if the input ends first
+ */
+static bool parser_available(JsonParser *parser, size_t count)
 {
-    parser->json = json;
-    parser->pos = 0;
-    parser->len = strlen(json);
-    parser->current_token.type = TOKEN_NONE;
-    parser->current_token.value = NULL;
+    while (parser->pos + count > parser->len)
+    {
+        if (!parser_fill(parser))
+        {
+            return false;
+        }
+    }
 
-    parser_next_token(parser);
+    return true;
 }
 
-static void parser_free(JsonParser *parser)
+/**
+ * @brief Check that the current position ends a literal, number or string
+ *
+ * @param parser The parser
+ * @return bool true if the input ends here or continues with whitespace or a structural character
+ */
+static bool parser_at_delimiter(JsonParser *parser)
 {
-    if (parser->current_token.value)
+    if (!parser_available(parser, 1))
     {
-        free(parser->current_token.value);
-        parser->current_token.value = NULL;
+        return true;
     }
+
+    char c = parser->json[parser->pos];
+    return isspace((unsigned char)c) || c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
 }
 
 static void parser_next_token(JsonParser *parser)
 {
-    // Free previous token value
-    if (parser->current_token.value)
+    parser->current_token.value = NULL;
+    parser->current_token.length = 0;
+
+    // Jump to the next structural position
+    if (parser->scanner)
     {
-        free(parser->current_token.value);
-        parser->current_token.value = NULL;
+        parser->pos = json_scanner_next(parser->scanner);
+        parser->mark = parser->pos;
+
+        if (parser->pos >= parser->len)
+        {
+            parser->current_token.type = TOKEN_EOF;
+            return;
+        }
     }
 
     // Skip whitespace
-    while (parser->pos < parser->len && isspace(parser->json[parser->pos]))
+    while (!parser->scanner)
     {
-        parser->pos++;
-    }
+        parser->mark = parser->pos;
 
-    // Check for EOF
-    if (parser->pos >= parser->len)
-    {
-        parser->current_token.type = TOKEN_EOF;
-        return;
+        if (!parser_available(parser, 1))
+        {
+            // Check for EOF
+            parser->current_token.type = TOKEN_EOF;
+            return;
+        }
+
+        if (!isspace((unsigned char)parser->json[parser->pos]))
+        {
+            break;
+        }
+        parser->pos++;
     }
 
     // Parse token
@@ -165,7 +1478,7 @@ static void parser_next_token(JsonParser *parser)
         parser->current_token.value = parser_parse_string(parser);
         break;
     case 't':
-        if (parser->pos + 3 < parser->len &&
+        if (parser_available(parser, 4) &&
             parser->json[parser->pos + 1] == 'r' &&
             parser->json[parser->pos + 2] == 'u' &&
             parser->json[parser->pos + 3] == 'e')
@@ -180,7 +1493,7 @@ static void parser_next_token(JsonParser *parser)
         }
         break;
     case 'f':
-        if (parser->pos + 4 < parser->len &&
+        if (parser_available(parser, 5) &&
             parser->json[parser->pos + 1] == 'a' &&
             parser->json[parser->pos + 2] == 'l' &&
             parser->json[parser->pos + 3] == 's' &&
@@ -196,7 +1509,7 @@ static void parser_next_token(JsonParser *parser)
         }
         break;
     case 'n':
-        if (parser->pos + 3 < parser->len &&
+        if (parser_available(parser, 4) &&
             parser->json[parser->pos + 1] == 'u' &&
             parser->json[parser->pos + 2] == 'l' &&
             parser->json[parser->pos + 3] == 'l')
@@ -211,13 +1524,12 @@ static void parser_next_token(JsonParser *parser)
         }
         break;
     default:
-        if (isdigit(c) || c == '-')
+        if (isdigit((unsigned char)c) || c == '-')
         {
             // Parse number (simplified)
             parser->current_token.type = TOKEN_NUMBER;
-            size_t start = parser->pos;
-            while (parser->pos < parser->len &&
-                   (isdigit(parser->json[parser->pos]) ||
+            while (parser_available(parser, 1) &&
+                   (isdigit((unsigned char)parser->json[parser->pos]) ||
                     parser->json[parser->pos] == '.' ||
                     parser->json[parser->pos] == '-' ||
                     parser->json[parser->pos] == '+' ||
@@ -226,13 +1538,8 @@ static void parser_next_token(JsonParser *parser)
             {
                 parser->pos++;
             }
-            size_t len = parser->pos - start;
-            parser->current_token.value = malloc(len + 1);
-            if (parser->current_token.value)
-            {
-                strncpy(parser->current_token.value, parser->json + start, len);
-                parser->current_token.value[len] = '\0';
-            }
+            parser->current_token.value = parser->json + parser->mark;
+            parser->current_token.length = parser->pos - parser->mark;
         }
         else
         {
@@ -242,6 +1549,27 @@ static void parser_next_token(JsonParser *parser)
         }
         break;
     }
+
+    // Tokens must be separated, which the scanner alone does not check
+    TokenType type = parser->current_token.type;
+    if ((type == TOKEN_STRING || type == TOKEN_NUMBER || type == TOKEN_TRUE ||
+         type == TOKEN_FALSE || type == TOKEN_NULL))
+    {
+        // Checking may refill the window, which moves the token with the mark
+        size_t value_offset = parser->current_token.value
+                                  ? (size_t)(parser->current_token.value - parser->json) - parser->mark
+                                  : 0;
+
+        if (!parser_at_delimiter(parser))
+        {
+            logger_error("Invalid token at position %zu", parser->pos);
+            parser->current_token.type = TOKEN_NONE;
+        }
+        else if (parser->current_token.value)
+        {
+            parser->current_token.value = parser->json + parser->mark + value_offset;
+        }
+    }
 }
 
 static bool parser_expect(JsonParser *parser, TokenType type)
@@ -261,84 +1589,133 @@ static char *parser_parse_string(JsonParser *parser)
     // Skip opening quote
     parser->pos++;
 
-    size_t start = parser->pos;
-    size_t len = 0;
+    bool has_escapes = false;
+
+    // The scanner already knows the closing quote
+    if (parser->scanner)
+    {
+        size_t start = parser->pos;
+        parser->pos = json_scanner_next(parser->scanner);
+        has_escapes = parser->pos < parser->len &&
+                      memchr(parser->json + start, '\\', parser->pos - start) != NULL;
+    }
 
     // Find closing quote
-    while (parser->pos < parser->len && parser->json[parser->pos] != '"')
+    while (!parser->scanner && parser_available(parser, 1) && parser->json[parser->pos] != '"')
     {
         // Handle escape sequences
-        if (parser->json[parser->pos] == '\\' && parser->pos + 1 < parser->len)
+        if (parser->json[parser->pos] == '\\' && parser_available(parser, 2))
         {
             parser->pos += 2;
+            has_escapes = true;
         }
         else
         {
             parser->pos++;
         }
-        len++;
     }
 
-    // Skip closing quote
-    if (parser->pos < parser->len)
-    {
-        parser->pos++;
-    }
+    // The window may have moved while reading, so positions are taken now
+    size_t start = parser->mark + 1;
+    size_t end = parser->pos;
 
-    // Allocate and copy string
-    char *str = malloc(len + 1);
-    if (!str)
+    if (parser->pos >= parser->len || parser->json[parser->pos] != '"')
     {
-        logger_error("Failed to allocate memory for string");
+        logger_error("Unterminated string at position %zu", parser->mark);
         return NULL;
     }
 
-    // Copy and unescape string
-    size_t j = 0;
-    for (size_t i = start; i < start + len; i++)
+    // Skip closing quote
+    parser->pos++;
+
+    // Unescape in place: the text only shrinks, and the closing quote always
+    // leaves room for the terminator
+    size_t j = end;
+    if (has_escapes)
     {
-        if (parser->json[i] == '\\' && i + 1 < parser->len)
+        j = start;
+        for (size_t i = start; i < end; i++)
         {
-            i++;
-            switch (parser->json[i])
+            if (parser->json[i] == '\\' && i + 1 < end)
+            {
+                i++;
+                switch (parser->json[i])
+                {
+                case 'n':
+                    parser->json[j++] = '\n';
+                    break;
+                case 'r':
+                    parser->json[j++] = '\r';
+                    break;
+                case 't':
+                    parser->json[j++] = '\t';
+                    break;
+                case 'b':
+                    parser->json[j++] = '\b';
+                    break;
+                case 'f':
+                    parser->json[j++] = '\f';
+                    break;
+                case '\\':
+                    parser->json[j++] = '\\';
+                    break;
+                case '/':
+                    parser->json[j++] = '/';
+                    break;
+                case '"':
+                    parser->json[j++] = '"';
+                    break;
+                default:
+                    parser->json[j++] = parser->json[i];
+                    break;
+                }
+            }
+            else
             {
-            case 'n':
-                str[j++] = '\n';
-                break;
-            case 'r':
-                str[j++] = '\r';
-                break;
-            case 't':
-                str[j++] = '\t';
-                break;
-            case 'b':
-                str[j++] = '\b';
-                break;
-            case 'f':
-                str[j++] = '\f';
-                break;
-            case '\\':
-                str[j++] = '\\';
-                break;
-            case '/':
-                str[j++] = '/';
-                break;
-            case '"':
-                str[j++] = '"';
-                break;
-            default:
-                str[j++] = parser->json[i];
-                break;
+                parser->json[j++] = parser->json[i];
             }
         }
-        else
+    }
+
+    parser->json[j] = '\0';
+    parser->current_token.length = j - start;
+
+    return parser->json + start;
+}
+
+/**
+ * @brief Keep the current string token readable past the next tokens
+ *
+ * Strings inside a whole buffer already are; streamed ones are copied into a
+ * scratch buffer reused between calls.
+ *
+ * @param parser The parser
+ * @return const char* The string or NULL if memory allocation failed
+ */
+static const char *parser_hold_string(JsonParser *parser)
+{
+    const char *value = parser->current_token.value;
+
+    if (parser->fd < 0)
+    {
+        return value;
+    }
+
+    size_t len = parser->current_token.length;
+    if (len + 1 > parser->held_capacity)
+    {
+        char *new_held = realloc(parser->held, len + 1);
+        if (!new_held)
         {
-            str[j++] = parser->json[i];
+            logger_error("Failed to allocate memory for string");
+            return NULL;
         }
+        parser->held = new_held;
+        parser->held_capacity = len + 1;
     }
 
-    str[j] = '\0';
-    return str;
+    memcpy(parser->held, value, len + 1);
+    return parser->held;
 }
 
 static bool parser_parse_boolean(JsonParser *parser)
@@ -348,97 +1725,181 @@ static bool parser_parse_boolean(JsonParser *parser)
     return value;
 }
 
-static DicotomicTree *parser_parse_tree(JsonParser *parser)
+static StatusCode parser_parse_document(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
 {
+    StatusCode error;
+
     // Expect object start
     if (!parser_expect(parser, TOKEN_OBJECT_START))
     {
-        return NULL;
+        return ERROR_INVALID_JSON;
     }
 
+    // Parse trees separated by commas
+    while (true)
+    {
+        if ((error = parser_parse_tree_open(parser, callbacks, context)) != SUCCESS ||
+            (error = parser_parse_species_list(parser, TOKEN_ARRAY_END, callbacks, context)) != SUCCESS ||
+            (error = parser_parse_tree_close(parser, callbacks, context)) != SUCCESS)
+        {
+            return error;
+        }
+
+        if (parser->current_token.type != TOKEN_COMMA)
+        {
+            break;
+        }
+        parser_next_token(parser);
+    }
+
+    // Expect object end
+    if (!parser_expect(parser, TOKEN_OBJECT_END))
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Parse the name of a tree up to the opening of its species array
+ */
+static StatusCode parser_parse_tree_open(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
+{
+    StatusCode error;
+
     // Parse tree name
-    if (parser->current_token.type != TOKEN_STRING)
+    if (parser->current_token.type != TOKEN_STRING || !parser->current_token.value)
     {
         logger_error("Expected tree name as string");
-        return NULL;
+        return ERROR_INVALID_JSON;
     }
 
-    char *tree_name = my_strdup(parser->current_token.value);
+    if (callbacks->on_tree_start &&
+        (error = callbacks->on_tree_start(context, parser->current_token.value)) != SUCCESS)
+    {
+        return error;
+    }
     parser_next_token(parser);
 
     // Expect colon
     if (!parser_expect(parser, TOKEN_COLON))
     {
-        free(tree_name);
-        return NULL;
+        return ERROR_INVALID_JSON;
     }
 
     // Expect array start
     if (!parser_expect(parser, TOKEN_ARRAY_START))
     {
-        free(tree_name);
-        return NULL;
+        return ERROR_INVALID_JSON;
     }
 
-    // Create tree
-    DicotomicTree *tree = dicotomic_tree_create(tree_name);
-    free(tree_name);
+    return SUCCESS;
+}
+
+/**
+ * @brief Parse the closing of the species array of a tree
+ */
+static StatusCode parser_parse_tree_close(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
+{
+    StatusCode error;
 
-    if (!tree)
+    // Expect array end
+    if (!parser_expect(parser, TOKEN_ARRAY_END))
     {
-        logger_error("Failed to create dicotomic tree");
-        return NULL;
+        return ERROR_INVALID_JSON;
+    }
+
+    if (callbacks->on_tree_end && (error = callbacks->on_tree_end(context)) != SUCCESS)
+    {
+        return error;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Parse a key up to the opening of the species array of its first tree
+ */
+static StatusCode parser_parse_head(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
+{
+    // Expect object start
+    if (!parser_expect(parser, TOKEN_OBJECT_START))
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    return parser_parse_tree_open(parser, callbacks, context);
+}
+
+/**
+ * @brief Parse the end of a tree up to the opening of the species array of the next one
+ */
+static StatusCode parser_parse_between(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
+{
+    StatusCode error = parser_parse_tree_close(parser, callbacks, context);
+    if (error != SUCCESS)
+    {
+        return error;
     }
 
+    // Expect comma
+    if (!parser_expect(parser, TOKEN_COMMA))
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    return parser_parse_tree_open(parser, callbacks, context);
+}
+
+/**
+ * @brief Parse species separated by commas, stopping before the token end
+ */
+static StatusCode parser_parse_species_list(JsonParser *parser, TokenType end, const JsonParserCallbacks *callbacks, void *context)
+{
+    StatusCode error;
+
     // Parse species
     while (parser->current_token.type == TOKEN_OBJECT_START)
     {
         parser_next_token(parser);
 
         // Parse species name
-        if (parser->current_token.type != TOKEN_STRING)
+        if (parser->current_token.type != TOKEN_STRING || !parser->current_token.value)
         {
             logger_error("Expected species name as string");
-            dicotomic_tree_free(tree);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
 
-        char *species_name = my_strdup(parser->current_token.value);
+        if (callbacks->on_species_start &&
+            (error = callbacks->on_species_start(context, parser->current_token.value)) != SUCCESS)
+        {
+            return error;
+        }
         parser_next_token(parser);
 
         // Expect colon
         if (!parser_expect(parser, TOKEN_COLON))
         {
-            free(species_name);
-            dicotomic_tree_free(tree);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
 
         // Parse species characteristics
-        Species *species = parser_parse_species(parser, species_name);
-        free(species_name);
-
-        if (!species)
+        if ((error = parser_parse_species(parser, callbacks, context)) != SUCCESS)
         {
             logger_error("Failed to parse species");
-            dicotomic_tree_free(tree);
-            return NULL;
+            return error;
         }
 
-        // Add species to tree
-        if (!dicotomic_tree_add_species(tree, species))
+        // Expect object end
+        if (!parser_expect(parser, TOKEN_OBJECT_END))
         {
-            logger_error("Failed to add species to tree");
-            species_free(species);
-            dicotomic_tree_free(tree);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
 
-        // Expect object end
-        if (!parser_expect(parser, TOKEN_OBJECT_END))
+        if (callbacks->on_species_end && (error = callbacks->on_species_end(context)) != SUCCESS)
         {
-            dicotomic_tree_free(tree);
-            return NULL;
+            return error;
         }
 
         // Expect comma or array end
@@ -446,57 +1907,66 @@ static DicotomicTree *parser_parse_tree(JsonParser *parser)
         {
             parser_next_token(parser);
         }
-        else if (parser->current_token.type == TOKEN_ARRAY_END)
+        else if (parser->current_token.type == end)
         {
             break;
         }
         else
         {
             logger_error("Expected comma or array end");
-            dicotomic_tree_free(tree);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
     }
 
-    // Expect array end
-    if (!parser_expect(parser, TOKEN_ARRAY_END))
+    return SUCCESS;
+}
+
+/**
+ * @brief Parse a run of species cut out of the species array
+ *
+ * Every chunk but the last one ends with the comma before the next species.
+ */
+static StatusCode parser_parse_species_chunk(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
+{
+    StatusCode error = parser_parse_species_list(parser, TOKEN_EOF, callbacks, context);
+
+    if (error == SUCCESS && parser->current_token.type != TOKEN_EOF)
     {
-        dicotomic_tree_free(tree);
-        return NULL;
+        logger_error("Expected comma or array end");
+        error = ERROR_INVALID_JSON;
     }
 
-    // Expect object end
-    if (!parser_expect(parser, TOKEN_OBJECT_END))
+    return error;
+}
+
+/**
+ * @brief Parse the end of the last tree and of the key
+ */
+static StatusCode parser_parse_tail(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
+{
+    StatusCode error = parser_parse_tree_close(parser, callbacks, context);
+    if (error != SUCCESS)
     {
-        dicotomic_tree_free(tree);
-        return NULL;
+        return error;
     }
 
-    // Extract questions
-    if (!dicotomic_tree_extract_questions(tree))
+    // Expect object end
+    if (!parser_expect(parser, TOKEN_OBJECT_END))
     {
-        logger_error("Failed to extract questions from tree");
-        dicotomic_tree_free(tree);
-        return NULL;
+        return ERROR_INVALID_JSON;
     }
 
-    return tree;
+    return SUCCESS;
 }
 
-static Species *parser_parse_species(JsonParser *parser, const char *name)
+static StatusCode parser_parse_species(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context)
 {
+    StatusCode error;
+
     // Expect array start
     if (!parser_expect(parser, TOKEN_ARRAY_START))
     {
-        return NULL;
-    }
-
-    // Create species
-    Species *species = species_create(name);
-    if (!species)
-    {
-        logger_error("Failed to create species");
-        return NULL;
+        return ERROR_INVALID_JSON;
     }
 
     // Parse characteristics
@@ -505,22 +1975,23 @@ static Species *parser_parse_species(JsonParser *parser, const char *name)
         parser_next_token(parser);
 
         // Parse question
-        if (parser->current_token.type != TOKEN_STRING)
+        if (parser->current_token.type != TOKEN_STRING || !parser->current_token.value)
         {
             logger_error("Expected question as string");
-            species_free(species);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
 
-        char *question = my_strdup(parser->current_token.value);
+        const char *question = parser_hold_string(parser);
+        if (!question)
+        {
+            return ERROR_MEMORY_ALLOCATION;
+        }
         parser_next_token(parser);
 
         // Expect colon
         if (!parser_expect(parser, TOKEN_COLON))
         {
-            free(question);
-            species_free(species);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
 
         // Parse answer
@@ -532,27 +2003,20 @@ static Species *parser_parse_species(JsonParser *parser, const char *name)
         else
         {
             logger_error("Expected boolean value");
-            free(question);
-            species_free(species);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
 
-        // Add characteristic to species
-        if (!species_add_characteristic(species, question, answer))
+        // Report characteristic
+        if (callbacks->on_characteristic &&
+            (error = callbacks->on_characteristic(context, question, answer)) != SUCCESS)
         {
-            logger_error("Failed to add characteristic to species");
-            free(question);
-            species_free(species);
-            return NULL;
+            return error;
         }
 
-        free(question);
-
         // Expect object end
         if (!parser_expect(parser, TOKEN_OBJECT_END))
         {
-            species_free(species);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
 
         // Expect comma or array end
@@ -567,25 +2031,131 @@ static Species *parser_parse_species(JsonParser *parser, const char *name)
         else
         {
             logger_error("Expected comma or array end");
-            species_free(species);
-            return NULL;
+            return ERROR_INVALID_JSON;
         }
     }
 
     // Expect array end
     if (!parser_expect(parser, TOKEN_ARRAY_END))
     {
-        species_free(species);
-        return NULL;
+        return ERROR_INVALID_JSON;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Parse one NDJSON record: a tree header or a species
+ *
+ * A header {"tree": "<name>"} ends the open tree and starts a new one; any
+ * other record is a species object of the open tree, as in a JSON key.
+ */
+static StatusCode parser_parse_record(JsonParser *parser, const JsonParserCallbacks *callbacks, void *context, bool *tree_open)
+{
+    StatusCode error;
+
+    // Expect object start
+    if (!parser_expect(parser, TOKEN_OBJECT_START))
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    if (parser->current_token.type != TOKEN_STRING || !parser->current_token.value)
+    {
+        logger_error("Expected tree header or species name as string");
+        return ERROR_INVALID_JSON;
+    }
+
+    // Records are parsed from whole lines, so the name stays valid
+    const char *name = parser->current_token.value;
+    parser_next_token(parser);
+
+    // Expect colon
+    if (!parser_expect(parser, TOKEN_COLON))
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    if (parser->current_token.type == TOKEN_STRING)
+    {
+        if (strcmp(name, NDJSON_TREE_KEY) != 0 || !parser->current_token.value)
+        {
+            logger_error("Expected \"%s\" as the key of a tree header", NDJSON_TREE_KEY);
+            return ERROR_INVALID_JSON;
+        }
+
+        if (*tree_open && callbacks->on_tree_end && (error = callbacks->on_tree_end(context)) != SUCCESS)
+        {
+            return error;
+        }
+
+        if (callbacks->on_tree_start &&
+            (error = callbacks->on_tree_start(context, parser->current_token.value)) != SUCCESS)
+        {
+            return error;
+        }
+        *tree_open = true;
+        parser_next_token(parser);
+    }
+    else
+    {
+        if (!*tree_open)
+        {
+            logger_error("Species before the first tree header");
+            return ERROR_INVALID_JSON;
+        }
+
+        if (callbacks->on_species_start && (error = callbacks->on_species_start(context, name)) != SUCCESS)
+        {
+            return error;
+        }
+
+        // Parse species characteristics
+        if ((error = parser_parse_species(parser, callbacks, context)) != SUCCESS)
+        {
+            logger_error("Failed to parse species");
+            return error;
+        }
+
+        if (callbacks->on_species_end && (error = callbacks->on_species_end(context)) != SUCCESS)
+        {
+            return error;
+        }
+    }
+
+    // Expect object end
+    if (!parser_expect(parser, TOKEN_OBJECT_END))
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    if (parser->current_token.type != TOKEN_EOF)
+    {
+        logger_error("Expected one record per line");
+        return ERROR_INVALID_JSON;
     }
 
-    return species;
+    return SUCCESS;
 }
 
 static const JsonParserPort json_parser = {
-    .parse_file = parse_json_file};
+    .parse_file = parse_json_file,
+    .parse_file_parallel = parse_json_file_parallel,
+    .parse_file_trees = parse_json_file_trees,
+    .parse_stream = parse_json_stream};
 
 const JsonParserPort *get_json_parser(void)
 {
     return &json_parser;
+}
+
+static const JsonParserPort ndjson_parser = {
+    .parse_file = parse_ndjson_file,
+    .parse_file_parallel = parse_ndjson_file_parallel,
+    .parse_file_trees = parse_ndjson_file_trees,
+    .parse_stream = parse_ndjson_stream};
+
+const JsonParserPort *get_ndjson_parser(void)
+{
+    return &ndjson_parser;
 }
\ No newline at end of file
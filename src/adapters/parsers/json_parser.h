@@ -10,4 +10,15 @@
  */
 const JsonParserPort *get_json_parser(void);
 
+/**
+ * @brief Get the parser for newline-delimited keys
+ *
+ * Each line holds one record: {"tree": "<name>"} starts a tree and every
+ * other line is a species object of the last tree started. The trees are the
+ * same as those of the equivalent JSON key.
+ *
+ * @return const JsonParserPort* The NDJSON parser implementation
+ */
+const JsonParserPort *get_ndjson_parser(void);
+
 #endif /* JSON_PARSER_H */
\ No newline at end of file
@@ -0,0 +1,340 @@
+#include "json_scanner.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+static const uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+static bool is_structural_char(char c)
+{
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+}
+
+static bool is_whitespace_char(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Portable kernel, also the reference the vector kernels are checked against
+static void classify_block_scalar(const char *block, JsonBlockMasks *masks)
+{
+    masks->quote = 0;
+    masks->backslash = 0;
+    masks->structural = 0;
+    masks->whitespace = 0;
+
+    for (int i = 0; i < JSON_SCANNER_BLOCK_SIZE; i++)
+    {
+        uint64_t bit = 1ULL << i;
+        char c = block[i];
+
+        if (c == '"')
+        {
+            masks->quote |= bit;
+        }
+        else if (c == '\\')
+        {
+            masks->backslash |= bit;
+        }
+        else if (is_structural_char(c))
+        {
+            masks->structural |= bit;
+        }
+        else if (is_whitespace_char(c))
+        {
+            masks->whitespace |= bit;
+        }
+    }
+}
+
+#ifdef JSON_SCANNER_X86
+
+static void classify_block_sse2(const char *block, JsonBlockMasks *masks)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i open_brace = _mm_set1_epi8('{');
+    const __m128i close_brace = _mm_set1_epi8('}');
+    const __m128i open_bracket = _mm_set1_epi8('[');
+    const __m128i close_bracket = _mm_set1_epi8(']');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+
+    masks->quote = 0;
+    masks->backslash = 0;
+    masks->structural = 0;
+    masks->whitespace = 0;
+
+    for (int i = 0; i < JSON_SCANNER_BLOCK_SIZE; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(block + i));
+
+        __m128i structural = _mm_or_si128(
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, open_brace), _mm_cmpeq_epi8(chunk, close_brace)),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, open_bracket), _mm_cmpeq_epi8(chunk, close_bracket))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+
+        __m128i whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, carriage_return)));
+
+        masks->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << i;
+        masks->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << i;
+        masks->structural |= (uint64_t)(uint16_t)_mm_movemask_epi8(structural) << i;
+        masks->whitespace |= (uint64_t)(uint16_t)_mm_movemask_epi8(whitespace) << i;
+    }
+}
+
+__attribute__((target("avx2"))) static void classify_block_avx2(const char *block, JsonBlockMasks *masks)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i open_brace = _mm256_set1_epi8('{');
+    const __m256i close_brace = _mm256_set1_epi8('}');
+    const __m256i open_bracket = _mm256_set1_epi8('[');
+    const __m256i close_bracket = _mm256_set1_epi8(']');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage_return = _mm256_set1_epi8('\r');
+
+    masks->quote = 0;
+    masks->backslash = 0;
+    masks->structural = 0;
+    masks->whitespace = 0;
+
+    for (int i = 0; i < JSON_SCANNER_BLOCK_SIZE; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(block + i));
+
+        __m256i structural = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, open_brace), _mm256_cmpeq_epi8(chunk, close_brace)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, open_bracket), _mm256_cmpeq_epi8(chunk, close_bracket))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma)));
+
+        __m256i whitespace = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, carriage_return)));
+
+        masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)) << i;
+        masks->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)) << i;
+        masks->structural |= (uint64_t)(uint32_t)_mm256_movemask_epi8(structural) << i;
+        masks->whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(whitespace) << i;
+    }
+}
+
+#endif /* JSON_SCANNER_X86 */
+
+static bool kernel_supported(JsonScannerKernel kernel)
+{
+    switch (kernel)
+    {
+    case JSON_SCANNER_SCALAR:
+        return true;
+#ifdef JSON_SCANNER_X86
+    case JSON_SCANNER_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case JSON_SCANNER_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+JsonScannerKernel json_scanner_detect_kernel(void)
+{
+    const char *forced = getenv("DICOTODIR_SCANNER");
+    if (forced)
+    {
+        for (int kernel = JSON_SCANNER_SCALAR; kernel <= JSON_SCANNER_AVX2; kernel++)
+        {
+            if (strcmp(forced, json_scanner_kernel_name(kernel)) == 0 && kernel_supported(kernel))
+            {
+                return kernel;
+            }
+        }
+    }
+
+    if (kernel_supported(JSON_SCANNER_AVX2))
+    {
+        return JSON_SCANNER_AVX2;
+    }
+    if (kernel_supported(JSON_SCANNER_SSE2))
+    {
+        return JSON_SCANNER_SSE2;
+    }
+
+    return JSON_SCANNER_SCALAR;
+}
+
+const char *json_scanner_kernel_name(JsonScannerKernel kernel)
+{
+    switch (kernel)
+    {
+    case JSON_SCANNER_SCALAR:
+        return "scalar";
+    case JSON_SCANNER_SSE2:
+        return "sse2";
+    case JSON_SCANNER_AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+void json_scanner_init(JsonScanner *scanner, const char *json, size_t start, size_t end, JsonScannerKernel kernel)
+{
+    scanner->json = json;
+    scanner->end = end;
+    scanner->next_block = start;
+    scanner->prev_escaped = 0;
+    scanner->prev_in_string = 0;
+    scanner->prev_separator = 1;
+    scanner->count = 0;
+    scanner->cursor = 0;
+    scanner->classify = classify_block_scalar;
+
+#ifdef JSON_SCANNER_X86
+    if (kernel == JSON_SCANNER_AVX2 && kernel_supported(kernel))
+    {
+        scanner->classify = classify_block_avx2;
+    }
+    else if (kernel == JSON_SCANNER_SSE2 && kernel_supported(kernel))
+    {
+        scanner->classify = classify_block_sse2;
+    }
+#else
+    (void)kernel;
+#endif
+}
+
+/**
+ * @brief Find the bytes escaped by a backslash
+ *
+ * Runs of backslashes escape the byte after them only when they have odd
+ * length; adding the odd-position run starts to the backslashes carries
+ * through each run and exposes its parity. prev_escaped carries the escape
+ * of a run ending the previous block.
+ */
+static uint64_t find_escaped(uint64_t backslash, uint64_t *prev_escaped)
+{
+    backslash &= ~*prev_escaped;
+    uint64_t follows_escape = backslash << 1 | *prev_escaped;
+
+    uint64_t odd_sequence_starts = backslash & ~EVEN_BITS & ~follows_escape;
+    uint64_t sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+    *prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts;
+
+    uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+    return (EVEN_BITS ^ invert_mask) & follows_escape;
+}
+
+/**
+ * @brief Set every bit from each quote up to (not including) the next one
+ */
+static uint64_t prefix_xor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+static int lowest_bit(uint64_t bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/**
+ * @brief Classify the next batch of blocks and record their positions
+ */
+static void scanner_fill(JsonScanner *scanner)
+{
+    scanner->count = 0;
+    scanner->cursor = 0;
+
+    for (int b = 0; b < JSON_SCANNER_BATCH_BLOCKS && scanner->next_block < scanner->end; b++)
+    {
+        size_t offset = scanner->next_block;
+        const char *block = scanner->json + offset;
+        char tail[JSON_SCANNER_BLOCK_SIZE];
+
+        // The last block is padded with whitespace so kernels read full blocks
+        if (scanner->end - offset < JSON_SCANNER_BLOCK_SIZE)
+        {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, scanner->end - offset);
+            block = tail;
+        }
+
+        JsonBlockMasks masks;
+        scanner->classify(block, &masks);
+
+        uint64_t escaped = find_escaped(masks.backslash, &scanner->prev_escaped);
+        uint64_t quotes = masks.quote & ~escaped;
+        uint64_t in_string = prefix_xor(quotes) ^ scanner->prev_in_string;
+        scanner->prev_in_string = (in_string >> 63) ? ~0ULL : 0;
+
+        // Literals and numbers start right after whitespace or a structural
+        uint64_t separators = masks.whitespace | masks.structural;
+        uint64_t follows_separator = separators << 1 | scanner->prev_separator;
+        scanner->prev_separator = separators >> 63;
+        uint64_t scalar_starts = ~separators & ~masks.quote & follows_separator;
+
+        uint64_t bits = ((masks.structural | scalar_starts) & ~in_string) | quotes;
+
+        while (bits)
+        {
+            size_t position = offset + (size_t)lowest_bit(bits);
+            if (position >= scanner->end)
+            {
+                break;
+            }
+            scanner->positions[scanner->count++] = position;
+            bits &= bits - 1;
+        }
+
+        scanner->next_block += JSON_SCANNER_BLOCK_SIZE;
+    }
+}
+
+size_t json_scanner_next(JsonScanner *scanner)
+{
+    while (scanner->cursor == scanner->count)
+    {
+        if (scanner->next_block >= scanner->end)
+        {
+            return scanner->end;
+        }
+        scanner_fill(scanner);
+    }
+
+    return scanner->positions[scanner->cursor++];
+}
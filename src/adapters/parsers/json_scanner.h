@@ -0,0 +1,96 @@
+#ifndef JSON_SCANNER_H
+#define JSON_SCANNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes classified per block and blocks classified per batch
+#define JSON_SCANNER_BLOCK_SIZE 64
+#define JSON_SCANNER_BATCH_BLOCKS 64
+
+/**
+ * @brief Implementation used to classify input blocks
+ */
+typedef enum
+{
+    JSON_SCANNER_SCALAR,
+    JSON_SCANNER_SSE2,
+    JSON_SCANNER_AVX2
+} JsonScannerKernel;
+
+/**
+ * @brief Bitmasks of one input block, bit i describing byte i
+ */
+typedef struct
+{
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t structural;
+    uint64_t whitespace;
+} JsonBlockMasks;
+
+/**
+ * @brief Finds the structural positions of a JSON buffer ahead of the parser
+ *
+ * Positions are produced in batches: every structural character outside
+ * strings, every unescaped quote (opening and closing) and the first byte of
+ * every literal or number. Blocks are only classified once, before the parser
+ * reaches them, so the parser may rewrite strings it has already been given
+ * the closing quote of.
+ */
+typedef struct
+{
+    const char *json;
+    size_t end;
+    size_t next_block;
+    uint64_t prev_escaped;
+    uint64_t prev_in_string;
+    uint64_t prev_separator;
+    size_t positions[JSON_SCANNER_BLOCK_SIZE * JSON_SCANNER_BATCH_BLOCKS];
+    size_t count;
+    size_t cursor;
+    void (*classify)(const char *block, JsonBlockMasks *masks);
+} JsonScanner;
+
+/**
+ * @brief Get the fastest kernel supported by the running CPU
+ *
+ * The DICOTODIR_SCANNER environment variable ("scalar", "sse2" or "avx2") can
+ * force a kernel to cross-check results; unsupported choices are ignored.
+ *
+ * @return JsonScannerKernel The kernel to use
+ */
+JsonScannerKernel json_scanner_detect_kernel(void);
+
+/**
+ * @brief Get the name of a kernel
+ *
+ * @param kernel The kernel
+ * @return const char* The name of the kernel
+ */
+const char *json_scanner_kernel_name(JsonScannerKernel kernel);
+
+/**
+ * @brief Prepare a scanner over a range of a buffer
+ *
+ * The range must not start inside a string. Positions are offsets in the
+ * whole buffer.
+ *
+ * @param scanner The scanner
+ * @param json The buffer
+ * @param start The offset where scanning starts
+ * @param end The offset where scanning stops
+ * @param kernel The kernel used to classify blocks
+ */
+void json_scanner_init(JsonScanner *scanner, const char *json, size_t start, size_t end, JsonScannerKernel kernel);
+
+/**
+ * @brief Get the next structural position
+ *
+ * @param scanner The scanner
+ * @return size_t The position, or the end of the range when there are no more
+ */
+size_t json_scanner_next(JsonScanner *scanner);
+
+#endif /* JSON_SCANNER_H */
@@ -0,0 +1,643 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "key_image.h"
+#include "../../../include/common/logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// An image is a header followed by four sections, each naturally aligned
+// because the header and the records before them are multiples of 8 bytes:
+//   questions  uint64_t string offset per question, in key order
+//   species    KeyImageSpecies per species, in key order
+//   answers    uint32_t (question id << 1 | answer) per characteristic
+//   strings    NUL terminated strings: tree name, questions, species names
+// Numbers are stored in the byte order of the machine that wrote the image,
+// which byte_order lets a reader check.
+
+#define KEY_IMAGE_MAGIC "DICOKEY"
+#define KEY_IMAGE_MAGIC_SIZE 8
+#define KEY_IMAGE_VERSION 1
+#define KEY_IMAGE_BYTE_ORDER 0x01020304u
+
+// Suffix of the image cached next to a key
+#define KEY_IMAGE_CACHE_SUFFIX ".dki"
+
+// Seed of the 64 bit FNV-1a hash
+#define HASH_SEED 0xcbf29ce484222325ULL
+
+// Buffer used when writing images
+#define KEY_IMAGE_WRITE_BUFFER (1024 * 1024)
+
+/**
+ * @brief Header at the start of every image
+ *
+ * The source fields describe the key an image was cached from and are zero
+ * for images compiled on request.
+ */
+typedef struct
+{
+    char magic[KEY_IMAGE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_hash;
+    uint64_t name;
+    uint64_t num_questions;
+    uint64_t num_species;
+    uint64_t num_answers;
+    uint64_t questions_offset;
+    uint64_t species_offset;
+    uint64_t answers_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} KeyImageHeader;
+
+/**
+ * @brief A species in an image
+ */
+typedef struct
+{
+    uint64_t name;
+    uint64_t first_answer;
+    uint64_t num_answers;
+} KeyImageSpecies;
+
+static uint64_t hash_bytes(uint64_t hash, const unsigned char *bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Hash the whole content of a key file
+ *
+ * @param key_path The path of the key
+ * @param hash Pointer to store the hash
+ * @return bool true if successful, false otherwise
+ */
+static bool hash_key_file(const char *key_path, uint64_t *hash)
+{
+    int fd = open(key_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uintmax_t)st.st_size > SIZE_MAX)
+    {
+        close(fd);
+        return false;
+    }
+
+    *hash = HASH_SEED;
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+
+    posix_madvise(mapped, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    *hash = hash_bytes(HASH_SEED, mapped, (size_t)st.st_size);
+    munmap(mapped, (size_t)st.st_size);
+
+    return true;
+}
+
+/**
+ * @brief Write the sections of an image after its header
+ *
+ * @param file The file, positioned after the header
+ * @param tree The tree
+ * @param header The header, whose counts are already set
+ * @return bool true if successful, false otherwise
+ */
+static bool write_sections(FILE *file, const DicotomicTree *tree, const KeyImageHeader *header)
+{
+    // String offsets follow the order strings are written at the end
+    uint64_t string_offset = strlen(tree->name) + 1;
+
+    for (size_t i = 0; i < tree->num_questions; i++)
+    {
+        uint64_t offset = string_offset;
+        if (fwrite(&offset, sizeof(offset), 1, file) != 1)
+        {
+            return false;
+        }
+        string_offset += strlen(tree->questions[i]) + 1;
+    }
+
+    uint64_t first_answer = 0;
+    for (size_t i = 0; i < tree->num_species; i++)
+    {
+        const Species *species = &tree->species[i];
+        KeyImageSpecies record = {
+            .name = string_offset,
+            .first_answer = first_answer,
+            .num_answers = (uint64_t)species->num_characteristics};
+
+        if (fwrite(&record, sizeof(record), 1, file) != 1)
+        {
+            return false;
+        }
+        string_offset += strlen(species->name) + 1;
+        first_answer += record.num_answers;
+    }
+
+    for (size_t i = 0; i < tree->num_species; i++)
+    {
+        const Species *species = &tree->species[i];
+        const QuestionAnswer *characteristics = tree->characteristics + species->first_characteristic;
+
+        for (size_t j = 0; j < species->num_characteristics; j++)
+        {
+            QuestionId id = characteristics[j].question;
+            if (id >= tree->num_questions)
+            {
+                logger_error("Question %u of species '%s' is not in the tree", (unsigned)id, species->name);
+                return false;
+            }
+
+            uint32_t answer = ((uint32_t)id << 1) | (characteristics[j].answer ? 1u : 0u);
+            if (fwrite(&answer, sizeof(answer), 1, file) != 1)
+            {
+                return false;
+            }
+        }
+    }
+
+    if (fwrite(tree->name, strlen(tree->name) + 1, 1, file) != 1)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < tree->num_questions; i++)
+    {
+        if (fwrite(tree->questions[i], strlen(tree->questions[i]) + 1, 1, file) != 1)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < tree->num_species; i++)
+    {
+        if (fwrite(tree->species[i].name, strlen(tree->species[i].name) + 1, 1, file) != 1)
+        {
+            return false;
+        }
+    }
+
+    return string_offset == header->strings_size;
+}
+
+/**
+ * @brief Write a tree as an image, replacing the file at once
+ *
+ * The image is written to a temporary file renamed over the path, so readers
+ * never see a partial image.
+ *
+ * @param tree The tree
+ * @param image_path The path of the image
+ * @param stamp A header holding the source fields to store
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode write_image(const DicotomicTree *tree, const char *image_path, const KeyImageHeader *stamp)
+{
+    if (!tree || tree->num_questions == 0)
+    {
+        logger_error("Invalid tree or no questions");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    if ((uint64_t)tree->num_questions > (UINT32_MAX >> 1))
+    {
+        logger_error("Too many questions for a key image");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    KeyImageHeader header = *stamp;
+    memcpy(header.magic, KEY_IMAGE_MAGIC, KEY_IMAGE_MAGIC_SIZE);
+    header.version = KEY_IMAGE_VERSION;
+    header.byte_order = KEY_IMAGE_BYTE_ORDER;
+    header.name = 0;
+    header.num_questions = (uint64_t)tree->num_questions;
+    header.num_species = (uint64_t)tree->num_species;
+    header.num_answers = 0;
+    header.strings_size = strlen(tree->name) + 1;
+
+    for (size_t i = 0; i < tree->num_questions; i++)
+    {
+        header.strings_size += strlen(tree->questions[i]) + 1;
+    }
+    for (size_t i = 0; i < tree->num_species; i++)
+    {
+        header.num_answers += (uint64_t)tree->species[i].num_characteristics;
+        header.strings_size += strlen(tree->species[i].name) + 1;
+    }
+
+    header.questions_offset = sizeof(KeyImageHeader);
+    header.species_offset = header.questions_offset + header.num_questions * sizeof(uint64_t);
+    header.answers_offset = header.species_offset + header.num_species * sizeof(KeyImageSpecies);
+    header.strings_offset = header.answers_offset + header.num_answers * sizeof(uint32_t);
+
+    size_t temp_size = strlen(image_path) + 32;
+    char *temp_path = malloc(temp_size);
+    if (!temp_path)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    snprintf(temp_path, temp_size, "%s.tmp.%ld", image_path, (long)getpid());
+
+    FILE *file = fopen(temp_path, "wb");
+    if (!file)
+    {
+        logger_error("Failed to create file %s: %s", temp_path, strerror(errno));
+        free(temp_path);
+        return ERROR_FILE_CREATION;
+    }
+    setvbuf(file, NULL, _IOFBF, KEY_IMAGE_WRITE_BUFFER);
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   write_sections(file, tree, &header);
+
+    if (fclose(file) != 0)
+    {
+        written = false;
+    }
+
+    if (!written || rename(temp_path, image_path) != 0)
+    {
+        logger_error("Failed to write key image %s", image_path);
+        unlink(temp_path);
+        free(temp_path);
+        return ERROR_FILE_CREATION;
+    }
+
+    free(temp_path);
+    return SUCCESS;
+}
+
+static void release_mapped_image(void *source, size_t source_size)
+{
+    munmap(source, source_size);
+}
+
+/**
+ * @brief Check that count elements of a size fit in an image from an offset
+ */
+static bool section_fits(uint64_t offset, uint64_t count, size_t element_size, size_t image_size)
+{
+    return offset <= image_size && count <= (image_size - offset) / element_size;
+}
+
+/**
+ * @brief Check the header and the bounds of every section of an image
+ *
+ * The contents of the sections are checked while the tree is built.
+ *
+ * @param image The mapped image
+ * @param image_size The size of the image
+ * @return bool true if the image can be read safely, false otherwise
+ */
+static bool validate_header(const char *image, size_t image_size)
+{
+    if (image_size < sizeof(KeyImageHeader))
+    {
+        return false;
+    }
+
+    const KeyImageHeader *header = (const KeyImageHeader *)image;
+
+    if (memcmp(header->magic, KEY_IMAGE_MAGIC, KEY_IMAGE_MAGIC_SIZE) != 0 ||
+        header->version != KEY_IMAGE_VERSION ||
+        header->byte_order != KEY_IMAGE_BYTE_ORDER)
+    {
+        return false;
+    }
+
+    if (header->num_questions == 0 || header->num_questions > (UINT32_MAX >> 1) ||
+        header->num_questions > SIZE_MAX || header->num_species > SIZE_MAX)
+    {
+        return false;
+    }
+
+    if (header->questions_offset % sizeof(uint64_t) != 0 ||
+        header->species_offset % sizeof(uint64_t) != 0 ||
+        header->answers_offset % sizeof(uint32_t) != 0)
+    {
+        return false;
+    }
+
+    if (!section_fits(header->questions_offset, header->num_questions, sizeof(uint64_t), image_size) ||
+        !section_fits(header->species_offset, header->num_species, sizeof(KeyImageSpecies), image_size) ||
+        !section_fits(header->answers_offset, header->num_answers, sizeof(uint32_t), image_size) ||
+        !section_fits(header->strings_offset, header->strings_size, 1, image_size) ||
+        header->strings_size == 0)
+    {
+        return false;
+    }
+
+    // Every string ends before the end of the table
+    return image[header->strings_offset + header->strings_size - 1] == '\0' &&
+           header->name < header->strings_size;
+}
+
+/**
+ * @brief Map an image and check its header
+ *
+ * @param image_path The path of the image
+ * @param image Pointer to store the mapping
+ * @param image_size Pointer to store the size of the mapping
+ * @param quiet Whether a missing file is expected and not worth an error
+ * @return bool true if the image is mapped, false otherwise
+ */
+static bool map_image(const char *image_path, char **image, size_t *image_size, bool quiet)
+{
+    int fd = open(image_path, O_RDONLY);
+    if (fd < 0)
+    {
+        if (!quiet || errno != ENOENT)
+        {
+            logger_error("Failed to open file: %s", image_path);
+        }
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || (uintmax_t)st.st_size > SIZE_MAX)
+    {
+        logger_error("Invalid key image: %s", image_path);
+        close(fd);
+        return false;
+    }
+
+    // Private writable mappings let species borrow strings as char *
+    *image_size = (size_t)st.st_size;
+    void *mapped = mmap(NULL, *image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        logger_error("Failed to map file: %s", image_path);
+        return false;
+    }
+
+    if (!validate_header(mapped, *image_size))
+    {
+        logger_error("Invalid key image: %s", image_path);
+        munmap(mapped, *image_size);
+        return false;
+    }
+
+    *image = mapped;
+    return true;
+}
+
+/**
+ * @brief Build a tree whose strings are borrowed from a mapped image
+ *
+ * The tree takes the mapping, which is released with it or on error.
+ *
+ * @param image The mapped image, with a valid header
+ * @param image_size The size of the image
+ * @return DicotomicTree* The tree or NULL if the image is invalid
+ */
+static DicotomicTree *tree_from_image(char *image, size_t image_size)
+{
+    const KeyImageHeader *header = (const KeyImageHeader *)image;
+    const uint64_t *questions = (const uint64_t *)(image + header->questions_offset);
+    const KeyImageSpecies *records = (const KeyImageSpecies *)(image + header->species_offset);
+    const uint32_t *answers = (const uint32_t *)(image + header->answers_offset);
+    char *strings = image + header->strings_offset;
+
+    DicotomicTree *tree = dicotomic_tree_create(strings + header->name);
+    if (!tree)
+    {
+        release_mapped_image(image, image_size);
+        return NULL;
+    }
+    dicotomic_tree_attach_source(tree, image, image_size, release_mapped_image);
+
+    size_t num_questions = (size_t)header->num_questions;
+    const char **question_texts = malloc(num_questions * sizeof(char *));
+    if (!question_texts)
+    {
+        logger_error("Failed to allocate memory for questions");
+        dicotomic_tree_free(tree);
+        return NULL;
+    }
+
+    bool valid = true;
+    for (size_t i = 0; i < num_questions && valid; i++)
+    {
+        // Only offsets inside the strings make pointers into the image
+        valid = questions[i] < header->strings_size;
+        if (valid)
+        {
+            question_texts[i] = strings + questions[i];
+        }
+    }
+
+    if (!valid || !dicotomic_tree_set_questions(tree, question_texts, num_questions) ||
+        !dicotomic_tree_reserve(tree, (size_t)header->num_species, (size_t)header->num_answers))
+    {
+        free(question_texts);
+        dicotomic_tree_free(tree);
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < header->num_species && valid; i++)
+    {
+        const KeyImageSpecies *record = &records[i];
+
+        if (record->name >= header->strings_size ||
+            record->first_answer > header->num_answers ||
+            record->num_answers > header->num_answers - record->first_answer ||
+            record->num_answers > SIZE_MAX)
+        {
+            valid = false;
+            break;
+        }
+
+        valid = dicotomic_tree_add_species_view(tree, strings + record->name);
+
+        for (uint64_t j = 0; j < record->num_answers && valid; j++)
+        {
+            uint32_t answer = answers[record->first_answer + j];
+            uint32_t id = answer >> 1;
+
+            valid = id < header->num_questions &&
+                    dicotomic_tree_add_characteristic(tree, id, (answer & 1u) != 0);
+        }
+    }
+
+    free(question_texts);
+
+    if (!valid)
+    {
+        logger_error("Invalid key image");
+        dicotomic_tree_free(tree);
+        return NULL;
+    }
+
+    return tree;
+}
+
+static bool is_key_image(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char magic[KEY_IMAGE_MAGIC_SIZE];
+    bool is_image = read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) &&
+                    memcmp(magic, KEY_IMAGE_MAGIC, KEY_IMAGE_MAGIC_SIZE) == 0;
+    close(fd);
+
+    return is_image;
+}
+
+static StatusCode save_key_image(const DicotomicTree *tree, const char *image_path)
+{
+    KeyImageHeader stamp;
+    memset(&stamp, 0, sizeof(stamp));
+
+    return write_image(tree, image_path, &stamp);
+}
+
+static DicotomicTree *load_key_image(const char *image_path)
+{
+    char *image;
+    size_t image_size;
+
+    if (!map_image(image_path, &image, &image_size, false))
+    {
+        return NULL;
+    }
+
+    return tree_from_image(image, image_size);
+}
+
+/**
+ * @brief Get the path of the image cached for a key
+ *
+ * @param key_path The path of the key
+ * @return char* The path, to be freed by the caller, or NULL
+ */
+static char *cache_path(const char *key_path)
+{
+    char *path = malloc(strlen(key_path) + strlen(KEY_IMAGE_CACHE_SUFFIX) + 1);
+    if (path)
+    {
+        sprintf(path, "%s%s", key_path, KEY_IMAGE_CACHE_SUFFIX);
+    }
+
+    return path;
+}
+
+static DicotomicTree *load_cached_key_image(const char *key_path)
+{
+    struct stat st;
+    if (stat(key_path, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return NULL;
+    }
+
+    char *image_path = cache_path(key_path);
+    if (!image_path)
+    {
+        return NULL;
+    }
+
+    char *image;
+    size_t image_size;
+    if (!map_image(image_path, &image, &image_size, true))
+    {
+        free(image_path);
+        return NULL;
+    }
+
+    // A key with the same size and modification time is taken as unchanged;
+    // one that was only touched is recognized by its hash
+    const KeyImageHeader *header = (const KeyImageHeader *)image;
+    uint64_t hash;
+    bool up_to_date = header->source_size == (uint64_t)st.st_size &&
+                      ((header->source_mtime_sec == (int64_t)st.st_mtim.tv_sec &&
+                        header->source_mtime_nsec == (int64_t)st.st_mtim.tv_nsec) ||
+                       (hash_key_file(key_path, &hash) && hash == header->source_hash));
+
+    if (!up_to_date)
+    {
+        logger_info("Cached image %s is out of date", image_path);
+        release_mapped_image(image, image_size);
+        free(image_path);
+        return NULL;
+    }
+
+    logger_info("Using cached image %s", image_path);
+    free(image_path);
+
+    return tree_from_image(image, image_size);
+}
+
+static StatusCode save_cached_key_image(const DicotomicTree *tree, const char *key_path)
+{
+    KeyImageHeader stamp;
+    memset(&stamp, 0, sizeof(stamp));
+
+    struct stat st;
+    if (stat(key_path, &st) != 0 || !S_ISREG(st.st_mode) || !hash_key_file(key_path, &stamp.source_hash))
+    {
+        logger_error("Failed to read key file: %s", key_path);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    stamp.source_size = (uint64_t)st.st_size;
+    stamp.source_mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    stamp.source_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+
+    char *image_path = cache_path(key_path);
+    if (!image_path)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    StatusCode error = write_image(tree, image_path, &stamp);
+    free(image_path);
+
+    return error;
+}
+
+static const KeyImagePort key_image = {
+    .is_image = is_key_image,
+    .save = save_key_image,
+    .load = load_key_image,
+    .load_cached = load_cached_key_image,
+    .save_cached = save_cached_key_image};
+
+const KeyImagePort *get_key_image(void)
+{
+    return &key_image;
+}
@@ -0,0 +1,13 @@
+#ifndef KEY_IMAGE_H
+#define KEY_IMAGE_H
+
+#include "../../core/ports/key_image_port.h"
+
+/**
+ * @brief Get the key image implementation
+ *
+ * @return const KeyImagePort* The key image implementation
+ */
+const KeyImagePort *get_key_image(void);
+
+#endif /* KEY_IMAGE_H */
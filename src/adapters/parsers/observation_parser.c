@@ -0,0 +1,369 @@
+#include "observation_parser.h"
+#include "../../../include/common/logger.h"
+#include "../../../include/common/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *skip_whitespace(char *text)
+{
+    while (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n')
+    {
+        text++;
+    }
+
+    return text;
+}
+
+/**
+ * @brief Unescape a JSON string in place and terminate it
+ *
+ * @param text The opening quote of the string
+ * @param end Pointer to store the position after the closing quote
+ * @return char* The string, or NULL if it is not closed
+ */
+static char *parse_json_string(char *text, char **end)
+{
+    char *start = text + 1;
+    char *read = start;
+    char *write = start;
+
+    // The text only shrinks, and the closing quote leaves room for the terminator
+    while (*read != '"')
+    {
+        if (*read == '\0')
+        {
+            return NULL;
+        }
+
+        if (*read == '\\' && read[1] != '\0')
+        {
+            read++;
+            switch (*read)
+            {
+            case 'n':
+                *write++ = '\n';
+                break;
+            case 'r':
+                *write++ = '\r';
+                break;
+            case 't':
+                *write++ = '\t';
+                break;
+            case 'b':
+                *write++ = '\b';
+                break;
+            case 'f':
+                *write++ = '\f';
+                break;
+            default:
+                *write++ = *read;
+                break;
+            }
+            read++;
+        }
+        else
+        {
+            *write++ = *read++;
+        }
+    }
+
+    *end = read + 1;
+    *write = '\0';
+
+    return start;
+}
+
+static StatusCode ndjson_read_header(const char *line, void **state, bool *consumed)
+{
+    (void)line;
+
+    // Every line names its questions
+    *state = NULL;
+    *consumed = false;
+
+    return SUCCESS;
+}
+
+static StatusCode ndjson_parse_record(
+    const void *state,
+    char *line,
+    ObservationAnswerCallback on_answer,
+    void *context)
+{
+    (void)state;
+
+    char *text = skip_whitespace(line);
+    if (*text++ != '{')
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    text = skip_whitespace(text);
+    if (*text == '}')
+    {
+        return *skip_whitespace(text + 1) == '\0' ? SUCCESS : ERROR_INVALID_JSON;
+    }
+
+    for (;;)
+    {
+        if (*text != '"')
+        {
+            return ERROR_INVALID_JSON;
+        }
+
+        char *question = parse_json_string(text, &text);
+        if (!question)
+        {
+            return ERROR_INVALID_JSON;
+        }
+
+        text = skip_whitespace(text);
+        if (*text++ != ':')
+        {
+            return ERROR_INVALID_JSON;
+        }
+        text = skip_whitespace(text);
+
+        // null leaves the question unanswered
+        StatusCode error = SUCCESS;
+        if (strncmp(text, "true", 4) == 0)
+        {
+            error = on_answer(context, question, true);
+            text += 4;
+        }
+        else if (strncmp(text, "false", 5) == 0)
+        {
+            error = on_answer(context, question, false);
+            text += 5;
+        }
+        else if (strncmp(text, "null", 4) == 0)
+        {
+            text += 4;
+        }
+        else
+        {
+            return ERROR_INVALID_JSON;
+        }
+
+        if (error != SUCCESS)
+        {
+            return error;
+        }
+
+        text = skip_whitespace(text);
+        if (*text == '}')
+        {
+            return *skip_whitespace(text + 1) == '\0' ? SUCCESS : ERROR_INVALID_JSON;
+        }
+        if (*text++ != ',')
+        {
+            return ERROR_INVALID_JSON;
+        }
+        text = skip_whitespace(text);
+    }
+}
+
+/**
+ * @brief The columns named by the header of a CSV stream
+ */
+typedef struct
+{
+    char **columns;
+    size_t num_columns;
+} CsvHeader;
+
+/**
+ * @brief Cut the next field of a CSV line, unquoting it in place
+ *
+ * Quoted fields may hold commas, and "" inside them stands for a quote.
+ *
+ * @param text The start of the field
+ * @param end Pointer to store the start of the next field, or NULL after the last one
+ * @return char* The field, or NULL if a quote is not closed
+ */
+static char *next_csv_field(char *text, char **end)
+{
+    char *field = text;
+
+    if (*text == '"')
+    {
+        char *read = text + 1;
+        char *write = text;
+
+        for (;;)
+        {
+            if (*read == '\0')
+            {
+                return NULL;
+            }
+            if (*read == '"')
+            {
+                if (read[1] != '"')
+                {
+                    read++;
+                    break;
+                }
+                read++;
+            }
+            *write++ = *read++;
+        }
+
+        // Anything between the closing quote and the comma is dropped
+        *write = '\0';
+        text = strchr(read, ',');
+    }
+    else
+    {
+        text = strchr(text, ',');
+    }
+
+    if (text)
+    {
+        *text = '\0';
+        *end = text + 1;
+    }
+    else
+    {
+        *end = NULL;
+    }
+
+    return field;
+}
+
+static void csv_free_state(void *state)
+{
+    CsvHeader *header = state;
+    if (!header)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < header->num_columns; i++)
+    {
+        free(header->columns[i]);
+    }
+    free(header->columns);
+    free(header);
+}
+
+static StatusCode csv_read_header(const char *line, void **state, bool *consumed)
+{
+    *state = NULL;
+    *consumed = true;
+
+    // Fields are cut in place, so work on a copy of the line
+    char *copy = my_strdup(line);
+    CsvHeader *header = malloc(sizeof(CsvHeader));
+    if (!copy || !header)
+    {
+        free(copy);
+        free(header);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    header->columns = NULL;
+    header->num_columns = 0;
+
+    StatusCode error = SUCCESS;
+    char *text = copy;
+
+    while (text && error == SUCCESS)
+    {
+        char *field = next_csv_field(text, &text);
+        if (!field)
+        {
+            logger_error("Invalid CSV header: unclosed quote");
+            error = ERROR_INVALID_ARGUMENTS;
+            break;
+        }
+
+        char **columns = realloc(header->columns, (header->num_columns + 1) * sizeof(char *));
+        if (!columns)
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+        header->columns = columns;
+
+        header->columns[header->num_columns] = my_strdup(field);
+        if (!header->columns[header->num_columns])
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+        header->num_columns++;
+    }
+
+    free(copy);
+
+    if (error != SUCCESS)
+    {
+        csv_free_state(header);
+        return error;
+    }
+
+    *state = header;
+    return SUCCESS;
+}
+
+static StatusCode csv_parse_record(
+    const void *state,
+    char *line,
+    ObservationAnswerCallback on_answer,
+    void *context)
+{
+    const CsvHeader *header = state;
+    char *text = line;
+
+    for (size_t i = 0; text; i++)
+    {
+        char *field = next_csv_field(text, &text);
+        if (!field || i >= header->num_columns)
+        {
+            return ERROR_INVALID_ARGUMENTS;
+        }
+
+        // An empty field leaves the question unanswered
+        StatusCode error = SUCCESS;
+        if (strcmp(field, "si") == 0 || strcmp(field, "true") == 0 || strcmp(field, "1") == 0)
+        {
+            error = on_answer(context, header->columns[i], true);
+        }
+        else if (strcmp(field, "no") == 0 || strcmp(field, "false") == 0 || strcmp(field, "0") == 0)
+        {
+            error = on_answer(context, header->columns[i], false);
+        }
+        else if (field[0] != '\0')
+        {
+            return ERROR_INVALID_ARGUMENTS;
+        }
+
+        if (error != SUCCESS)
+        {
+            return error;
+        }
+    }
+
+    return SUCCESS;
+}
+
+static const ObservationParserPort ndjson_observation_parser = {
+    .read_header = ndjson_read_header,
+    .parse_record = ndjson_parse_record,
+    .free_state = NULL};
+
+static const ObservationParserPort csv_observation_parser = {
+    .read_header = csv_read_header,
+    .parse_record = csv_parse_record,
+    .free_state = csv_free_state};
+
+const ObservationParserPort *get_ndjson_observation_parser(void)
+{
+    return &ndjson_observation_parser;
+}
+
+const ObservationParserPort *get_csv_observation_parser(void)
+{
+    return &csv_observation_parser;
+}
@@ -0,0 +1,26 @@
+#ifndef OBSERVATION_PARSER_H
+#define OBSERVATION_PARSER_H
+
+#include "../../core/ports/observation_parser_port.h"
+
+/**
+ * @brief Get the parser for observations given as NDJSON
+ *
+ * Each line is an object mapping questions to true, false or null, e.g.
+ * {"Hojas como agujas": false, "Hojas compuestas": true}.
+ *
+ * @return const ObservationParserPort* The NDJSON observation parser
+ */
+const ObservationParserPort *get_ndjson_observation_parser(void);
+
+/**
+ * @brief Get the parser for observations given as CSV
+ *
+ * The header names the questions, and each row answers them with si, no,
+ * true, false, 1 or 0. Empty fields leave a question unanswered.
+ *
+ * @return const ObservationParserPort* The CSV observation parser
+ */
+const ObservationParserPort *get_csv_observation_parser(void);
+
+#endif /* OBSERVATION_PARSER_H */
@@ -0,0 +1,1012 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "species_index.h"
+#include "../../core/domain/perfect_hash.h"
+#include "../../core/domain/trigrams.h"
+#include "../../../include/common/logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// An index is a header followed by these sections, each of the first six
+// starting at a multiple of 8 bytes:
+//   displacements  uint32_t per bucket of the perfect hash
+//   taken          uint64_t words, a bit per slot of the perfect hash
+//   ranks          uint32_t per word of taken
+//   names          SpeciesIndexName per distinct name, at the index of its hash
+//   paths          uint64_t string offset per path, those of a name together
+//   trigrams       SpeciesIndexTrigram per trigram of the names, sorted, if saved with them
+//   name_trigrams  uint16_t per name, its number of distinct trigrams up to 65535
+//   postings       per trigram, the ascending indexes of the names having it,
+//                  as LEB128 differences from the previous one
+//   strings        NUL terminated strings: names, then paths
+// Numbers are stored in the byte order of the machine that wrote the index,
+// which byte_order lets a reader check.
+
+#define SPECIES_INDEX_MAGIC "DICOIDX"
+#define SPECIES_INDEX_MAGIC_SIZE 8
+#define SPECIES_INDEX_VERSION 2
+#define SPECIES_INDEX_BYTE_ORDER 0x01020304u
+
+// Buffer used when writing indexes
+#define SPECIES_INDEX_WRITE_BUFFER (1024 * 1024)
+
+/**
+ * @brief Header at the start of every index
+ */
+typedef struct
+{
+    char magic[SPECIES_INDEX_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t seed;
+    uint64_t num_names;
+    uint64_t num_paths;
+    uint64_t num_buckets;
+    uint64_t num_slots;
+    uint64_t displacements_offset;
+    uint64_t taken_offset;
+    uint64_t ranks_offset;
+    uint64_t names_offset;
+    uint64_t paths_offset;
+    uint64_t num_trigrams;
+    uint64_t trigrams_offset; // 0 if the index was saved without trigrams
+    uint64_t name_trigrams_offset;
+    uint64_t postings_offset;
+    uint64_t postings_size;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} SpeciesIndexHeader;
+
+/**
+ * @brief A distinct name in an index
+ */
+typedef struct
+{
+    uint64_t name;
+    uint64_t first_path;
+    uint64_t num_paths;
+} SpeciesIndexName;
+
+/**
+ * @brief A trigram of the names in an index
+ */
+typedef struct
+{
+    uint32_t trigram;
+    uint32_t num_names;
+    uint64_t postings; // Offset of its postings in the postings section
+} SpeciesIndexTrigram;
+
+static uint64_t align_section(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static int compare_entries_by_name(const void *a, const void *b)
+{
+    const SpeciesIndexEntry *first = *(const SpeciesIndexEntry *const *)a;
+    const SpeciesIndexEntry *second = *(const SpeciesIndexEntry *const *)b;
+
+    // Entries with the same name keep the order they were given in
+    int order = strcmp(first->name, second->name);
+    if (order != 0)
+    {
+        return order;
+    }
+    return first < second ? -1 : (first > second);
+}
+
+/**
+ * @brief Write bytes to an index, counting them
+ */
+static bool write_bytes(FILE *file, const void *bytes, size_t size, uint64_t *written)
+{
+    *written += size;
+    return size == 0 || fwrite(bytes, size, 1, file) == 1;
+}
+
+/**
+ * @brief Write zeros up to the start of a section
+ */
+static bool pad_to(FILE *file, uint64_t offset, uint64_t *written)
+{
+    static const char zeros[8];
+    return write_bytes(file, zeros, (size_t)(offset - *written), written);
+}
+
+/**
+ * @brief The names of an index grouped with their paths
+ */
+typedef struct
+{
+    const SpeciesIndexEntry **sorted; // The entries sorted by name
+    const char **names;               // Each distinct name
+    size_t *first_entries;            // The first sorted entry of each name, plus the end
+    size_t num_names;
+} NameGroups;
+
+/**
+ * @brief The posting lists of the trigrams of the names of an index
+ */
+typedef struct
+{
+    SpeciesIndexTrigram *trigrams;
+    size_t num_trigrams;
+    uint16_t *name_trigrams;
+    unsigned char *postings;
+    size_t postings_size;
+} TrigramPostings;
+
+/**
+ * @brief Sort (trigram << 32 | name) pairs made in ascending name order
+ *
+ * A stable radix sort on the three bytes of the trigram, which keeps the
+ * names of each trigram ascending.
+ *
+ * @param pairs The pairs
+ * @param scratch Array as large as pairs
+ * @param count The number of pairs
+ */
+static void sort_trigram_pairs(uint64_t *pairs, uint64_t *scratch, size_t count)
+{
+    for (unsigned shift = 32; shift < 56; shift += 8)
+    {
+        size_t starts[257] = {0};
+        for (size_t i = 0; i < count; i++)
+        {
+            starts[((pairs[i] >> shift) & 0xff) + 1]++;
+        }
+        for (size_t b = 0; b < 256; b++)
+        {
+            starts[b + 1] += starts[b];
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            scratch[starts[(pairs[i] >> shift) & 0xff]++] = pairs[i];
+        }
+        memcpy(pairs, scratch, count * sizeof(uint64_t));
+    }
+}
+
+/**
+ * @brief Build the posting list of every trigram of the names
+ *
+ * @param hash The perfect hash of the names, which gives their indexes
+ * @param groups The names
+ * @param postings Pointer to store the posting lists, freed with free_postings
+ * @return bool true if successful, false if memory allocation failed
+ */
+static bool build_postings(const PerfectHash *hash, const NameGroups *groups, TrigramPostings *postings)
+{
+    size_t num_names = groups->num_names;
+    size_t num_pairs = 0;
+    size_t max_trigrams = 1;
+
+    for (size_t i = 0; i < num_names; i++)
+    {
+        size_t capacity = trigrams_capacity(groups->names[i]);
+        num_pairs += capacity;
+        max_trigrams = capacity > max_trigrams ? capacity : max_trigrams;
+    }
+
+    size_t *names_at = malloc((num_names ? num_names : 1) * sizeof(size_t));
+    Trigram *trigrams = malloc(max_trigrams * sizeof(Trigram));
+    uint64_t *pairs = malloc((num_pairs ? num_pairs : 1) * sizeof(uint64_t));
+    uint64_t *scratch = malloc((num_pairs ? num_pairs : 1) * sizeof(uint64_t));
+
+    postings->trigrams = NULL;
+    postings->postings = NULL;
+    postings->name_trigrams = malloc((num_names ? num_names : 1) * sizeof(uint16_t));
+    bool valid = names_at && trigrams && pairs && scratch && postings->name_trigrams;
+
+    if (valid)
+    {
+        // Pairs are made by name index, so each list comes out ascending
+        for (size_t i = 0; i < num_names; i++)
+        {
+            names_at[perfect_hash_index(hash, groups->names[i])] = i;
+        }
+
+        num_pairs = 0;
+        for (size_t position = 0; position < num_names; position++)
+        {
+            size_t count = trigrams_extract(groups->names[names_at[position]], trigrams);
+            postings->name_trigrams[position] = (uint16_t)(count < UINT16_MAX ? count : UINT16_MAX);
+            for (size_t j = 0; j < count; j++)
+            {
+                pairs[num_pairs++] = ((uint64_t)trigrams[j] << 32) | position;
+            }
+        }
+        sort_trigram_pairs(pairs, scratch, num_pairs);
+
+        size_t num_trigrams = 0;
+        for (size_t i = 0; i < num_pairs; i++)
+        {
+            num_trigrams += (i == 0 || (pairs[i] >> 32) != (pairs[i - 1] >> 32));
+        }
+
+        // A difference below 2^32 takes at most five bytes
+        postings->trigrams = malloc((num_trigrams ? num_trigrams : 1) * sizeof(SpeciesIndexTrigram));
+        postings->postings = malloc((num_pairs ? num_pairs : 1) * 5);
+        valid = postings->trigrams && postings->postings;
+    }
+
+    if (valid)
+    {
+        postings->num_trigrams = 0;
+        postings->postings_size = 0;
+
+        uint32_t previous = 0;
+        for (size_t i = 0; i < num_pairs; i++)
+        {
+            uint32_t trigram = (uint32_t)(pairs[i] >> 32);
+            uint32_t position = (uint32_t)pairs[i];
+
+            if (i == 0 || trigram != postings->trigrams[postings->num_trigrams - 1].trigram)
+            {
+                SpeciesIndexTrigram *record = &postings->trigrams[postings->num_trigrams++];
+                record->trigram = trigram;
+                record->num_names = 0;
+                record->postings = postings->postings_size;
+                previous = 0;
+            }
+
+            uint32_t delta = position - previous;
+            while (delta >= 0x80)
+            {
+                postings->postings[postings->postings_size++] = (unsigned char)(delta | 0x80);
+                delta >>= 7;
+            }
+            postings->postings[postings->postings_size++] = (unsigned char)delta;
+
+            postings->trigrams[postings->num_trigrams - 1].num_names++;
+            previous = position;
+        }
+    }
+    else
+    {
+        free(postings->trigrams);
+        free(postings->name_trigrams);
+        free(postings->postings);
+        postings->trigrams = NULL;
+        postings->name_trigrams = NULL;
+        postings->postings = NULL;
+    }
+
+    free(names_at);
+    free(trigrams);
+    free(pairs);
+    free(scratch);
+
+    return valid;
+}
+
+/**
+ * @brief Write the sections of an index after its header
+ *
+ * @param file The file, positioned after the header
+ * @param header The header, whose counts and offsets are already set
+ * @param hash The perfect hash of the names
+ * @param groups The names and their entries
+ * @param postings The posting lists of the trigrams, NULL to save none
+ * @return bool true if successful, false otherwise
+ */
+static bool write_sections(
+    FILE *file,
+    const SpeciesIndexHeader *header,
+    const PerfectHash *hash,
+    const NameGroups *groups,
+    const TrigramPostings *postings)
+{
+    size_t num_words = perfect_hash_num_words(hash->num_slots);
+    uint64_t written = sizeof(SpeciesIndexHeader);
+
+    SpeciesIndexName *records = calloc(groups->num_names ? groups->num_names : 1, sizeof(SpeciesIndexName));
+    if (!records)
+    {
+        return false;
+    }
+
+    // Strings are names in group order then paths in sorted order, and so
+    // are the offsets computed here
+    uint64_t string_offset = 0;
+    for (size_t i = 0; i < groups->num_names; i++)
+    {
+        SpeciesIndexName *record = &records[perfect_hash_index(hash, groups->names[i])];
+        record->name = string_offset;
+        record->first_path = groups->first_entries[i];
+        record->num_paths = groups->first_entries[i + 1] - groups->first_entries[i];
+        string_offset += strlen(groups->names[i]) + 1;
+    }
+
+    bool valid = write_bytes(file, hash->displacements, hash->num_buckets * sizeof(uint32_t), &written) &&
+                 pad_to(file, header->taken_offset, &written) &&
+                 write_bytes(file, hash->taken, num_words * sizeof(uint64_t), &written) &&
+                 write_bytes(file, hash->ranks, num_words * sizeof(uint32_t), &written) &&
+                 pad_to(file, header->names_offset, &written) &&
+                 write_bytes(file, records, groups->num_names * sizeof(SpeciesIndexName), &written);
+    free(records);
+
+    for (size_t i = 0; i < header->num_paths && valid; i++)
+    {
+        valid = write_bytes(file, &string_offset, sizeof(string_offset), &written);
+        string_offset += strlen(groups->sorted[i]->path) + 1;
+    }
+
+    if (postings)
+    {
+        valid = valid &&
+                write_bytes(file, postings->trigrams, postings->num_trigrams * sizeof(SpeciesIndexTrigram), &written) &&
+                write_bytes(file, postings->name_trigrams, groups->num_names * sizeof(uint16_t), &written) &&
+                write_bytes(file, postings->postings, postings->postings_size, &written);
+    }
+
+    for (size_t i = 0; i < groups->num_names && valid; i++)
+    {
+        valid = write_bytes(file, groups->names[i], strlen(groups->names[i]) + 1, &written);
+    }
+    for (size_t i = 0; i < header->num_paths && valid; i++)
+    {
+        valid = write_bytes(file, groups->sorted[i]->path, strlen(groups->sorted[i]->path) + 1, &written);
+    }
+
+    return valid && string_offset == header->strings_size &&
+           written == header->strings_offset + header->strings_size;
+}
+
+/**
+ * @brief Write an index, replacing the file at once
+ *
+ * The index is written to a temporary file renamed over the path, so
+ * lookups never see a partial index.
+ *
+ * @param index_path The path of the index
+ * @param header The header, with its counts and offsets set
+ * @param hash The perfect hash of the names
+ * @param groups The names and their entries
+ * @param postings The posting lists of the trigrams, NULL to save none
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode write_index(
+    const char *index_path,
+    const SpeciesIndexHeader *header,
+    const PerfectHash *hash,
+    const NameGroups *groups,
+    const TrigramPostings *postings)
+{
+    size_t temp_size = strlen(index_path) + 32;
+    char *temp_path = malloc(temp_size);
+    if (!temp_path)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    snprintf(temp_path, temp_size, "%s.tmp.%ld", index_path, (long)getpid());
+
+    FILE *file = fopen(temp_path, "wb");
+    if (!file)
+    {
+        logger_error("Failed to create file %s: %s", temp_path, strerror(errno));
+        free(temp_path);
+        return ERROR_FILE_CREATION;
+    }
+    setvbuf(file, NULL, _IOFBF, SPECIES_INDEX_WRITE_BUFFER);
+
+    bool written = fwrite(header, sizeof(*header), 1, file) == 1 &&
+                   write_sections(file, header, hash, groups, postings);
+
+    if (fclose(file) != 0)
+    {
+        written = false;
+    }
+
+    if (!written || rename(temp_path, index_path) != 0)
+    {
+        logger_error("Failed to write species index %s", index_path);
+        unlink(temp_path);
+        free(temp_path);
+        return ERROR_FILE_CREATION;
+    }
+
+    free(temp_path);
+    return SUCCESS;
+}
+
+static StatusCode save_species_index(
+    const SpeciesIndexEntry *entries,
+    size_t num_entries,
+    bool with_trigrams,
+    const char *index_path)
+{
+    if ((!entries && num_entries > 0) || !index_path)
+    {
+        logger_error("Invalid species or index path");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    size_t capacity = num_entries ? num_entries : 1;
+    NameGroups groups = {
+        .sorted = malloc(capacity * sizeof(SpeciesIndexEntry *)),
+        .names = malloc(capacity * sizeof(char *)),
+        .first_entries = malloc((capacity + 1) * sizeof(size_t)),
+        .num_names = 0};
+
+    if (!groups.sorted || !groups.names || !groups.first_entries)
+    {
+        free(groups.sorted);
+        free(groups.names);
+        free(groups.first_entries);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    SpeciesIndexHeader header;
+    memset(&header, 0, sizeof(header));
+
+    // Sorting brings the paths of each name together
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        groups.sorted[i] = &entries[i];
+    }
+    qsort(groups.sorted, num_entries, sizeof(SpeciesIndexEntry *), compare_entries_by_name);
+
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        if (i == 0 || strcmp(groups.sorted[i]->name, groups.sorted[i - 1]->name) != 0)
+        {
+            groups.first_entries[groups.num_names] = i;
+            groups.names[groups.num_names++] = groups.sorted[i]->name;
+            header.strings_size += strlen(groups.sorted[i]->name) + 1;
+        }
+        header.strings_size += strlen(groups.sorted[i]->path) + 1;
+    }
+    groups.first_entries[groups.num_names] = num_entries;
+
+    PerfectHash hash;
+    TrigramPostings postings = {NULL, 0, NULL, NULL, 0};
+    StatusCode error = SUCCESS;
+
+    if (!perfect_hash_build(groups.names, groups.num_names, &hash))
+    {
+        error = ERROR_MEMORY_ALLOCATION;
+    }
+    else if (with_trigrams && !build_postings(&hash, &groups, &postings))
+    {
+        logger_error("Failed to allocate memory for the trigrams of the species");
+        perfect_hash_free(&hash);
+        error = ERROR_MEMORY_ALLOCATION;
+    }
+    else
+    {
+        size_t num_words = perfect_hash_num_words(hash.num_slots);
+
+        memcpy(header.magic, SPECIES_INDEX_MAGIC, SPECIES_INDEX_MAGIC_SIZE);
+        header.version = SPECIES_INDEX_VERSION;
+        header.byte_order = SPECIES_INDEX_BYTE_ORDER;
+        header.seed = hash.seed;
+        header.num_names = (uint64_t)groups.num_names;
+        header.num_paths = (uint64_t)num_entries;
+        header.num_buckets = (uint64_t)hash.num_buckets;
+        header.num_slots = (uint64_t)hash.num_slots;
+        header.displacements_offset = sizeof(SpeciesIndexHeader);
+        header.taken_offset = align_section(header.displacements_offset + header.num_buckets * sizeof(uint32_t));
+        header.ranks_offset = header.taken_offset + num_words * sizeof(uint64_t);
+        header.names_offset = align_section(header.ranks_offset + num_words * sizeof(uint32_t));
+        header.paths_offset = header.names_offset + header.num_names * sizeof(SpeciesIndexName);
+        header.strings_offset = header.paths_offset + header.num_paths * sizeof(uint64_t);
+
+        if (with_trigrams)
+        {
+            header.num_trigrams = (uint64_t)postings.num_trigrams;
+            header.trigrams_offset = header.strings_offset;
+            header.name_trigrams_offset = header.trigrams_offset + header.num_trigrams * sizeof(SpeciesIndexTrigram);
+            header.postings_offset = header.name_trigrams_offset + header.num_names * sizeof(uint16_t);
+            header.postings_size = (uint64_t)postings.postings_size;
+            header.strings_offset = header.postings_offset + header.postings_size;
+        }
+
+        error = write_index(index_path, &header, &hash, &groups, with_trigrams ? &postings : NULL);
+        perfect_hash_free(&hash);
+        free(postings.trigrams);
+        free(postings.name_trigrams);
+        free(postings.postings);
+    }
+
+    free(groups.sorted);
+    free(groups.names);
+    free(groups.first_entries);
+
+    return error;
+}
+
+/**
+ * @brief Check that count elements of a size fit in an index from an offset
+ */
+static bool section_fits(uint64_t offset, uint64_t count, size_t element_size, size_t index_size)
+{
+    return offset <= index_size && count <= (index_size - offset) / element_size;
+}
+
+/**
+ * @brief Check the header and the bounds of every section of an index
+ *
+ * The records and path offsets are checked when a lookup reads them.
+ *
+ * @param index The mapped index
+ * @param index_size The size of the index
+ * @return bool true if the index can be read safely, false otherwise
+ */
+static bool validate_header(const char *index, size_t index_size)
+{
+    if (index_size < sizeof(SpeciesIndexHeader))
+    {
+        return false;
+    }
+
+    const SpeciesIndexHeader *header = (const SpeciesIndexHeader *)index;
+
+    if (memcmp(header->magic, SPECIES_INDEX_MAGIC, SPECIES_INDEX_MAGIC_SIZE) != 0 ||
+        header->version != SPECIES_INDEX_VERSION ||
+        header->byte_order != SPECIES_INDEX_BYTE_ORDER)
+    {
+        return false;
+    }
+
+    if (header->num_buckets == 0 || header->num_buckets > SIZE_MAX ||
+        header->num_slots < header->num_names || header->num_slots == 0 || header->num_slots > SIZE_MAX ||
+        header->num_names >= UINT32_MAX || header->num_names > header->num_paths)
+    {
+        return false;
+    }
+
+    if (header->displacements_offset % sizeof(uint32_t) != 0 ||
+        header->taken_offset % sizeof(uint64_t) != 0 ||
+        header->ranks_offset % sizeof(uint32_t) != 0 ||
+        header->names_offset % sizeof(uint64_t) != 0 ||
+        header->paths_offset % sizeof(uint64_t) != 0 ||
+        header->trigrams_offset % sizeof(uint64_t) != 0 ||
+        header->name_trigrams_offset % sizeof(uint16_t) != 0)
+    {
+        return false;
+    }
+
+    uint64_t num_words = perfect_hash_num_words((size_t)header->num_slots);
+    if (!section_fits(header->displacements_offset, header->num_buckets, sizeof(uint32_t), index_size) ||
+        !section_fits(header->taken_offset, num_words, sizeof(uint64_t), index_size) ||
+        !section_fits(header->ranks_offset, num_words, sizeof(uint32_t), index_size) ||
+        !section_fits(header->names_offset, header->num_names, sizeof(SpeciesIndexName), index_size) ||
+        !section_fits(header->paths_offset, header->num_paths, sizeof(uint64_t), index_size) ||
+        !section_fits(header->trigrams_offset, header->num_trigrams, sizeof(SpeciesIndexTrigram), index_size) ||
+        !section_fits(header->name_trigrams_offset, header->num_names, sizeof(uint16_t), index_size) ||
+        !section_fits(header->postings_offset, header->postings_size, 1, index_size) ||
+        !section_fits(header->strings_offset, header->strings_size, 1, index_size))
+    {
+        return false;
+    }
+
+    // Every string ends before the end of the table
+    return header->strings_size == 0 || index[header->strings_offset + header->strings_size - 1] == '\0';
+}
+
+/**
+ * @brief Map an index and check its header
+ *
+ * @param index_path The path of the index
+ * @param index Pointer to store the mapping
+ * @param index_size Pointer to store the size of the mapping
+ * @return StatusCode SUCCESS if the index is mapped, an error code otherwise
+ */
+static StatusCode map_index(const char *index_path, char **index, size_t *index_size)
+{
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0)
+    {
+        logger_error("Failed to open file: %s", index_path);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || (uintmax_t)st.st_size > SIZE_MAX)
+    {
+        logger_error("Invalid species index: %s", index_path);
+        close(fd);
+        return ERROR_INVALID_JSON;
+    }
+
+    *index_size = (size_t)st.st_size;
+    void *mapped = mmap(NULL, *index_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        logger_error("Failed to map file: %s", index_path);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    if (!validate_header(mapped, *index_size))
+    {
+        logger_error("Invalid species index: %s", index_path);
+        munmap(mapped, *index_size);
+        return ERROR_INVALID_JSON;
+    }
+
+    *index = mapped;
+    return SUCCESS;
+}
+
+/**
+ * @brief Find a name in a mapped index
+ *
+ * @param index The mapped index, with a valid header
+ * @param name The species name
+ * @param on_match Called with each path of the name
+ * @param context The context given to on_match
+ * @param num_matches Pointer to store the number of paths found
+ * @return bool true if the records read are valid, false otherwise
+ */
+static bool find_name(const char *index, const char *name, SpeciesIndexMatch on_match, void *context, size_t *num_matches)
+{
+    const SpeciesIndexHeader *header = (const SpeciesIndexHeader *)index;
+    const SpeciesIndexName *records = (const SpeciesIndexName *)(index + header->names_offset);
+    const uint64_t *paths = (const uint64_t *)(index + header->paths_offset);
+    const char *strings = index + header->strings_offset;
+
+    *num_matches = 0;
+    if (header->num_names == 0)
+    {
+        return true;
+    }
+
+    PerfectHash hash = {
+        .seed = header->seed,
+        .num_keys = (size_t)header->num_names,
+        .num_buckets = (size_t)header->num_buckets,
+        .num_slots = (size_t)header->num_slots,
+        .displacements = (const uint32_t *)(index + header->displacements_offset),
+        .taken = (const uint64_t *)(index + header->taken_offset),
+        .ranks = (const uint32_t *)(index + header->ranks_offset)};
+
+    // Any string gets an index, so the name stored there tells if it is the one
+    size_t position = perfect_hash_index(&hash, name);
+    if (position >= header->num_names)
+    {
+        return false;
+    }
+
+    const SpeciesIndexName *record = &records[position];
+    if (record->name >= header->strings_size ||
+        record->first_path > header->num_paths ||
+        record->num_paths > header->num_paths - record->first_path)
+    {
+        return false;
+    }
+
+    if (strcmp(strings + record->name, name) != 0)
+    {
+        return true;
+    }
+
+    for (uint64_t i = 0; i < record->num_paths; i++)
+    {
+        uint64_t path = paths[record->first_path + i];
+        if (path >= header->strings_size)
+        {
+            return false;
+        }
+
+        on_match(context, strings + path);
+        (*num_matches)++;
+    }
+
+    return true;
+}
+
+static StatusCode lookup_species_index(
+    const char *index_path,
+    const char *name,
+    SpeciesIndexMatch on_match,
+    void *context,
+    size_t *num_matches)
+{
+    if (!index_path || !name || !on_match || !num_matches)
+    {
+        logger_error("Invalid index path or species name");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    char *index;
+    size_t index_size;
+    StatusCode error = map_index(index_path, &index, &index_size);
+    if (error != SUCCESS)
+    {
+        return error;
+    }
+
+    if (!find_name(index, name, on_match, context, num_matches))
+    {
+        logger_error("Invalid species index: %s", index_path);
+        error = ERROR_INVALID_JSON;
+    }
+
+    munmap(index, index_size);
+    return error;
+}
+
+/**
+ * @brief A name found by a search
+ */
+typedef struct
+{
+    const char *name;
+    size_t position;
+    double similarity;
+} SearchResult;
+
+static int compare_results(const void *a, const void *b)
+{
+    const SearchResult *first = a;
+    const SearchResult *second = b;
+
+    if (first->similarity != second->similarity)
+    {
+        return first->similarity > second->similarity ? -1 : 1;
+    }
+    return strcmp(first->name, second->name);
+}
+
+/**
+ * @brief Find the trigram record of a trigram in a mapped index
+ *
+ * @param header The header of the index
+ * @param trigrams The trigram records, sorted
+ * @param trigram The trigram
+ * @return const SpeciesIndexTrigram* The record or NULL if no name has the trigram
+ */
+static const SpeciesIndexTrigram *find_trigram(
+    const SpeciesIndexHeader *header,
+    const SpeciesIndexTrigram *trigrams,
+    Trigram trigram)
+{
+    size_t low = 0;
+    size_t high = (size_t)header->num_trigrams;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (trigrams[middle].trigram < trigram)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return (low < header->num_trigrams && trigrams[low].trigram == trigram) ? &trigrams[low] : NULL;
+}
+
+/**
+ * @brief Count the trigrams of a text each name of a mapped index shares with it
+ *
+ * @param index The mapped index, with trigrams
+ * @param trigrams The distinct trigrams of the text
+ * @param num_trigrams The number of trigrams
+ * @param shared Array of a counter per name, cleared, to count them
+ * @return bool true if the posting lists read are valid, false otherwise
+ */
+static bool count_shared_trigrams(const char *index, const Trigram *trigrams, size_t num_trigrams, uint16_t *shared)
+{
+    const SpeciesIndexHeader *header = (const SpeciesIndexHeader *)index;
+    const SpeciesIndexTrigram *records = (const SpeciesIndexTrigram *)(index + header->trigrams_offset);
+    const unsigned char *postings = (const unsigned char *)(index + header->postings_offset);
+
+    for (size_t i = 0; i < num_trigrams; i++)
+    {
+        const SpeciesIndexTrigram *record = find_trigram(header, records, trigrams[i]);
+        if (!record)
+        {
+            continue;
+        }
+
+        uint64_t offset = record->postings;
+        uint64_t position = 0;
+        for (uint32_t j = 0; j < record->num_names; j++)
+        {
+            uint64_t delta = 0;
+            unsigned shift = 0;
+            do
+            {
+                if (offset >= header->postings_size || shift > 28)
+                {
+                    return false;
+                }
+                delta |= (uint64_t)(postings[offset] & 0x7f) << shift;
+                shift += 7;
+            } while (postings[offset++] & 0x80);
+
+            position += delta;
+            if (position >= header->num_names)
+            {
+                return false;
+            }
+            shared[position]++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Rank the names of a mapped index by their similarity to a text
+ *
+ * @param index The mapped index, with trigrams
+ * @param text The text
+ * @param min_similarity The similarity below which names are left out
+ * @param results Pointer to store the names found, most similar first, freed by the caller
+ * @param num_results Pointer to store the number of names found
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode rank_names(
+    const char *index,
+    const char *text,
+    double min_similarity,
+    SearchResult **results,
+    size_t *num_results)
+{
+    const SpeciesIndexHeader *header = (const SpeciesIndexHeader *)index;
+    const SpeciesIndexName *records = (const SpeciesIndexName *)(index + header->names_offset);
+    const uint16_t *name_trigrams = (const uint16_t *)(index + header->name_trigrams_offset);
+    const char *strings = index + header->strings_offset;
+    size_t num_names = (size_t)header->num_names;
+
+    Trigram *trigrams = malloc(trigrams_capacity(text) * sizeof(Trigram));
+    uint16_t *shared = calloc(num_names ? num_names : 1, sizeof(uint16_t));
+
+    *results = NULL;
+    *num_results = 0;
+    if (!trigrams || !shared)
+    {
+        free(trigrams);
+        free(shared);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Counters are 16 bits, so only the first 65535 trigrams of a text count
+    size_t num_trigrams = trigrams_extract(text, trigrams);
+    num_trigrams = num_trigrams < UINT16_MAX ? num_trigrams : UINT16_MAX;
+    StatusCode error = count_shared_trigrams(index, trigrams, num_trigrams, shared) ? SUCCESS : ERROR_INVALID_JSON;
+
+    size_t results_capacity = 0;
+    for (size_t position = 0; position < num_names && error == SUCCESS; position++)
+    {
+        if (shared[position] == 0)
+        {
+            continue;
+        }
+        if (shared[position] > name_trigrams[position] || records[position].name >= header->strings_size)
+        {
+            error = ERROR_INVALID_JSON;
+            break;
+        }
+
+        double similarity = trigrams_similarity(shared[position], num_trigrams, name_trigrams[position]);
+        if (similarity < min_similarity)
+        {
+            continue;
+        }
+
+        if (*num_results == results_capacity)
+        {
+            results_capacity = results_capacity ? results_capacity * 2 : 64;
+            SearchResult *grown = realloc(*results, results_capacity * sizeof(SearchResult));
+            if (!grown)
+            {
+                error = ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            *results = grown;
+        }
+        (*results)[(*num_results)++] = (SearchResult){strings + records[position].name, position, similarity};
+    }
+
+    // Nothing matched leaves no results to sort, and qsort needs an array
+    if (error == SUCCESS && *num_results > 0)
+    {
+        qsort(*results, *num_results, sizeof(SearchResult), compare_results);
+    }
+
+    free(trigrams);
+    free(shared);
+
+    return error;
+}
+
+static StatusCode search_species_index(
+    const char *index_path,
+    const char *text,
+    double min_similarity,
+    size_t max_names,
+    SpeciesIndexFound on_found,
+    void *context,
+    size_t *num_found)
+{
+    if (!index_path || !text || !on_found || !num_found)
+    {
+        logger_error("Invalid index path or text");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    *num_found = 0;
+
+    char *index;
+    size_t index_size;
+    StatusCode error = map_index(index_path, &index, &index_size);
+    if (error != SUCCESS)
+    {
+        return error;
+    }
+
+    const SpeciesIndexHeader *header = (const SpeciesIndexHeader *)index;
+    if (header->trigrams_offset == 0)
+    {
+        logger_error("Species index %s has no trigrams to search, write it with them", index_path);
+        munmap(index, index_size);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    SearchResult *results;
+    size_t num_results;
+    error = rank_names(index, text, min_similarity, &results, &num_results);
+
+    const SpeciesIndexName *records = (const SpeciesIndexName *)(index + header->names_offset);
+    const uint64_t *paths = (const uint64_t *)(index + header->paths_offset);
+    const char *strings = index + header->strings_offset;
+
+    for (size_t i = 0; i < num_results && i < max_names && error == SUCCESS; i++)
+    {
+        const SpeciesIndexName *record = &records[results[i].position];
+        if (record->first_path > header->num_paths || record->num_paths > header->num_paths - record->first_path)
+        {
+            error = ERROR_INVALID_JSON;
+            break;
+        }
+
+        for (uint64_t j = 0; j < record->num_paths && error == SUCCESS; j++)
+        {
+            uint64_t path = paths[record->first_path + j];
+            if (path >= header->strings_size)
+            {
+                error = ERROR_INVALID_JSON;
+                break;
+            }
+            on_found(context, results[i].name, strings + path, results[i].similarity);
+        }
+        (*num_found)++;
+    }
+
+    if (error == ERROR_INVALID_JSON)
+    {
+        logger_error("Invalid species index: %s", index_path);
+    }
+
+    free(results);
+    munmap(index, index_size);
+
+    return error;
+}
+
+static const SpeciesIndexPort species_index = {
+    .save = save_species_index,
+    .lookup = lookup_species_index,
+    .search = search_species_index};
+
+const SpeciesIndexPort *get_species_index(void)
+{
+    return &species_index;
+}
@@ -0,0 +1,17 @@
+#ifndef SPECIES_INDEX_H
+#define SPECIES_INDEX_H
+
+#include "../../core/ports/species_index_port.h"
+
+/**
+ * @brief Get the species index implementation
+ *
+ * Indexes are files mapped on lookup, where a minimal perfect hash of the
+ * names gives the only record to compare, so a lookup reads a few pages
+ * whatever the number of species.
+ *
+ * @return const SpeciesIndexPort* The species index implementation
+ */
+const SpeciesIndexPort *get_species_index(void);
+
+#endif /* SPECIES_INDEX_H */
@@ -0,0 +1,138 @@
+#include "../../include/common/arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Usable size of the blocks of an arena; larger allocations get their own block
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Alignment of every allocation, enough for any scalar type
+#define ARENA_ALIGNMENT 16
+
+struct ArenaBlock
+{
+    ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+    unsigned char data[];
+};
+
+/**
+ * @brief Get the aligned address of the free space of a block
+ *
+ * @param block The block
+ * @return size_t The offset in data where the next allocation would start
+ */
+static size_t block_next_offset(const ArenaBlock *block)
+{
+    uintptr_t address = (uintptr_t)(block->data + block->used);
+    uintptr_t aligned = (address + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+
+    return block->used + (size_t)(aligned - address);
+}
+
+void arena_init(Arena *arena)
+{
+    arena->blocks = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    ArenaBlock *block = arena->blocks;
+
+    if (block)
+    {
+        size_t offset = block_next_offset(block);
+        if (offset <= block->capacity && size <= block->capacity - offset)
+        {
+            block->used = offset + size;
+            return block->data + offset;
+        }
+    }
+
+    // Room for the allocation even when the block data is not aligned
+    size_t capacity = (size + ARENA_ALIGNMENT > ARENA_BLOCK_SIZE) ? size + ARENA_ALIGNMENT : ARENA_BLOCK_SIZE;
+    ArenaBlock *new_block = malloc(sizeof(ArenaBlock) + capacity);
+    if (!new_block)
+    {
+        return NULL;
+    }
+
+    new_block->used = 0;
+    new_block->capacity = capacity;
+
+    // A block only as large as its allocation goes behind the current one,
+    // which keeps its free space
+    if (block && capacity > ARENA_BLOCK_SIZE)
+    {
+        new_block->next = block->next;
+        block->next = new_block;
+    }
+    else
+    {
+        new_block->next = block;
+        arena->blocks = new_block;
+    }
+
+    size_t offset = block_next_offset(new_block);
+    new_block->used = offset + size;
+    return new_block->data + offset;
+}
+
+char *arena_strdup(Arena *arena, const char *str)
+{
+    if (!str)
+    {
+        return NULL;
+    }
+
+    size_t size = strlen(str) + 1;
+    char *copy = arena_alloc(arena, size);
+    if (copy)
+    {
+        memcpy(copy, str, size);
+    }
+
+    return copy;
+}
+
+void arena_take(Arena *arena, Arena *other)
+{
+    if (!other->blocks)
+    {
+        return;
+    }
+
+    if (!arena->blocks)
+    {
+        arena->blocks = other->blocks;
+        other->blocks = NULL;
+        return;
+    }
+
+    // The blocks go behind the current one, which keeps its free space
+    ArenaBlock *last = other->blocks;
+    while (last->next)
+    {
+        last = last->next;
+    }
+
+    last->next = arena->blocks->next;
+    arena->blocks->next = other->blocks;
+    other->blocks = NULL;
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaBlock *block = arena->blocks;
+
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+}
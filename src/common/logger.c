@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "../../include/common/logger.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,10 +53,14 @@ static void logger_logv(LogLevel level, const char *format, va_list args)
 
     // Get current time
     time_t now = time(NULL);
-    const struct tm *tm_info = localtime(&now);
+    struct tm tm_buffer;
+    const struct tm *tm_info = localtime_r(&now, &tm_buffer);
     char time_str[20];
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
 
+    // Hold the stream so lines logged by several threads do not interleave
+    flockfile(output);
+
     // Print log header with color
     fprintf(output, "%s[%s] [%s]%s ", color_code, time_str, level_str, "\033[0m");
 
@@ -62,6 +68,7 @@ static void logger_logv(LogLevel level, const char *format, va_list args)
     vfprintf(output, format, args);
 
     fprintf(output, "\n");
+    funlockfile(output);
 }
 
 void logger_log(LogLevel level, const char *format, ...)
@@ -0,0 +1,339 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../../include/common/parallel.h"
+#include "../../include/common/logger.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * @brief State shared by the threads of a parallel_for
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t next;
+    size_t count;
+    ParallelTask task;
+    void *context;
+} ParallelLoop;
+
+static void *parallel_worker(void *arg)
+{
+    ParallelLoop *loop = arg;
+
+    while (true)
+    {
+        pthread_mutex_lock(&loop->lock);
+        size_t index = loop->next;
+        if (index < loop->count)
+        {
+            loop->next++;
+        }
+        pthread_mutex_unlock(&loop->lock);
+
+        if (index >= loop->count)
+        {
+            break;
+        }
+
+        loop->task(loop->context, index);
+    }
+
+    return NULL;
+}
+
+int parallel_available_threads(void)
+{
+    long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (num_processors > 0) ? (int)num_processors : 1;
+}
+
+void parallel_for(size_t count, int num_threads, ParallelTask task, void *context)
+{
+    // Run small loops on the calling thread
+    if (num_threads <= 1 || count <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            task(context, i);
+        }
+        return;
+    }
+
+    if ((size_t)num_threads > count)
+    {
+        num_threads = (int)count;
+    }
+
+    ParallelLoop loop = {
+        .next = 0,
+        .count = count,
+        .task = task,
+        .context = context};
+    pthread_mutex_init(&loop.lock, NULL);
+
+    // The calling thread is one of the workers
+    pthread_t *threads = malloc((size_t)(num_threads - 1) * sizeof(pthread_t));
+    int started = 0;
+
+    if (threads)
+    {
+        while (started < num_threads - 1 &&
+               pthread_create(&threads[started], NULL, parallel_worker, &loop) == 0)
+        {
+            started++;
+        }
+    }
+
+    if (started < num_threads - 1)
+    {
+        logger_warning("Running with %d of %d threads", started + 1, num_threads);
+    }
+
+    parallel_worker(&loop);
+
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&loop.lock);
+}
+
+// Items moved at once from a thread to another, and the least room of a queue
+#define MAX_STOLEN 64
+
+/**
+ * @brief The items queued on a thread of parallel_steal
+ *
+ * The thread takes items from the bottom and others steal from the top, so
+ * a lock per queue is only contended while stealing.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t *items; // Pending items are items[top] to items[bottom - 1]
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+} ParallelQueue;
+
+/**
+ * @brief A thread of parallel_steal, with its own queue of items
+ */
+typedef struct ParallelWorker ParallelWorker;
+
+/**
+ * @brief State shared by the threads of a parallel_steal
+ */
+typedef struct
+{
+    ParallelWorker *workers;
+    int num_workers;
+    ParallelTask task;
+    void *context;
+} StealingLoop;
+
+struct ParallelWorker
+{
+    StealingLoop *loop;
+    int index;
+    ParallelQueue queue;
+};
+
+/**
+ * @brief Add an item at the bottom of a queue, its lock held
+ *
+ * @param queue The queue
+ * @param item The item
+ * @return bool true if successful, false if memory allocation failed
+ */
+static bool queue_push_locked(ParallelQueue *queue, size_t item)
+{
+    if (queue->bottom == queue->capacity)
+    {
+        // Reuse the room left by stolen items before growing
+        if (queue->top > 0)
+        {
+            memmove(queue->items, queue->items + queue->top, (queue->bottom - queue->top) * sizeof(size_t));
+            queue->bottom -= queue->top;
+            queue->top = 0;
+        }
+        else
+        {
+            size_t capacity = queue->capacity * 2;
+            size_t *items = realloc(queue->items, capacity * sizeof(size_t));
+            if (!items)
+            {
+                return false;
+            }
+            queue->items = items;
+            queue->capacity = capacity;
+        }
+    }
+
+    queue->items[queue->bottom++] = item;
+    return true;
+}
+
+static bool queue_pop(ParallelQueue *queue, size_t *item)
+{
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->bottom > queue->top;
+    if (found)
+    {
+        *item = queue->items[--queue->bottom];
+    }
+    if (queue->bottom == queue->top)
+    {
+        queue->top = 0;
+        queue->bottom = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+/**
+ * @brief Move half of the items of another thread to a thread with none
+ *
+ * @param worker The thread with no items
+ * @param item Pointer to store the first item to run
+ * @return bool true if an item was stolen, false if every queue was empty
+ */
+static bool steal(ParallelWorker *worker, size_t *item)
+{
+    StealingLoop *loop = worker->loop;
+
+    for (int i = 1; i < loop->num_workers; i++)
+    {
+        ParallelQueue *victim = &loop->workers[(worker->index + i) % loop->num_workers].queue;
+        size_t stolen[MAX_STOLEN];
+
+        pthread_mutex_lock(&victim->lock);
+        size_t taken = (victim->bottom - victim->top + 1) / 2;
+        taken = (taken > MAX_STOLEN) ? MAX_STOLEN : taken;
+        memcpy(stolen, victim->items + victim->top, taken * sizeof(size_t));
+        victim->top += taken;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (taken > 0)
+        {
+            // Only its thread fills a queue, so this one is still empty and
+            // has room; the far end of the range stolen runs last
+            pthread_mutex_lock(&worker->queue.lock);
+            for (size_t j = taken - 1; j > 0; j--)
+            {
+                queue_push_locked(&worker->queue, stolen[j]);
+            }
+            pthread_mutex_unlock(&worker->queue.lock);
+
+            *item = stolen[0];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void *stealing_worker(void *arg)
+{
+    ParallelWorker *worker = arg;
+    StealingLoop *loop = worker->loop;
+    size_t item;
+
+    // Tasks queue no items, so once every queue is empty there is nothing
+    // left for this thread; the items other threads hold are theirs to run
+    while (queue_pop(&worker->queue, &item) || steal(worker, &item))
+    {
+        loop->task(loop->context, item);
+    }
+
+    return NULL;
+}
+
+bool parallel_steal(size_t count, int num_threads, ParallelTask task, void *context)
+{
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    StealingLoop loop = {
+        .workers = calloc((size_t)num_threads, sizeof(ParallelWorker)),
+        .num_workers = num_threads,
+        .task = task,
+        .context = context};
+
+    if (!loop.workers)
+    {
+        logger_error("Failed to allocate memory for %d threads", num_threads);
+        return false;
+    }
+
+    // Each thread gets a contiguous range, queued backwards so it runs in order
+    bool queued = true;
+    for (int w = 0; w < num_threads; w++)
+    {
+        ParallelWorker *worker = &loop.workers[w];
+        worker->loop = &loop;
+        worker->index = w;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+
+        worker->queue.items = malloc(MAX_STOLEN * sizeof(size_t));
+        worker->queue.capacity = MAX_STOLEN;
+        queued = queued && worker->queue.items;
+
+        size_t first = count * (size_t)w / (size_t)num_threads;
+        size_t last = count * (size_t)(w + 1) / (size_t)num_threads;
+        for (size_t i = last; i > first && queued; i--)
+        {
+            queued = queue_push_locked(&worker->queue, i - 1);
+        }
+    }
+
+    pthread_t *threads = queued ? malloc((size_t)num_threads * sizeof(pthread_t)) : NULL;
+    int started = 0;
+
+    if (!queued)
+    {
+        logger_error("Failed to allocate memory for %zu items", count);
+    }
+    else
+    {
+        while (threads && started < num_threads - 1 &&
+               pthread_create(&threads[started], NULL, stealing_worker, &loop.workers[started + 1]) == 0)
+        {
+            started++;
+        }
+
+        if (started < num_threads - 1)
+        {
+            logger_warning("Running with %d of %d threads", started + 1, num_threads);
+        }
+
+        // The queues of threads that did not start are stolen by the caller
+        stealing_worker(&loop.workers[0]);
+
+        for (int i = 0; i < started; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (int w = 0; w < num_threads; w++)
+    {
+        pthread_mutex_destroy(&loop.workers[w].queue.lock);
+        free(loop.workers[w].queue.items);
+    }
+    free(threads);
+    free(loop.workers);
+
+    return queued;
+}
@@ -0,0 +1,290 @@
+#include "decision_trie.h"
+#include "../../../include/common/logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Initial number of slots of the child index, a power of two
+#define CHILD_SLOTS_INITIAL 64
+
+static size_t child_hash(size_t parent, QuestionId question, bool answer)
+{
+    uint64_t hash = (uint64_t)parent * 0x9e3779b97f4a7c15ULL;
+    hash ^= ((uint64_t)question << 1) | (answer ? 1u : 0u);
+    hash *= 0xff51afd7ed553ccdULL;
+    hash ^= hash >> 32;
+
+    return (size_t)hash;
+}
+
+/**
+ * @brief Find the slot of a child in the child index
+ *
+ * @param trie The trie, with a non-empty child index
+ * @param parent The parent node
+ * @param question The question answered to reach the child
+ * @param answer The answer
+ * @return size_t The slot holding the child, or the empty slot where it belongs
+ */
+static size_t find_child_slot(const DecisionTrie *trie, size_t parent, QuestionId question, bool answer)
+{
+    size_t mask = trie->child_slots_capacity - 1;
+    size_t slot = child_hash(parent, question, answer) & mask;
+
+    while (trie->child_slots[slot] != 0)
+    {
+        const DecisionNode *node = &trie->nodes[trie->child_slots[slot] - 1];
+        if (node->parent == parent && node->question == question && node->answer == answer)
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/**
+ * @brief Make the child index hold a number of nodes at most half full
+ *
+ * @param trie The trie
+ * @param num_nodes The number of nodes to index
+ * @return bool true if successful, false otherwise
+ */
+static bool reserve_child_slots(DecisionTrie *trie, size_t num_nodes)
+{
+    if (num_nodes * 2 <= trie->child_slots_capacity)
+    {
+        return true;
+    }
+
+    size_t capacity = trie->child_slots_capacity ? trie->child_slots_capacity : CHILD_SLOTS_INITIAL;
+    while (num_nodes * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+
+    size_t *slots = calloc(capacity, sizeof(size_t));
+    if (!slots)
+    {
+        return false;
+    }
+
+    free(trie->child_slots);
+    trie->child_slots = slots;
+    trie->child_slots_capacity = capacity;
+
+    // The root is nobody's child
+    for (size_t i = 1; i < trie->num_nodes; i++)
+    {
+        const DecisionNode *node = &trie->nodes[i];
+        trie->child_slots[find_child_slot(trie, node->parent, node->question, node->answer)] = i + 1;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Append a node to the trie, without indexing it
+ *
+ * @param trie The trie
+ * @param parent The parent node, or DECISION_TRIE_NONE for the root
+ * @param question The question answered to reach the node
+ * @param answer The answer
+ * @return bool true if successful, false otherwise
+ */
+static bool append_node(DecisionTrie *trie, size_t parent, QuestionId question, bool answer)
+{
+    if (trie->num_nodes == trie->nodes_capacity)
+    {
+        size_t capacity = trie->nodes_capacity ? trie->nodes_capacity * 2 : 64;
+        DecisionNode *nodes = realloc(trie->nodes, capacity * sizeof(DecisionNode));
+        if (!nodes)
+        {
+            return false;
+        }
+        trie->nodes = nodes;
+        trie->nodes_capacity = capacity;
+    }
+
+    DecisionNode *node = &trie->nodes[trie->num_nodes++];
+    node->question = question;
+    node->answer = answer;
+    node->parent = parent;
+    node->first_child = DECISION_TRIE_NONE;
+    node->last_child = DECISION_TRIE_NONE;
+    node->next_sibling = DECISION_TRIE_NONE;
+    node->first_species = DECISION_TRIE_NONE;
+    node->last_species = DECISION_TRIE_NONE;
+
+    return true;
+}
+
+/**
+ * @brief Get the child of a node reached by an answer, adding it if needed
+ *
+ * @param trie The trie
+ * @param parent The parent node
+ * @param question The question
+ * @param answer The answer
+ * @param child Pointer to store the child node
+ * @return bool true if successful, false otherwise
+ */
+static bool get_child(DecisionTrie *trie, size_t parent, QuestionId question, bool answer, size_t *child)
+{
+    if (!reserve_child_slots(trie, trie->num_nodes + 1))
+    {
+        return false;
+    }
+
+    size_t slot = find_child_slot(trie, parent, question, answer);
+    if (trie->child_slots[slot] != 0)
+    {
+        *child = trie->child_slots[slot] - 1;
+        return true;
+    }
+
+    if (!append_node(trie, parent, question, answer))
+    {
+        return false;
+    }
+
+    *child = trie->num_nodes - 1;
+    trie->child_slots[slot] = *child + 1;
+
+    DecisionNode *node = &trie->nodes[parent];
+    if (node->last_child == DECISION_TRIE_NONE)
+    {
+        node->first_child = *child;
+    }
+    else
+    {
+        trie->nodes[node->last_child].next_sibling = *child;
+    }
+    node->last_child = *child;
+
+    return true;
+}
+
+DecisionTrie *decision_trie_build(const DicotomicTree *tree)
+{
+    if (!tree)
+    {
+        logger_error("Invalid tree");
+        return NULL;
+    }
+
+    DecisionTrie *trie = malloc(sizeof(DecisionTrie));
+    if (!trie)
+    {
+        logger_error("Failed to allocate memory for decision trie");
+        return NULL;
+    }
+
+    trie->nodes = NULL;
+    trie->num_nodes = 0;
+    trie->nodes_capacity = 0;
+    trie->next_species = malloc((tree->num_species ? tree->num_species : 1) * sizeof(size_t));
+    trie->child_slots = NULL;
+    trie->child_slots_capacity = 0;
+
+    bool valid = trie->next_species && append_node(trie, DECISION_TRIE_NONE, 0, false);
+
+    for (size_t i = 0; i < tree->num_species && valid; i++)
+    {
+        const QuestionAnswer *path;
+        size_t count;
+        QuestionAnswer *sorted;
+
+        valid = species_path(&tree->species[i], tree->characteristics, tree->num_questions, &path, &count, &sorted);
+
+        // Descend from the root, adding the directories not seen yet
+        size_t node = 0;
+        for (size_t j = 0; j < count && valid; j++)
+        {
+            valid = get_child(trie, node, path[j].question, path[j].answer, &node);
+        }
+        free(sorted);
+
+        if (valid)
+        {
+            DecisionNode *end = &trie->nodes[node];
+            if (end->last_species == DECISION_TRIE_NONE)
+            {
+                end->first_species = i;
+            }
+            else
+            {
+                trie->next_species[end->last_species] = i;
+            }
+            end->last_species = i;
+            trie->next_species[i] = DECISION_TRIE_NONE;
+        }
+    }
+
+    if (!valid)
+    {
+        logger_error("Failed to allocate memory for decision trie");
+        decision_trie_free(trie);
+        return NULL;
+    }
+
+    return trie;
+}
+
+void decision_trie_order_species(
+    const DecisionTrie *trie,
+    size_t *order,
+    size_t *first,
+    size_t *num_own,
+    size_t *num_below)
+{
+    // Children are added after their parent, so going backwards sums every
+    // subtree before its parent needs it
+    for (size_t i = trie->num_nodes; i-- > 0;)
+    {
+        num_own[i] = 0;
+        for (size_t j = trie->nodes[i].first_species; j != DECISION_TRIE_NONE; j = trie->next_species[j])
+        {
+            num_own[i]++;
+        }
+    }
+    memcpy(num_below, num_own, trie->num_nodes * sizeof(size_t));
+    for (size_t i = trie->num_nodes; i-- > 1;)
+    {
+        num_below[trie->nodes[i].parent] += num_below[i];
+    }
+
+    // Going forwards, each node places its own species and hands the rest of
+    // its run out to its children
+    first[0] = 0;
+    for (size_t i = 0; i < trie->num_nodes; i++)
+    {
+        size_t position = first[i];
+
+        for (size_t j = trie->nodes[i].first_species; j != DECISION_TRIE_NONE; j = trie->next_species[j])
+        {
+            order[position++] = j;
+        }
+        for (size_t child = trie->nodes[i].first_child; child != DECISION_TRIE_NONE;
+             child = trie->nodes[child].next_sibling)
+        {
+            first[child] = position;
+            position += num_below[child];
+        }
+    }
+}
+
+void decision_trie_free(DecisionTrie *trie)
+{
+    if (!trie)
+    {
+        return;
+    }
+
+    free(trie->nodes);
+    free(trie->next_species);
+    free(trie->child_slots);
+    free(trie);
+}
@@ -0,0 +1,88 @@
+#ifndef DECISION_TRIE_H
+#define DECISION_TRIE_H
+
+#include "dicotomic_tree.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Index meaning "no node" or "no species" in a decision trie
+ */
+#define DECISION_TRIE_NONE SIZE_MAX
+
+/**
+ * @brief A node of a decision trie: one directory of the structure
+ *
+ * The node is reached from its parent by answering a question. Its children
+ * and the species that end at it are linked lists, in order of appearance
+ * in the key.
+ */
+typedef struct
+{
+    QuestionId question;
+    bool answer;
+    size_t parent;
+    size_t first_child;
+    size_t last_child;
+    size_t next_sibling;
+    size_t first_species;
+    size_t last_species;
+} DecisionNode;
+
+/**
+ * @brief The answer paths of the species of a tree merged by common prefix
+ *
+ * Node 0 is the root, the directory of the tree. Every other node is a
+ * distinct directory, shared by all the species whose path goes through it.
+ */
+typedef struct
+{
+    DecisionNode *nodes;
+    size_t num_nodes;
+    size_t nodes_capacity;
+    size_t *next_species; // Next species ending at the same node, by species index
+    size_t *child_slots;  // Hash index of children by parent and answer, each slot holds node + 1 or 0
+    size_t child_slots_capacity;
+} DecisionTrie;
+
+/**
+ * @brief Build the decision trie of a tree
+ *
+ * The path of each species is its characteristics ordered by question id,
+ * as given by species_path.
+ *
+ * @param tree The tree
+ * @return DecisionTrie* The trie or NULL if memory allocation failed
+ */
+DecisionTrie *decision_trie_build(const DicotomicTree *tree);
+
+/**
+ * @brief Number the species of a trie in depth-first order
+ *
+ * The species ending at a node come first, then those below each of its
+ * children in turn, so the species at or below any node are a run of the
+ * order starting at first[node].
+ *
+ * @param trie The trie
+ * @param order Array of one entry per species, to store the species in depth-first order
+ * @param first Array of num_nodes entries, to store where the run of each node starts
+ * @param num_own Array of num_nodes entries, to store the number of species ending at each node
+ * @param num_below Array of num_nodes entries, to store the number of species at or below each node
+ */
+void decision_trie_order_species(
+    const DecisionTrie *trie,
+    size_t *order,
+    size_t *first,
+    size_t *num_own,
+    size_t *num_below);
+
+/**
+ * @brief Free the memory allocated for a decision trie
+ *
+ * @param trie The trie to free
+ */
+void decision_trie_free(DecisionTrie *trie);
+
+#endif /* DECISION_TRIE_H */
@@ -1,11 +1,50 @@
 #include "dicotomic_tree.h"
-#include "../../../include/common/utils.h"
 #include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Initial number of slots of the question index, a power of two
+#define QUESTION_SLOTS_INITIAL 64
+
+// Species checked by a thread each time it takes work during validation
+#define SPECIES_PER_CHECK 4096
+
+/**
+ * @brief Make an array hold at least a number of elements, doubling its capacity
+ *
+ * @param array Pointer to the array
+ * @param capacity Pointer to the number of elements the array can hold
+ * @param needed The number of elements needed
+ * @param element_size The size of an element
+ * @return bool true if successful, false otherwise
+ */
+static bool reserve_array(void **array, size_t *capacity, size_t needed, size_t element_size)
+{
+    if (needed <= *capacity)
+    {
+        return true;
+    }
+
+    size_t new_capacity = *capacity ? *capacity : 16;
+    while (new_capacity < needed)
+    {
+        new_capacity *= 2;
+    }
+
+    void *new_array = realloc(*array, new_capacity * element_size);
+    if (!new_array)
+    {
+        return false;
+    }
+
+    *array = new_array;
+    *capacity = new_capacity;
+    return true;
+}
+
 DicotomicTree *dicotomic_tree_create(const char *name)
 {
     DicotomicTree *tree = malloc(sizeof(DicotomicTree));
@@ -15,7 +54,8 @@ DicotomicTree *dicotomic_tree_create(const char *name)
         return NULL;
     }
 
-    tree->name = my_strdup(name);
+    arena_init(&tree->strings);
+    tree->name = arena_strdup(&tree->strings, name);
     if (!tree->name)
     {
         logger_error("Failed to allocate memory for tree name");
@@ -25,172 +65,498 @@ DicotomicTree *dicotomic_tree_create(const char *name)
 
     tree->species = NULL;
     tree->num_species = 0;
+    tree->species_capacity = 0;
+    tree->characteristics = NULL;
+    tree->num_characteristics = 0;
+    tree->characteristics_capacity = 0;
     tree->questions = NULL;
     tree->num_questions = 0;
+    tree->questions_capacity = 0;
+    tree->question_slots = NULL;
+    tree->question_slots_capacity = 0;
+    tree->source = NULL;
+    tree->source_size = 0;
+    tree->release_source = NULL;
 
     return tree;
 }
 
-bool dicotomic_tree_add_species(DicotomicTree *tree, Species *species)
+bool dicotomic_tree_reserve(DicotomicTree *tree, size_t num_species, size_t num_characteristics)
+{
+    if (!tree)
+    {
+        logger_error("Invalid tree");
+        return false;
+    }
+
+    if (!reserve_array((void **)&tree->species, &tree->species_capacity, num_species, sizeof(Species)) ||
+        !reserve_array((void **)&tree->characteristics, &tree->characteristics_capacity,
+                       num_characteristics, sizeof(QuestionAnswer)))
+    {
+        logger_error("Failed to allocate memory for species");
+        return false;
+    }
+
+    return true;
+}
+
+bool dicotomic_tree_add_species_view(DicotomicTree *tree, char *name)
 {
-    if (!tree || !species)
+    if (!tree || !name)
     {
         logger_error("Invalid tree or species");
         return false;
     }
 
-    // Resize species array
-    Species **new_species = realloc(tree->species, (tree->num_species + 1) * sizeof(Species *));
-    if (!new_species)
+    if (!reserve_array((void **)&tree->species, &tree->species_capacity, tree->num_species + 1, sizeof(Species)))
     {
         logger_error("Failed to resize species array");
         return false;
     }
 
-    tree->species = new_species;
-    tree->species[tree->num_species] = species;
-    tree->num_species++;
+    Species *species = &tree->species[tree->num_species++];
+    species->name = name;
+    species->first_characteristic = tree->num_characteristics;
+    species->num_characteristics = 0;
+
+    return true;
+}
+
+bool dicotomic_tree_add_characteristic(DicotomicTree *tree, QuestionId question, bool answer)
+{
+    if (!tree || tree->num_species == 0)
+    {
+        logger_error("Invalid tree or no species");
+        return false;
+    }
+
+    if (!reserve_array((void **)&tree->characteristics, &tree->characteristics_capacity,
+                       tree->num_characteristics + 1, sizeof(QuestionAnswer)))
+    {
+        logger_error("Failed to resize characteristics array");
+        return false;
+    }
+
+    // Species are built one at a time, so the characteristics of the last
+    // one are always at the end of the array
+    QuestionAnswer *characteristic = &tree->characteristics[tree->num_characteristics++];
+    characteristic->question = question;
+    characteristic->answer = answer;
+    tree->species[tree->num_species - 1].num_characteristics++;
+
+    return true;
+}
+
+void dicotomic_tree_clear_species(DicotomicTree *tree)
+{
+    if (!tree)
+    {
+        return;
+    }
+
+    tree->num_species = 0;
+    tree->num_characteristics = 0;
+}
+
+bool dicotomic_tree_take_species(DicotomicTree *tree, DicotomicTree *other)
+{
+    if (!tree || !other)
+    {
+        logger_error("Invalid tree");
+        return false;
+    }
+
+    if (other->num_species == 0)
+    {
+        return true;
+    }
+
+    if (!dicotomic_tree_reserve(tree,
+                                tree->num_species + other->num_species,
+                                tree->num_characteristics + other->num_characteristics))
+    {
+        return false;
+    }
+
+    // Translate the ids of the other tree once per question, not per characteristic
+    QuestionId *ids = malloc((other->num_questions ? other->num_questions : 1) * sizeof(QuestionId));
+    if (!ids)
+    {
+        logger_error("Failed to allocate memory for question ids");
+        return false;
+    }
+
+    for (size_t i = 0; i < other->num_questions; i++)
+    {
+        if (!dicotomic_tree_intern_question(tree, other->questions[i], &ids[i]))
+        {
+            free(ids);
+            return false;
+        }
+    }
+
+    QuestionAnswer *characteristics = tree->characteristics + tree->num_characteristics;
+    for (size_t i = 0; i < other->num_characteristics; i++)
+    {
+        characteristics[i].question = ids[other->characteristics[i].question];
+        characteristics[i].answer = other->characteristics[i].answer;
+    }
+    free(ids);
+
+    Species *species = tree->species + tree->num_species;
+    for (size_t i = 0; i < other->num_species; i++)
+    {
+        species[i] = other->species[i];
+        species[i].first_characteristic += tree->num_characteristics;
+    }
+
+    tree->num_species += other->num_species;
+    tree->num_characteristics += other->num_characteristics;
+    dicotomic_tree_clear_species(other);
+
+    // Names copied by the other tree now belong to the tree
+    arena_take(&tree->strings, &other->strings);
 
     return true;
 }
 
+void dicotomic_tree_attach_source(
+    DicotomicTree *tree,
+    void *source,
+    size_t source_size,
+    TreeSourceRelease release_source)
+{
+    if (!tree)
+    {
+        return;
+    }
+
+    tree->source = source;
+    tree->source_size = source_size;
+    tree->release_source = release_source;
+}
+
+static size_t question_hash(const char *question)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *c = (const unsigned char *)question; *c; c++)
+    {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return (size_t)hash;
+}
+
 /**
- * @brief Check if a question is already in the array
+ * @brief Find the slot of a question in the index, or the empty slot it would take
  *
- * @param questions The array of questions
- * @param num_questions The number of questions in the array
- * @param question The question to check
- * @return bool true if the question is in the array, false otherwise
+ * @param tree The tree, whose index has at least one empty slot
+ * @param question The question
+ * @return size_t The slot
  */
-static bool is_question_in_array(const char **questions, int num_questions, const char *question)
+static size_t find_question_slot(const DicotomicTree *tree, const char *question)
 {
-    for (int i = 0; i < num_questions; i++)
+    size_t mask = tree->question_slots_capacity - 1;
+    size_t slot = question_hash(question) & mask;
+
+    while (tree->question_slots[slot] != 0 &&
+           strcmp(tree->questions[tree->question_slots[slot] - 1], question) != 0)
     {
-        if (strcmp(questions[i], question) == 0)
-        {
-            return true;
-        }
+        slot = (slot + 1) & mask;
     }
 
-    return false;
+    return slot;
 }
 
-bool dicotomic_tree_extract_questions(DicotomicTree *tree)
+/**
+ * @brief Rebuild the question index with room for at least twice the questions
+ *
+ * @param tree The tree
+ * @param num_questions The number of questions the index must hold
+ * @return bool true if successful, false otherwise
+ */
+static bool reserve_question_slots(DicotomicTree *tree, size_t num_questions)
 {
-    if (!tree || tree->num_species == 0)
+    if (num_questions * 2 <= tree->question_slots_capacity)
     {
-        logger_error("Invalid tree or no species");
+        return true;
+    }
+
+    size_t capacity = tree->question_slots_capacity ? tree->question_slots_capacity : QUESTION_SLOTS_INITIAL;
+    while (capacity < num_questions * 2)
+    {
+        capacity *= 2;
+    }
+
+    size_t *slots = calloc(capacity, sizeof(size_t));
+    if (!slots)
+    {
+        logger_error("Failed to allocate memory for question index");
         return false;
     }
 
-    // Free existing questions
-    if (tree->questions)
+    free(tree->question_slots);
+    tree->question_slots = slots;
+    tree->question_slots_capacity = capacity;
+
+    // Repeated questions keep the id of their first occurrence
+    for (size_t i = 0; i < tree->num_questions; i++)
     {
-        for (int i = 0; i < tree->num_questions; i++)
+        size_t slot = find_question_slot(tree, tree->questions[i]);
+        if (tree->question_slots[slot] == 0)
         {
-            free(tree->questions[i]);
+            tree->question_slots[slot] = i + 1;
         }
-        free(tree->questions);
-        tree->questions = NULL;
-        tree->num_questions = 0;
     }
 
-    // Count unique questions
-    int max_questions = 0;
-    for (int i = 0; i < tree->num_species; i++)
+    return true;
+}
+
+bool dicotomic_tree_find_question(const DicotomicTree *tree, const char *question, QuestionId *id)
+{
+    if (!tree || !question || !id || tree->question_slots_capacity == 0)
     {
-        max_questions += tree->species[i]->num_characteristics;
+        return false;
     }
 
-    // Allocate temporary array for unique questions
-    const char **unique_questions = malloc(max_questions * sizeof(char *));
-    if (!unique_questions)
+    size_t slot = find_question_slot(tree, question);
+    if (tree->question_slots[slot] == 0)
     {
-        logger_error("Failed to allocate memory for unique questions");
         return false;
     }
 
-    int num_unique_questions = 0;
+    *id = (QuestionId)(tree->question_slots[slot] - 1);
+    return true;
+}
 
-    // Extract unique questions in order
-    for (int i = 0; i < tree->num_species; i++)
+bool dicotomic_tree_intern_question(DicotomicTree *tree, const char *question, QuestionId *id)
+{
+    if (!tree || !question || !id)
     {
-        Species *species = tree->species[i];
+        logger_error("Invalid tree or question");
+        return false;
+    }
 
-        for (int j = 0; j < species->num_characteristics; j++)
-        {
-            const char *question = species->characteristics[j].question;
+    if (!reserve_question_slots(tree, tree->num_questions + 1))
+    {
+        return false;
+    }
 
-            if (!is_question_in_array(unique_questions, num_unique_questions, question))
-            {
-                unique_questions[num_unique_questions] = question;
-                num_unique_questions++;
-            }
-        }
+    size_t slot = find_question_slot(tree, question);
+    if (tree->question_slots[slot] != 0)
+    {
+        *id = (QuestionId)(tree->question_slots[slot] - 1);
+        return true;
+    }
+
+    if (tree->num_questions >= QUESTION_ID_MAX)
+    {
+        logger_error("Too many questions in tree '%s'", tree->name);
+        return false;
+    }
+
+    // Resize questions array
+    if (!reserve_array((void **)&tree->questions, &tree->questions_capacity,
+                       tree->num_questions + 1, sizeof(char *)))
+    {
+        logger_error("Failed to resize questions array");
+        return false;
     }
 
-    // Allocate and copy unique questions
-    tree->questions = malloc(num_unique_questions * sizeof(char *));
-    if (!tree->questions)
+    tree->questions[tree->num_questions] = arena_strdup(&tree->strings, question);
+    if (!tree->questions[tree->num_questions])
+    {
+        logger_error("Failed to allocate memory for question");
+        return false;
+    }
+
+    *id = (QuestionId)tree->num_questions;
+    tree->question_slots[slot] = ++tree->num_questions;
+
+    return true;
+}
+
+bool dicotomic_tree_set_questions(DicotomicTree *tree, const char **questions, size_t num_questions)
+{
+    if (!tree || !questions || num_questions == 0 || num_questions > QUESTION_ID_MAX)
+    {
+        logger_error("Invalid tree or questions");
+        return false;
+    }
+
+    char **new_questions = malloc(num_questions * sizeof(char *));
+    if (!new_questions)
     {
         logger_error("Failed to allocate memory for questions");
-        free(unique_questions);
         return false;
     }
 
-    for (int i = 0; i < num_unique_questions; i++)
+    // Copies of replaced questions stay in the arena until the tree is freed
+    for (size_t i = 0; i < num_questions; i++)
     {
-        tree->questions[i] = my_strdup(unique_questions[i]);
-        if (!tree->questions[i])
+        new_questions[i] = arena_strdup(&tree->strings, questions[i]);
+        if (!new_questions[i])
         {
             logger_error("Failed to allocate memory for question");
-
-            // Free already allocated questions
-            for (int j = 0; j < i; j++)
-            {
-                free(tree->questions[j]);
-            }
-            free(tree->questions);
-            tree->questions = NULL;
-            free(unique_questions);
+            free(new_questions);
             return false;
         }
     }
 
-    tree->num_questions = num_unique_questions;
-    free(unique_questions);
+    free(tree->questions);
+    free(tree->question_slots);
 
-    return true;
+    tree->questions = new_questions;
+    tree->num_questions = num_questions;
+    tree->questions_capacity = num_questions;
+    tree->question_slots = NULL;
+    tree->question_slots_capacity = 0;
+
+    return reserve_question_slots(tree, num_questions);
 }
 
-bool dicotomic_tree_validate(DicotomicTree *tree)
+bool dicotomic_tree_reorder_questions(DicotomicTree *tree, const QuestionId *order)
 {
-    if (!tree || tree->num_species == 0)
+    if (!tree || !order)
     {
-        logger_error("Invalid tree or no species");
+        logger_error("Invalid tree or question order");
         return false;
     }
 
-    // Extract questions if not already done
-    if (tree->num_questions == 0)
+    size_t num_questions = tree->num_questions;
+    size_t longest = 0;
+    for (size_t i = 0; i < tree->num_species; i++)
     {
-        if (!dicotomic_tree_extract_questions(tree))
+        if (tree->species[i].num_characteristics > longest)
         {
-            return false;
+            longest = tree->species[i].num_characteristics;
         }
     }
 
+    char **questions = malloc((num_questions ? num_questions : 1) * sizeof(char *));
+    QuestionId *new_ids = malloc((num_questions ? num_questions : 1) * sizeof(QuestionId));
+    PositionedCharacteristic *sorted = malloc((longest ? longest : 1) * sizeof(PositionedCharacteristic));
+    if (!questions || !new_ids || !sorted)
+    {
+        logger_error("Failed to allocate memory for question order");
+        free(questions);
+        free(new_ids);
+        free(sorted);
+        return false;
+    }
+
+    for (size_t i = 0; i < num_questions; i++)
+    {
+        questions[i] = tree->questions[order[i]];
+        new_ids[order[i]] = (QuestionId)i;
+    }
+
+    // Each species keeps its answers, now sorted by their new ids; the sort
+    // is stable so a repeated question still keeps its first answer first
+    for (size_t i = 0; i < tree->num_species; i++)
+    {
+        QuestionAnswer *characteristics = &tree->characteristics[tree->species[i].first_characteristic];
+        size_t count = tree->species[i].num_characteristics;
+
+        for (size_t j = 0; j < count; j++)
+        {
+            sorted[j].characteristic.question =
+                characteristics[j].question < num_questions ? new_ids[characteristics[j].question]
+                                                            : characteristics[j].question;
+            sorted[j].characteristic.answer = characteristics[j].answer;
+            sorted[j].position = j;
+        }
+        species_sort_positioned(sorted, count);
+        for (size_t j = 0; j < count; j++)
+        {
+            characteristics[j] = sorted[j].characteristic;
+        }
+    }
+
+    free(new_ids);
+    free(sorted);
+
+    free(tree->questions);
+    free(tree->question_slots);
+    tree->questions = questions;
+    tree->questions_capacity = num_questions;
+    tree->question_slots = NULL;
+    tree->question_slots_capacity = 0;
+
+    return reserve_question_slots(tree, num_questions);
+}
+
+/**
+ * @brief Species of a tree checked on several threads
+ */
+typedef struct
+{
+    const DicotomicTree *tree;
+    bool *misplaced;
+} OrderCheck;
+
+static void check_order_task(void *context, size_t index)
+{
+    OrderCheck *check = context;
+    const DicotomicTree *tree = check->tree;
+    size_t first = index * SPECIES_PER_CHECK;
+    size_t end = (first + SPECIES_PER_CHECK < tree->num_species) ? first + SPECIES_PER_CHECK : tree->num_species;
+
+    for (size_t i = first; i < end; i++)
+    {
+        const Species *species = &tree->species[i];
+        check->misplaced[i] = species_find_misplaced_question(species, tree->characteristics, tree->num_questions) <
+                              species->num_characteristics;
+    }
+}
+
+bool dicotomic_tree_validate(DicotomicTree *tree, int num_threads)
+{
+    if (!tree || tree->num_species == 0)
+    {
+        logger_error("Invalid tree or no species");
+        return false;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = parallel_available_threads();
+    }
+
+    // Threads only find the species out of order, which are then reported in
+    // order; without memory for the flags every species is checked here
+    OrderCheck check = {.tree = tree, .misplaced = NULL};
+    if (num_threads > 1 && tree->num_questions > 0 && tree->num_species > SPECIES_PER_CHECK)
+    {
+        check.misplaced = malloc(tree->num_species * sizeof(bool));
+    }
+
+    if (check.misplaced)
+    {
+        size_t num_checks = (tree->num_species + SPECIES_PER_CHECK - 1) / SPECIES_PER_CHECK;
+        parallel_for(num_checks, num_threads, check_order_task, &check);
+    }
+
     // Check that all species follow the same question order
-    for (int i = 0; i < tree->num_species; i++)
+    for (size_t i = 0; i < tree->num_species; i++)
     {
-        Species *species = tree->species[i];
+        const Species *species = &tree->species[i];
 
-        if (!species_follows_question_order(species, (const char **)tree->questions, tree->num_questions))
+        if (check.misplaced && !check.misplaced[i])
+        {
+            continue;
+        }
+
+        if (!species_follows_question_order(
+                species, tree->characteristics, (const char **)tree->questions, tree->num_questions))
         {
             logger_warning("Species '%s' does not follow the expected question order", species->name);
             // We don't return false here because the spec says to skip species with wrong order
         }
     }
+    free(check.misplaced);
 
     return true;
 }
@@ -202,22 +568,18 @@ void dicotomic_tree_free(DicotomicTree *tree)
         return;
     }
 
-    // Free name
-    free(tree->name);
-
-    // Free species
-    for (int i = 0; i < tree->num_species; i++)
-    {
-        species_free(tree->species[i]);
-    }
+    // Free the arrays, then every string the tree copied at once
     free(tree->species);
+    free(tree->characteristics);
+    free(tree->questions);
+    free(tree->question_slots);
+    arena_free(&tree->strings);
 
-    // Free questions
-    for (int i = 0; i < tree->num_questions; i++)
+    // Release the buffer borrowed strings point into, once nothing uses it
+    if (tree->source && tree->release_source)
     {
-        free(tree->questions[i]);
+        tree->release_source(tree->source, tree->source_size);
     }
-    free(tree->questions);
 
     // Free tree
     free(tree);
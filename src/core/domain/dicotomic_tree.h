@@ -3,17 +3,44 @@
 
 #include "species.h"
 #include "../../../include/common/types.h"
+#include "../../../include/common/arena.h"
+
+#include <stddef.h>
+
+/**
+ * @brief Releases the buffer a tree borrows its strings from
+ */
+typedef void (*TreeSourceRelease)(void *source, size_t source_size);
 
 /**
  * @brief Represents a dicotomic tree
+ *
+ * The tree is stored flat: species records one after another, the
+ * characteristics of every species in a single array, and the strings the
+ * tree copies in an arena. Adding a species or a characteristic allocates
+ * only when an array doubles, and freeing the tree frees a few blocks.
+ *
+ * Questions are interned: each text is stored once, in order of first
+ * appearance, and characteristics refer to it by its index in questions.
  */
 typedef struct
 {
     char *name;
-    Species **species;
-    int num_species;
+    Species *species;
+    size_t num_species;
+    size_t species_capacity;
+    QuestionAnswer *characteristics;
+    size_t num_characteristics;
+    size_t characteristics_capacity;
     char **questions;
-    int num_questions;
+    size_t num_questions;
+    size_t questions_capacity;
+    size_t *question_slots; // Hash index of questions, each slot holds id + 1 or 0 when empty
+    size_t question_slots_capacity;
+    Arena strings; // The name, the questions and the strings of merged trees
+    void *source;
+    size_t source_size;
+    TreeSourceRelease release_source;
 } DicotomicTree;
 
 /**
@@ -25,29 +52,130 @@ typedef struct
 DicotomicTree *dicotomic_tree_create(const char *name);
 
 /**
- * @brief Add a species to the tree
+ * @brief Make room for species and characteristics before adding them
+ *
+ * @param tree The tree
+ * @param num_species The number of species the tree will hold
+ * @param num_characteristics The number of characteristics the tree will hold
+ * @return bool true if successful, false otherwise
+ */
+bool dicotomic_tree_reserve(DicotomicTree *tree, size_t num_species, size_t num_characteristics);
+
+/**
+ * @brief Start a new species at the end of the tree
+ *
+ * The name is borrowed, not copied: it must outlive the species, e.g. a
+ * string stored inside the key file attached with dicotomic_tree_attach_source.
+ *
+ * @param tree The tree
+ * @param name The name of the species
+ * @return bool true if successful, false otherwise
+ */
+bool dicotomic_tree_add_species_view(DicotomicTree *tree, char *name);
+
+/**
+ * @brief Add a characteristic to the last species of the tree
+ *
+ * @param tree The tree
+ * @param question The id of the question in the tree
+ * @param answer The answer
+ * @return bool true if successful, false otherwise
+ */
+bool dicotomic_tree_add_characteristic(DicotomicTree *tree, QuestionId question, bool answer);
+
+/**
+ * @brief Drop every species of the tree, keeping its questions and its memory
+ *
+ * @param tree The tree
+ */
+void dicotomic_tree_clear_species(DicotomicTree *tree);
+
+/**
+ * @brief Move all species of another tree to the end of a tree
+ *
+ * The other tree is left without species. Their questions are interned in
+ * the tree and their ids translated, and the strings of the other tree move
+ * to the tree with them.
+ *
+ * @param tree The tree receiving the species
+ * @param other The tree giving its species
+ * @return bool true if successful, false otherwise
+ */
+bool dicotomic_tree_take_species(DicotomicTree *tree, DicotomicTree *other);
+
+/**
+ * @brief Hand over the buffer that species names and questions point into
+ *
+ * The buffer is released with release_source when the tree is freed, after
+ * all species that borrow from it.
+ *
+ * @param tree The tree
+ * @param source The buffer (e.g. the mapped key file)
+ * @param source_size The size of the buffer in bytes
+ * @param release_source The function used to release the buffer
+ */
+void dicotomic_tree_attach_source(
+    DicotomicTree *tree,
+    void *source,
+    size_t source_size,
+    TreeSourceRelease release_source);
+
+/**
+ * @brief Get the id of a question, adding it to the tree if it is new
  *
  * @param tree The tree
- * @param species The species to add
+ * @param question The question
+ * @param id Pointer to store the id of the question
  * @return bool true if successful, false otherwise
  */
-bool dicotomic_tree_add_species(DicotomicTree *tree, Species *species);
+bool dicotomic_tree_intern_question(DicotomicTree *tree, const char *question, QuestionId *id);
 
 /**
- * @brief Extract all unique questions from the species in the tree
+ * @brief Get the id of a question of the tree, without adding it
  *
  * @param tree The tree
+ * @param question The question
+ * @param id Pointer to store the id of the question
+ * @return bool true if the tree has the question, false otherwise
+ */
+bool dicotomic_tree_find_question(const DicotomicTree *tree, const char *question, QuestionId *id);
+
+/**
+ * @brief Replace the questions of the tree with copies of the given ones
+ *
+ * Ids follow the given order. The tree must not hold species yet, since their
+ * ids would refer to the old questions.
+ *
+ * @param tree The tree
+ * @param questions The questions in order
+ * @param num_questions The number of questions
+ * @return bool true if successful, false otherwise
+ */
+bool dicotomic_tree_set_questions(DicotomicTree *tree, const char **questions, size_t num_questions);
+
+/**
+ * @brief Give the questions of the tree new ids
+ *
+ * The characteristics of every species are renumbered and sorted by their
+ * new ids, so the species answer the same questions in the new order.
+ *
+ * @param tree The tree
+ * @param order The old id of each question, by new id: a permutation of the ids
  * @return bool true if successful, false otherwise
  */
-bool dicotomic_tree_extract_questions(DicotomicTree *tree);
+bool dicotomic_tree_reorder_questions(DicotomicTree *tree, const QuestionId *order);
 
 /**
  * @brief Validate that all species follow the same question order
  *
+ * Species are checked on several threads when there are enough of them;
+ * warnings for those out of order are still logged in tree order.
+ *
  * @param tree The tree
- * @return bool true if all species follow the same order, false otherwise
+ * @param num_threads The number of threads, 0 for one per processor
+ * @return bool true if the tree can be used, false otherwise
  */
-bool dicotomic_tree_validate(DicotomicTree *tree);
+bool dicotomic_tree_validate(DicotomicTree *tree, int num_threads);
 
 /**
  * @brief Free the memory allocated for a dicotomic tree
@@ -0,0 +1,98 @@
+#include "directory_set.h"
+
+// Empty slots per directory, keeping probes short until the set is full
+#define SLOTS_PER_DIRECTORY 2
+
+static uint64_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed553ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+static size_t set_capacity(size_t num_directories)
+{
+    size_t capacity = 16;
+    while (capacity < num_directories * SLOTS_PER_DIRECTORY)
+    {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+size_t directory_set_size(size_t num_directories)
+{
+    return sizeof(DirectorySet) + set_capacity(num_directories) * sizeof(uint64_t);
+}
+
+DirectorySet *directory_set_init(void *memory, size_t num_directories)
+{
+    DirectorySet *set = memory;
+    set->capacity = set_capacity(num_directories);
+    set->count = 0;
+
+    return set;
+}
+
+uint64_t directory_set_key(uint64_t parent, const char *name)
+{
+    // FNV-1a started from the parent
+    uint64_t hash = 0xcbf29ce484222325ULL ^ mix(parent);
+    for (const unsigned char *c = (const unsigned char *)name; *c; c++)
+    {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash = mix(hash);
+
+    return hash ? hash : 1;
+}
+
+bool directory_set_contains(const DirectorySet *set, uint64_t key)
+{
+    // The set is never full, so every probe ends at an empty slot
+    size_t mask = set->capacity - 1;
+    for (size_t slot = (size_t)key & mask;; slot = (slot + 1) & mask)
+    {
+        uint64_t found = __atomic_load_n(&set->keys[slot], __ATOMIC_ACQUIRE);
+        if (found == key)
+        {
+            return true;
+        }
+        if (found == 0)
+        {
+            return false;
+        }
+    }
+}
+
+void directory_set_add(DirectorySet *set, uint64_t key)
+{
+    size_t mask = set->capacity - 1;
+
+    if (__atomic_add_fetch(&set->count, 1, __ATOMIC_RELAXED) > set->capacity / 4 * 3)
+    {
+        __atomic_sub_fetch(&set->count, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (size_t slot = (size_t)key & mask;; slot = (slot + 1) & mask)
+    {
+        uint64_t expected = 0;
+        if (__atomic_compare_exchange_n(&set->keys[slot], &expected, key, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        {
+            return;
+        }
+        if (expected == key)
+        {
+            // Added by another worker meanwhile
+            __atomic_sub_fetch(&set->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
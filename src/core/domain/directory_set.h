@@ -0,0 +1,68 @@
+#ifndef DIRECTORY_SET_H
+#define DIRECTORY_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A set of the directories known to exist
+ *
+ * Directories are identified by a 64-bit hash of their path, chained from
+ * the hash of their parent, so a path is never built to look one up. The
+ * set is a table of hashes filled with atomic operations and holding no
+ * pointers, so it can be shared by threads, or by processes when it lives
+ * in shared memory. It is only a hint: once it is three quarters full new
+ * directories are left out, and they are created as if unknown.
+ */
+typedef struct
+{
+    size_t capacity; // A power of two
+    size_t count;
+    uint64_t keys[]; // 0 marks an empty slot
+} DirectorySet;
+
+/**
+ * @brief Get the size of the memory of a set for a number of directories
+ *
+ * @param num_directories The number of directories the set should hold
+ * @return size_t The number of bytes to give to directory_set_init
+ */
+size_t directory_set_size(size_t num_directories);
+
+/**
+ * @brief Initialise an empty set in memory of directory_set_size bytes
+ *
+ * @param memory The memory, zeroed and suitably aligned
+ * @param num_directories The number of directories given to directory_set_size
+ * @return DirectorySet* The set, at the start of memory
+ */
+DirectorySet *directory_set_init(void *memory, size_t num_directories);
+
+/**
+ * @brief Get the key of a directory
+ *
+ * @param parent The key of the parent directory, 0 when name is a whole path
+ * @param name The name of the directory in its parent, or its path
+ * @return uint64_t The key, never 0
+ */
+uint64_t directory_set_key(uint64_t parent, const char *name);
+
+/**
+ * @brief Check whether a directory was added to the set
+ *
+ * @param set The set
+ * @param key The key of the directory
+ * @return bool true if the directory was added, false otherwise
+ */
+bool directory_set_contains(const DirectorySet *set, uint64_t key);
+
+/**
+ * @brief Add a directory to the set once it exists
+ *
+ * @param set The set
+ * @param key The key of the directory
+ */
+void directory_set_add(DirectorySet *set, uint64_t key);
+
+#endif /* DIRECTORY_SET_H */
@@ -0,0 +1,367 @@
+#include "key_diagnostics.h"
+#include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Species handled by a thread each time it takes work
+#define SPECIES_PER_TASK 4096
+
+// Signature of the empty path, extended one answer at a time
+#define PATH_SIGNATURE_SEED 0xcbf29ce484222325ULL
+
+static uint64_t extend_path_signature(uint64_t signature, QuestionAnswer answer)
+{
+    signature ^= ((uint64_t)answer.question << 1) | (answer.answer ? 1u : 0u);
+    signature *= 0x9e3779b97f4a7c15ULL;
+    signature ^= signature >> 32;
+
+    return signature;
+}
+
+static uint64_t name_signature(const char *name)
+{
+    // FNV-1a
+    uint64_t signature = 0xcbf29ce484222325ULL;
+    for (const unsigned char *c = (const unsigned char *)name; *c; c++)
+    {
+        signature ^= *c;
+        signature *= 0x100000001b3ULL;
+    }
+
+    return signature;
+}
+
+/**
+ * @brief The state of the diagnostics of a tree
+ *
+ * Species whose path is not a duplicate are indexed by the signature of
+ * their path, in an open-addressing table holding species index + 1.
+ */
+typedef struct
+{
+    const DicotomicTree *tree;
+    KeyDiagnostics *diagnostics;
+    uint64_t *path_signatures;
+    uint64_t *name_signatures;
+    size_t *path_lengths;
+    size_t *path_slots;
+    size_t path_slots_capacity;
+    bool failed;
+} Diagnosis;
+
+/**
+ * @brief Get the path of a species of the diagnosed tree
+ *
+ * @param diagnosis The diagnosis
+ * @param index The index of the species
+ * @param path Pointer to store the path
+ * @param count Pointer to store the length of the path
+ * @param sorted Pointer to store the copy to free, NULL if none
+ * @return bool true if successful, false otherwise
+ */
+static bool get_path(
+    const Diagnosis *diagnosis,
+    size_t index,
+    const QuestionAnswer **path,
+    size_t *count,
+    QuestionAnswer **sorted)
+{
+    const DicotomicTree *tree = diagnosis->tree;
+    return species_path(&tree->species[index], tree->characteristics, tree->num_questions, path, count, sorted);
+}
+
+/**
+ * @brief Check whether the path of a species is the start of another path
+ *
+ * @param diagnosis The diagnosis
+ * @param index The species
+ * @param path The other path
+ * @param length The length of the start, that of the path of the species
+ * @param equal Pointer to store the result
+ * @return bool true if successful, false otherwise
+ */
+static bool path_starts(const Diagnosis *diagnosis, size_t index, const QuestionAnswer *path, size_t length, bool *equal)
+{
+    const QuestionAnswer *own;
+    size_t count;
+    QuestionAnswer *sorted;
+
+    if (!get_path(diagnosis, index, &own, &count, &sorted))
+    {
+        return false;
+    }
+
+    *equal = count == length;
+    for (size_t i = 0; i < length && *equal; i++)
+    {
+        *equal = own[i].question == path[i].question && own[i].answer == path[i].answer;
+    }
+    free(sorted);
+
+    return true;
+}
+
+static void fail(Diagnosis *diagnosis)
+{
+    __atomic_store_n(&diagnosis->failed, true, __ATOMIC_RELAXED);
+}
+
+static void sign_species_task(void *context, size_t index)
+{
+    Diagnosis *diagnosis = context;
+    const DicotomicTree *tree = diagnosis->tree;
+    size_t first = index * SPECIES_PER_TASK;
+    size_t end = first + SPECIES_PER_TASK < tree->num_species ? first + SPECIES_PER_TASK : tree->num_species;
+
+    for (size_t i = first; i < end; i++)
+    {
+        const QuestionAnswer *path;
+        size_t count;
+        QuestionAnswer *sorted;
+
+        if (!get_path(diagnosis, i, &path, &count, &sorted))
+        {
+            fail(diagnosis);
+            return;
+        }
+
+        uint64_t signature = PATH_SIGNATURE_SEED;
+        for (size_t j = 0; j < count; j++)
+        {
+            signature = extend_path_signature(signature, path[j]);
+            __atomic_fetch_or(&diagnosis->diagnostics->answers_given[path[j].question],
+                              (unsigned char)(path[j].answer ? 2 : 1),
+                              __ATOMIC_RELAXED);
+        }
+        free(sorted);
+
+        diagnosis->path_signatures[i] = signature;
+        diagnosis->path_lengths[i] = count;
+        diagnosis->name_signatures[i] = name_signature(tree->species[i].name);
+    }
+}
+
+static void find_prefixes_task(void *context, size_t index)
+{
+    Diagnosis *diagnosis = context;
+    const DicotomicTree *tree = diagnosis->tree;
+    size_t first = index * SPECIES_PER_TASK;
+    size_t end = first + SPECIES_PER_TASK < tree->num_species ? first + SPECIES_PER_TASK : tree->num_species;
+    size_t mask = diagnosis->path_slots_capacity - 1;
+
+    for (size_t i = first; i < end; i++)
+    {
+        const QuestionAnswer *path;
+        size_t count;
+        QuestionAnswer *sorted;
+
+        if (!get_path(diagnosis, i, &path, &count, &sorted))
+        {
+            fail(diagnosis);
+            return;
+        }
+
+        // Look up every proper start of the path among the indexed paths
+        uint64_t signature = PATH_SIGNATURE_SEED;
+        for (size_t length = 0; length < count; length++)
+        {
+            for (size_t slot = signature & mask; diagnosis->path_slots[slot] != 0; slot = (slot + 1) & mask)
+            {
+                size_t other = diagnosis->path_slots[slot] - 1;
+                bool equal;
+
+                if (diagnosis->path_signatures[other] != signature || diagnosis->path_lengths[other] != length)
+                {
+                    continue;
+                }
+                if (!path_starts(diagnosis, other, path, length, &equal))
+                {
+                    fail(diagnosis);
+                    break;
+                }
+
+                // Keep the first species extending it, whichever thread finds it
+                size_t *extended_by = &diagnosis->diagnostics->extended_by[other];
+                size_t current = __atomic_load_n(extended_by, __ATOMIC_RELAXED);
+                while (equal && i < current &&
+                       !__atomic_compare_exchange_n(
+                           extended_by, &current, i, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                {
+                }
+            }
+
+            signature = extend_path_signature(signature, path[length]);
+        }
+        free(sorted);
+    }
+}
+
+/**
+ * @brief Find the species repeating the path or the name of an earlier one
+ *
+ * @param diagnosis The diagnosis, with the signatures computed
+ * @return bool true if successful, false otherwise
+ */
+static bool find_duplicates(Diagnosis *diagnosis)
+{
+    const DicotomicTree *tree = diagnosis->tree;
+    KeyDiagnostics *diagnostics = diagnosis->diagnostics;
+    size_t capacity = diagnosis->path_slots_capacity;
+    size_t mask = capacity - 1;
+
+    size_t *name_slots = calloc(capacity, sizeof(size_t));
+    if (!name_slots)
+    {
+        return false;
+    }
+
+    bool valid = true;
+    for (size_t i = 0; i < tree->num_species && valid; i++)
+    {
+        size_t slot = diagnosis->name_signatures[i] & mask;
+        for (; name_slots[slot] != 0; slot = (slot + 1) & mask)
+        {
+            size_t other = name_slots[slot] - 1;
+            if (diagnosis->name_signatures[other] == diagnosis->name_signatures[i] &&
+                strcmp(tree->species[other].name, tree->species[i].name) == 0)
+            {
+                diagnostics->same_name[i] = other;
+                break;
+            }
+        }
+        if (name_slots[slot] == 0)
+        {
+            name_slots[slot] = i + 1;
+        }
+
+        const QuestionAnswer *path;
+        size_t count;
+        QuestionAnswer *sorted;
+        if (!get_path(diagnosis, i, &path, &count, &sorted))
+        {
+            valid = false;
+            break;
+        }
+
+        slot = diagnosis->path_signatures[i] & mask;
+        for (; diagnosis->path_slots[slot] != 0; slot = (slot + 1) & mask)
+        {
+            size_t other = diagnosis->path_slots[slot] - 1;
+            bool equal = false;
+
+            if (diagnosis->path_signatures[other] == diagnosis->path_signatures[i] &&
+                diagnosis->path_lengths[other] == count)
+            {
+                valid = path_starts(diagnosis, other, path, count, &equal);
+            }
+            if (!valid || equal)
+            {
+                diagnostics->same_path[i] = equal ? other : KEY_DIAGNOSTICS_NONE;
+                break;
+            }
+        }
+        if (valid && diagnosis->path_slots[slot] == 0)
+        {
+            diagnosis->path_slots[slot] = i + 1;
+        }
+        free(sorted);
+    }
+
+    free(name_slots);
+    return valid;
+}
+
+bool key_diagnostics_run(const DicotomicTree *tree, int num_threads, KeyDiagnostics *diagnostics)
+{
+    if (!tree || !diagnostics)
+    {
+        logger_error("Invalid tree or diagnostics");
+        return false;
+    }
+
+    size_t num_species = tree->num_species ? tree->num_species : 1;
+    size_t capacity = 64;
+    while (capacity < num_species * 2)
+    {
+        capacity *= 2;
+    }
+
+    diagnostics->same_name = malloc(num_species * sizeof(size_t));
+    diagnostics->same_path = malloc(num_species * sizeof(size_t));
+    diagnostics->extended_by = malloc(num_species * sizeof(size_t));
+    diagnostics->answers_given = calloc(tree->num_questions ? tree->num_questions : 1, 1);
+    diagnostics->num_questions = tree->num_questions;
+
+    Diagnosis diagnosis = {
+        .tree = tree,
+        .diagnostics = diagnostics,
+        .path_signatures = malloc(num_species * sizeof(uint64_t)),
+        .name_signatures = malloc(num_species * sizeof(uint64_t)),
+        .path_lengths = malloc(num_species * sizeof(size_t)),
+        .path_slots = calloc(capacity, sizeof(size_t)),
+        .path_slots_capacity = capacity,
+        .failed = false};
+
+    bool valid = diagnostics->same_name && diagnostics->same_path && diagnostics->extended_by &&
+                 diagnostics->answers_given && diagnosis.path_signatures && diagnosis.name_signatures &&
+                 diagnosis.path_lengths && diagnosis.path_slots;
+
+    if (valid)
+    {
+        for (size_t i = 0; i < tree->num_species; i++)
+        {
+            diagnostics->same_name[i] = KEY_DIAGNOSTICS_NONE;
+            diagnostics->same_path[i] = KEY_DIAGNOSTICS_NONE;
+            diagnostics->extended_by[i] = KEY_DIAGNOSTICS_NONE;
+        }
+
+        if (num_threads <= 0)
+        {
+            num_threads = parallel_available_threads();
+        }
+
+        // Signatures in parallel, the tables in order so the first of each
+        // duplicate is the one kept, then the starts of paths in parallel
+        size_t num_tasks = (tree->num_species + SPECIES_PER_TASK - 1) / SPECIES_PER_TASK;
+        parallel_for(num_tasks, num_threads, sign_species_task, &diagnosis);
+        valid = !diagnosis.failed && find_duplicates(&diagnosis);
+        if (valid)
+        {
+            parallel_for(num_tasks, num_threads, find_prefixes_task, &diagnosis);
+            valid = !diagnosis.failed;
+        }
+    }
+
+    free(diagnosis.path_signatures);
+    free(diagnosis.name_signatures);
+    free(diagnosis.path_lengths);
+    free(diagnosis.path_slots);
+
+    if (!valid)
+    {
+        logger_error("Failed to allocate memory for the diagnostics of tree '%s'", tree->name);
+        key_diagnostics_free(diagnostics);
+    }
+
+    return valid;
+}
+
+void key_diagnostics_free(KeyDiagnostics *diagnostics)
+{
+    if (!diagnostics)
+    {
+        return;
+    }
+
+    free(diagnostics->same_name);
+    free(diagnostics->same_path);
+    free(diagnostics->extended_by);
+    free(diagnostics->answers_given);
+
+    diagnostics->same_name = NULL;
+    diagnostics->same_path = NULL;
+    diagnostics->extended_by = NULL;
+    diagnostics->answers_given = NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef KEY_DIAGNOSTICS_H
+#define KEY_DIAGNOSTICS_H
+
+#include "dicotomic_tree.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Marks a species without a finding of some kind
+#define KEY_DIAGNOSTICS_NONE SIZE_MAX
+
+/**
+ * @brief Problems of a tree that validation lets through
+ *
+ * Species are compared by their paths, their answers sorted by question id,
+ * which is what decides the directory they end in.
+ */
+typedef struct
+{
+    size_t *same_name;            // The first earlier species with the same name, per species
+    size_t *same_path;            // The first earlier species with the same path, so the same directory
+    size_t *extended_by;          // The first species whose path starts with the whole path of this one
+    unsigned char *answers_given; // Per question, bit 0 set if some species answers no, bit 1 if yes
+    size_t num_questions;
+} KeyDiagnostics;
+
+/**
+ * @brief Find duplicate names, duplicate paths, paths extended by others and
+ * questions always answered alike
+ *
+ * Paths and names are compared by 64-bit signatures, and matching
+ * signatures are confirmed by comparing the paths or names, so the pass is
+ * linear in the characteristics of the tree. Signatures and prefixes are
+ * computed on several threads.
+ *
+ * @param tree The tree
+ * @param num_threads The number of threads, 0 for one per processor
+ * @param diagnostics Pointer to store the findings, freed with key_diagnostics_free
+ * @return bool true if successful, false otherwise
+ */
+bool key_diagnostics_run(const DicotomicTree *tree, int num_threads, KeyDiagnostics *diagnostics);
+
+/**
+ * @brief Free the findings of key_diagnostics_run
+ *
+ * @param diagnostics The findings
+ */
+void key_diagnostics_free(KeyDiagnostics *diagnostics);
+
+#endif /* KEY_DIAGNOSTICS_H */
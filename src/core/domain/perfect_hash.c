@@ -0,0 +1,270 @@
+#include "perfect_hash.h"
+#include "../../../include/common/logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Average number of keys per bucket
+#define KEYS_PER_BUCKET 4
+
+// Slots per hundred keys; the few spare slots keep the last buckets quick to place
+#define SLOTS_PER_HUNDRED_KEYS 101
+
+// Displacements tried for a bucket before starting over with another seed
+#define MAX_DISPLACEMENT (1u << 20)
+
+// Seeds tried before giving up, which only happens with colliding keys
+#define MAX_SEEDS 32
+
+static uint64_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed553ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+static uint64_t key_hash(const char *key, uint64_t seed)
+{
+    // FNV-1a started from the seed
+    uint64_t hash = 0xcbf29ce484222325ULL ^ mix(seed);
+    for (const unsigned char *c = (const unsigned char *)key; *c; c++)
+    {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return mix(hash);
+}
+
+static size_t bucket_of(const PerfectHash *hash, uint64_t key_hash)
+{
+    return (size_t)((key_hash >> 32) % hash->num_buckets);
+}
+
+static size_t slot_of(const PerfectHash *hash, uint64_t key_hash, uint32_t displacement)
+{
+    return (size_t)(mix(key_hash ^ ((uint64_t)displacement * 0x9e3779b97f4a7c15ULL)) % hash->num_slots);
+}
+
+size_t perfect_hash_num_words(size_t num_slots)
+{
+    return (num_slots + 63) / 64;
+}
+
+/**
+ * @brief The keys of a set grouped by bucket
+ */
+typedef struct
+{
+    size_t *start; // Where the keys of each bucket start in keys, plus the end
+    size_t *keys;  // The keys, bucket by bucket
+    size_t *order; // The buckets, largest first
+} Buckets;
+
+// qsort has no context argument, and buckets are only sorted on one thread
+static const Buckets *sorted_buckets;
+
+static int compare_bucket_sizes(const void *a, const void *b)
+{
+    size_t first = *(const size_t *)a;
+    size_t second = *(const size_t *)b;
+    size_t first_size = sorted_buckets->start[first + 1] - sorted_buckets->start[first];
+    size_t second_size = sorted_buckets->start[second + 1] - sorted_buckets->start[second];
+
+    if (first_size != second_size)
+    {
+        return first_size > second_size ? -1 : 1;
+    }
+    return first < second ? -1 : (first > second);
+}
+
+/**
+ * @brief Try to place every bucket with the current seed
+ *
+ * @param hash The hash, with its seed and sizes set
+ * @param hashes The hash of each key with the seed
+ * @param buckets The buckets
+ * @param displacements Array to store the displacement of each bucket
+ * @param taken Bitmap to mark the slots taken, cleared
+ * @param slots Scratch array as large as the largest bucket
+ * @return bool true if every bucket was placed, false otherwise
+ */
+static bool place_buckets(
+    const PerfectHash *hash,
+    const uint64_t *hashes,
+    const Buckets *buckets,
+    uint32_t *displacements,
+    uint64_t *taken,
+    size_t *slots)
+{
+    for (size_t i = 0; i < hash->num_buckets; i++)
+    {
+        size_t bucket = buckets->order[i];
+        size_t first = buckets->start[bucket];
+        size_t size = buckets->start[bucket + 1] - first;
+        if (size == 0)
+        {
+            break;
+        }
+
+        bool placed = false;
+        for (uint32_t displacement = 0; displacement < MAX_DISPLACEMENT && !placed; displacement++)
+        {
+            // Mark the slots as they are found, undoing them on a clash
+            size_t j = 0;
+            for (; j < size; j++)
+            {
+                size_t slot = slot_of(hash, hashes[buckets->keys[first + j]], displacement);
+                uint64_t bit = 1ULL << (slot % 64);
+                if (taken[slot / 64] & bit)
+                {
+                    break;
+                }
+                taken[slot / 64] |= bit;
+                slots[j] = slot;
+            }
+
+            if (j == size)
+            {
+                displacements[bucket] = displacement;
+                placed = true;
+            }
+            else
+            {
+                while (j-- > 0)
+                {
+                    taken[slots[j] / 64] &= ~(1ULL << (slots[j] % 64));
+                }
+            }
+        }
+
+        if (!placed)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool perfect_hash_build(const char *const *keys, size_t num_keys, PerfectHash *hash)
+{
+    if (!hash || (!keys && num_keys > 0) || num_keys >= UINT32_MAX)
+    {
+        logger_error("Invalid keys for perfect hash");
+        return false;
+    }
+
+    hash->num_keys = num_keys;
+    hash->num_buckets = num_keys / KEYS_PER_BUCKET + 1;
+    hash->num_slots = num_keys * SLOTS_PER_HUNDRED_KEYS / 100 + 1;
+    hash->displacements = NULL;
+    hash->taken = NULL;
+    hash->ranks = NULL;
+
+    size_t num_words = perfect_hash_num_words(hash->num_slots);
+    uint64_t *hashes = malloc((num_keys ? num_keys : 1) * sizeof(uint64_t));
+    uint32_t *displacements = calloc(hash->num_buckets, sizeof(uint32_t));
+    uint64_t *taken = malloc(num_words * sizeof(uint64_t));
+    uint32_t *ranks = malloc(num_words * sizeof(uint32_t));
+    size_t *slots = malloc((num_keys ? num_keys : 1) * sizeof(size_t));
+    Buckets buckets = {
+        .start = malloc((hash->num_buckets + 1) * sizeof(size_t)),
+        .keys = malloc((num_keys ? num_keys : 1) * sizeof(size_t)),
+        .order = malloc(hash->num_buckets * sizeof(size_t))};
+
+    bool valid = hashes && displacements && taken && ranks && slots && buckets.start && buckets.keys && buckets.order;
+    bool built = false;
+
+    for (uint64_t seed = 0; valid && !built && seed < MAX_SEEDS; seed++)
+    {
+        hash->seed = seed;
+
+        // Group the keys by bucket, counting then placing them
+        memset(buckets.start, 0, (hash->num_buckets + 1) * sizeof(size_t));
+        for (size_t i = 0; i < num_keys; i++)
+        {
+            hashes[i] = key_hash(keys[i], seed);
+            buckets.start[bucket_of(hash, hashes[i]) + 1]++;
+        }
+        for (size_t b = 0; b < hash->num_buckets; b++)
+        {
+            buckets.start[b + 1] += buckets.start[b];
+            buckets.order[b] = buckets.start[b];
+        }
+        for (size_t i = 0; i < num_keys; i++)
+        {
+            buckets.keys[buckets.order[bucket_of(hash, hashes[i])]++] = i;
+        }
+
+        for (size_t b = 0; b < hash->num_buckets; b++)
+        {
+            buckets.order[b] = b;
+        }
+        sorted_buckets = &buckets;
+        qsort(buckets.order, hash->num_buckets, sizeof(size_t), compare_bucket_sizes);
+
+        memset(taken, 0, num_words * sizeof(uint64_t));
+        memset(displacements, 0, hash->num_buckets * sizeof(uint32_t));
+        built = place_buckets(hash, hashes, &buckets, displacements, taken, slots);
+    }
+
+    if (valid && built)
+    {
+        uint32_t rank = 0;
+        for (size_t w = 0; w < num_words; w++)
+        {
+            ranks[w] = rank;
+            rank += (uint32_t)__builtin_popcountll(taken[w]);
+        }
+
+        hash->displacements = displacements;
+        hash->taken = taken;
+        hash->ranks = ranks;
+    }
+    else
+    {
+        logger_error(valid ? "Failed to find a perfect hash for the keys"
+                           : "Failed to allocate memory for perfect hash");
+        free(displacements);
+        free(taken);
+        free(ranks);
+    }
+
+    free(hashes);
+    free(slots);
+    free(buckets.start);
+    free(buckets.keys);
+    free(buckets.order);
+
+    return valid && built;
+}
+
+size_t perfect_hash_index(const PerfectHash *hash, const char *key)
+{
+    uint64_t hashed = key_hash(key, hash->seed);
+    size_t slot = slot_of(hash, hashed, hash->displacements[bucket_of(hash, hashed)]);
+    uint64_t below = hash->taken[slot / 64] & ((1ULL << (slot % 64)) - 1);
+
+    return hash->ranks[slot / 64] + (size_t)__builtin_popcountll(below);
+}
+
+void perfect_hash_free(PerfectHash *hash)
+{
+    if (!hash)
+    {
+        return;
+    }
+
+    free((void *)hash->displacements);
+    free((void *)hash->taken);
+    free((void *)hash->ranks);
+
+    hash->displacements = NULL;
+    hash->taken = NULL;
+    hash->ranks = NULL;
+}
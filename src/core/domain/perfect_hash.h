@@ -0,0 +1,65 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A minimal perfect hash over a set of strings
+ *
+ * Keys are spread into buckets of a few keys, and each bucket stores the
+ * displacement that sends its keys to free slots of a table slightly larger
+ * than the set. A bit per slot marks the slots taken, and the rank of a
+ * slot among them is the index of its key, so indexes are 0 to num_keys - 1
+ * with none unused. Strings not in the set get some index too, so callers
+ * compare the key stored at the index.
+ *
+ * The arrays may point into a mapped file, so they are only read here.
+ */
+typedef struct
+{
+    uint64_t seed;
+    size_t num_keys;
+    size_t num_buckets;
+    size_t num_slots;
+    const uint32_t *displacements; // Per bucket
+    const uint64_t *taken;         // A bit per slot, in words of 64 slots
+    const uint32_t *ranks;         // Per word of taken, the slots taken before it
+} PerfectHash;
+
+/**
+ * @brief Get the number of words of taken and ranks for a number of slots
+ *
+ * @param num_slots The number of slots
+ * @return size_t The number of 64-bit words
+ */
+size_t perfect_hash_num_words(size_t num_slots);
+
+/**
+ * @brief Build a minimal perfect hash over distinct strings
+ *
+ * @param keys The strings, all different
+ * @param num_keys The number of strings, below UINT32_MAX
+ * @param hash Pointer to store the hash, freed with perfect_hash_free
+ * @return bool true if successful, false otherwise
+ */
+bool perfect_hash_build(const char *const *keys, size_t num_keys, PerfectHash *hash);
+
+/**
+ * @brief Get the index of a string
+ *
+ * @param hash The hash, with at least one key
+ * @param key The string
+ * @return size_t The index of the string if it is in the set, some index below num_keys otherwise
+ */
+size_t perfect_hash_index(const PerfectHash *hash, const char *key);
+
+/**
+ * @brief Free the arrays of a hash built with perfect_hash_build
+ *
+ * @param hash The hash
+ */
+void perfect_hash_free(PerfectHash *hash);
+
+#endif /* PERFECT_HASH_H */
@@ -0,0 +1,452 @@
+#include "question_order.h"
+#include "decision_trie.h"
+#include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Answers below which candidate questions are scored on the calling thread
+#define ANSWERS_PER_THREAD 65536
+
+bool question_order_measure(const DicotomicTree *tree, KeyShape *shape)
+{
+    if (!tree || !shape)
+    {
+        logger_error("Invalid tree or shape");
+        return false;
+    }
+
+    DecisionTrie *trie = decision_trie_build(tree);
+    if (!trie)
+    {
+        return false;
+    }
+
+    size_t num_nodes = trie->num_nodes;
+    size_t *order = malloc((tree->num_species ? tree->num_species : 1) * sizeof(size_t));
+    size_t *first = malloc(num_nodes * sizeof(size_t));
+    size_t *num_own = malloc(num_nodes * sizeof(size_t));
+    size_t *num_below = malloc(num_nodes * sizeof(size_t));
+    size_t *depth = malloc(num_nodes * sizeof(size_t));
+    size_t *identified_depth = malloc(num_nodes * sizeof(size_t));
+    QuestionId *child_question = malloc(num_nodes * sizeof(QuestionId));
+    bool *mixed = calloc(num_nodes, sizeof(bool));
+
+    bool valid = order && first && num_own && num_below && depth && identified_depth && child_question && mixed;
+    if (valid)
+    {
+        decision_trie_order_species(trie, order, first, num_own, num_below);
+
+        // Parents come before their children, so one pass carries the depth
+        // where the path became unique down to every node, and sees whether
+        // the children of each node answer the same question
+        depth[0] = 0;
+        identified_depth[0] = num_below[0] == 1 ? 0 : DECISION_TRIE_NONE;
+        shape->num_mixed = 0;
+        for (size_t i = 1; i < num_nodes; i++)
+        {
+            size_t parent = trie->nodes[i].parent;
+            if (trie->nodes[parent].first_child == i)
+            {
+                child_question[parent] = trie->nodes[i].question;
+            }
+            else if (child_question[parent] != trie->nodes[i].question && !mixed[parent])
+            {
+                mixed[parent] = true;
+                shape->num_mixed++;
+            }
+
+            depth[i] = depth[parent] + 1;
+            identified_depth[i] = identified_depth[parent];
+            if (identified_depth[i] == DECISION_TRIE_NONE && num_below[i] == 1)
+            {
+                identified_depth[i] = depth[i];
+            }
+        }
+
+        size_t total_depth = 0;
+        shape->max_depth = 0;
+        for (size_t i = 0; i < num_nodes; i++)
+        {
+            if (num_own[i] == 0)
+            {
+                continue;
+            }
+
+            size_t species_depth = identified_depth[i] != DECISION_TRIE_NONE ? identified_depth[i] : depth[i];
+            total_depth += species_depth * num_own[i];
+            if (depth[i] > shape->max_depth)
+            {
+                shape->max_depth = depth[i];
+            }
+        }
+
+        shape->num_directories = num_nodes - 1;
+        shape->average_depth = tree->num_species ? (double)total_depth / (double)tree->num_species : 0.0;
+    }
+    else
+    {
+        logger_error("Failed to allocate memory for measuring the tree");
+    }
+
+    free(order);
+    free(first);
+    free(num_own);
+    free(num_below);
+    free(depth);
+    free(identified_depth);
+    free(child_question);
+    free(mixed);
+    decision_trie_free(trie);
+
+    return valid;
+}
+
+/**
+ * @brief The state of the greedy search for a question order
+ *
+ * Species are split in groups, those that answer the questions chosen so
+ * far alike; each group ends up as a directory shared by its species.
+ * Species with no pending question end at the directory of their group.
+ */
+typedef struct
+{
+    size_t *answers_start; // Where the answers to each question start in answers
+    size_t *answers;       // Species answering each question, as species * 2 + answer
+    size_t *group;         // The group of each species
+    size_t *group_size;    // The number of species in each group
+    size_t num_groups;
+    size_t *pending;       // The number of remaining questions each species answers
+    size_t *group_done;    // The number of species of each group with no pending question
+    QuestionId *remaining; // Questions not chosen yet, in their current order
+    size_t num_remaining;
+    uint64_t *separated;   // Pairs of species each remaining question would tell apart
+    size_t *added;         // Directories each remaining question would add
+    bool *binary;          // Whether each remaining question keeps one question per directory
+    bool failed;
+} OrderSearch;
+
+static int compare_sizes(const void *a, const void *b)
+{
+    size_t first = *(const size_t *)a;
+    size_t second = *(const size_t *)b;
+
+    return first < second ? -1 : (first > second);
+}
+
+static uint64_t pairs(size_t count)
+{
+    return (uint64_t)count * (count ? count - 1 : 0) / 2;
+}
+
+/**
+ * @brief Get the answers to a question as group * 2 + answer
+ *
+ * @param search The search
+ * @param question The question
+ * @param keys Array to store the keys
+ * @param stride The number of elements between consecutive keys
+ * @return size_t The number of answers
+ */
+static size_t group_answers(const OrderSearch *search, QuestionId question, size_t *keys, size_t stride)
+{
+    size_t begin = search->answers_start[question];
+    size_t count = search->answers_start[question + 1] - begin;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t answer = search->answers[begin + i];
+        keys[i * stride] = search->group[answer / 2] * 2 + answer % 2;
+    }
+
+    return count;
+}
+
+static void score_question_task(void *context, size_t index)
+{
+    OrderSearch *search = context;
+    QuestionId question = search->remaining[index];
+    size_t count = search->answers_start[question + 1] - search->answers_start[question];
+    size_t *keys = malloc((count ? count : 1) * sizeof(size_t));
+
+    if (!keys)
+    {
+        __atomic_store_n(&search->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+
+    group_answers(search, question, keys, 1);
+    qsort(keys, count, sizeof(size_t), compare_sizes);
+
+    // A group splits into the species answering yes, those answering no and
+    // those that do not answer, which stay in the directory of the group;
+    // those must answer nothing else, or the directory would get
+    // subdirectories of another question later
+    uint64_t separated = 0;
+    size_t added = 0;
+    bool binary = true;
+    for (size_t i = 0; i < count;)
+    {
+        size_t group = keys[i] / 2;
+        size_t answered[2] = {0, 0};
+
+        for (; i < count && keys[i] / 2 == group; i++)
+        {
+            answered[keys[i] % 2]++;
+        }
+
+        size_t size = search->group_size[group];
+        separated += pairs(size) - pairs(size - answered[0] - answered[1]) - pairs(answered[0]) - pairs(answered[1]);
+        added += (answered[0] > 0) + (answered[1] > 0);
+        binary = binary && answered[0] + answered[1] + search->group_done[group] == size;
+    }
+
+    search->separated[index] = separated;
+    search->added[index] = added;
+    search->binary[index] = binary;
+    free(keys);
+}
+
+/**
+ * @brief Split the groups by the answers to a chosen question
+ *
+ * @param search The search
+ * @param question The question
+ * @return bool true if successful, false otherwise
+ */
+static bool split_groups(OrderSearch *search, QuestionId question)
+{
+    size_t begin = search->answers_start[question];
+    size_t count = search->answers_start[question + 1] - begin;
+
+    // Each key is followed by its species, and the pairs sort by key
+    size_t *keys = malloc((count ? count : 1) * 2 * sizeof(size_t));
+    if (!keys)
+    {
+        return false;
+    }
+
+    group_answers(search, question, keys, 2);
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i * 2 + 1] = search->answers[begin + i] / 2;
+    }
+    qsort(keys, count, 2 * sizeof(size_t), compare_sizes);
+
+    // A run taking a whole group keeps its id, so there are never more
+    // groups than species
+    for (size_t i = 0; i < count;)
+    {
+        size_t end = i;
+        while (end < count && keys[end * 2] == keys[i * 2])
+        {
+            end++;
+        }
+
+        size_t group = keys[i * 2] / 2;
+        if (end - i < search->group_size[group])
+        {
+            size_t new_group = search->num_groups++;
+            search->group_size[group] -= end - i;
+            search->group_size[new_group] = end - i;
+            for (size_t j = i; j < end; j++)
+            {
+                search->group[keys[j * 2 + 1]] = new_group;
+            }
+        }
+        i = end;
+    }
+
+    // Species answering the question have one pending question less, and
+    // those left with none end at their new group
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t species = keys[i * 2 + 1];
+        if (--search->pending[species] == 0)
+        {
+            search->group_done[search->group[species]]++;
+        }
+    }
+
+    free(keys);
+    return true;
+}
+
+/**
+ * @brief Index the species answering each question
+ *
+ * @param tree The tree
+ * @param search The search, to store the index in
+ * @return bool true if successful, false otherwise
+ */
+static bool index_answers(const DicotomicTree *tree, OrderSearch *search)
+{
+    size_t num_questions = tree->num_questions;
+
+    search->answers_start = calloc(num_questions + 1, sizeof(size_t));
+    search->answers = malloc((tree->num_characteristics ? tree->num_characteristics : 1) * sizeof(size_t));
+    size_t *next = malloc((num_questions ? num_questions : 1) * sizeof(size_t));
+    if (!search->answers_start || !search->answers || !next)
+    {
+        free(next);
+        return false;
+    }
+
+    // Count the answers to each question, then place them, both from the
+    // paths of the species so a repeated question counts once
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t i = 0; i < tree->num_species; i++)
+        {
+            const QuestionAnswer *path;
+            size_t count;
+            QuestionAnswer *sorted;
+
+            if (!species_path(&tree->species[i], tree->characteristics, num_questions, &path, &count, &sorted))
+            {
+                free(next);
+                return false;
+            }
+
+            for (size_t j = 0; j < count; j++)
+            {
+                if (pass == 0)
+                {
+                    search->answers_start[path[j].question + 1]++;
+                    search->pending[i]++;
+                }
+                else
+                {
+                    search->answers[next[path[j].question]++] = i * 2 + (path[j].answer ? 1 : 0);
+                }
+            }
+            free(sorted);
+        }
+
+        if (pass == 0)
+        {
+            for (size_t q = 0; q < num_questions; q++)
+            {
+                search->answers_start[q + 1] += search->answers_start[q];
+                next[q] = search->answers_start[q];
+            }
+        }
+    }
+
+    free(next);
+    return true;
+}
+
+bool question_order_optimize(const DicotomicTree *tree, int num_threads, QuestionId *order)
+{
+    if (!tree || !order)
+    {
+        logger_error("Invalid tree or question order");
+        return false;
+    }
+
+    size_t num_questions = tree->num_questions;
+    size_t num_species = tree->num_species ? tree->num_species : 1;
+    OrderSearch search = {
+        .answers_start = NULL,
+        .answers = NULL,
+        .group = calloc(num_species, sizeof(size_t)),
+        .group_size = malloc(num_species * sizeof(size_t)),
+        .num_groups = 1,
+        .pending = calloc(num_species, sizeof(size_t)),
+        .group_done = calloc(num_species, sizeof(size_t)),
+        .remaining = malloc((num_questions ? num_questions : 1) * sizeof(QuestionId)),
+        .num_remaining = num_questions,
+        .separated = malloc((num_questions ? num_questions : 1) * sizeof(uint64_t)),
+        .added = malloc((num_questions ? num_questions : 1) * sizeof(size_t)),
+        .binary = malloc((num_questions ? num_questions : 1) * sizeof(bool)),
+        .failed = false};
+
+    bool valid = search.group && search.group_size && search.pending && search.group_done && search.remaining &&
+                 search.separated && search.added && search.binary && index_answers(tree, &search);
+
+    if (num_threads <= 0)
+    {
+        num_threads = parallel_available_threads();
+    }
+    if (tree->num_characteristics < ANSWERS_PER_THREAD)
+    {
+        num_threads = 1;
+    }
+
+    size_t num_chosen = 0;
+    if (valid)
+    {
+        search.group_size[0] = tree->num_species;
+        for (size_t i = 0; i < tree->num_species; i++)
+        {
+            search.group_done[0] += search.pending[i] == 0;
+        }
+        for (size_t q = 0; q < num_questions; q++)
+        {
+            search.remaining[q] = (QuestionId)q;
+        }
+    }
+
+    while (valid && search.num_remaining > 0)
+    {
+        parallel_for(search.num_remaining, num_threads, score_question_task, &search);
+        if (search.failed)
+        {
+            valid = false;
+            break;
+        }
+
+        size_t best = DECISION_TRIE_NONE;
+        for (size_t i = 0; i < search.num_remaining; i++)
+        {
+            if (!search.binary[i] || search.separated[i] == 0)
+            {
+                continue;
+            }
+            if (best == DECISION_TRIE_NONE || search.separated[i] > search.separated[best] ||
+                (search.separated[i] == search.separated[best] && search.added[i] < search.added[best]))
+            {
+                best = i;
+            }
+        }
+
+        if (best == DECISION_TRIE_NONE)
+        {
+            break;
+        }
+
+        QuestionId question = search.remaining[best];
+        order[num_chosen++] = question;
+        memmove(&search.remaining[best],
+                &search.remaining[best + 1],
+                (search.num_remaining - best - 1) * sizeof(QuestionId));
+        search.num_remaining--;
+
+        valid = split_groups(&search, question);
+    }
+
+    if (valid)
+    {
+        memcpy(&order[num_chosen], search.remaining, search.num_remaining * sizeof(QuestionId));
+    }
+    else
+    {
+        logger_error("Failed to allocate memory for the question order");
+    }
+
+    free(search.answers_start);
+    free(search.answers);
+    free(search.group);
+    free(search.group_size);
+    free(search.pending);
+    free(search.group_done);
+    free(search.remaining);
+    free(search.separated);
+    free(search.added);
+    free(search.binary);
+
+    return valid;
+}
@@ -0,0 +1,53 @@
+#ifndef QUESTION_ORDER_H
+#define QUESTION_ORDER_H
+
+#include "dicotomic_tree.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The shape of the directories a tree creates with its question order
+ */
+typedef struct
+{
+    size_t num_directories; // Distinct directories, the mkdir calls needed
+    double average_depth;   // Questions a species answers before no other species shares its directory
+    size_t max_depth;       // The deepest directory of a species
+    size_t num_mixed;       // Directories whose subdirectories answer more than one question
+} KeyShape;
+
+/**
+ * @brief Measure the directories of a tree with its current question order
+ *
+ * A species is identified at the first directory of its path that no other
+ * species reaches; species that never get one (duplicates, or species whose
+ * path is the start of another) count their whole path. A directory whose
+ * subdirectories answer different questions is not a dichotomous step, so
+ * the measure only means the same for shapes with the same num_mixed.
+ *
+ * @param tree The tree
+ * @param shape Pointer to store the shape
+ * @return bool true if successful, false otherwise
+ */
+bool question_order_measure(const DicotomicTree *tree, KeyShape *shape);
+
+/**
+ * @brief Find a question order that identifies species sooner
+ *
+ * Questions are chosen greedily: each one is the question that tells apart
+ * the most pairs of species not told apart by the questions before it, with
+ * ties going to the one adding fewer directories. A question is only chosen
+ * when every species sharing a directory with one that answers it answers it
+ * too, or answers nothing else, so every directory keeps asking a single
+ * question. Once no such question tells any pair apart the rest keep their
+ * current order. Candidate questions are scored on several threads.
+ *
+ * @param tree The tree
+ * @param num_threads The number of threads, 0 for one per processor
+ * @param order Array of tree->num_questions to store the old id of each question, by new id
+ * @return bool true if successful, false otherwise
+ */
+bool question_order_optimize(const DicotomicTree *tree, int num_threads, QuestionId *order);
+
+#endif /* QUESTION_ORDER_H */
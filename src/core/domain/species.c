@@ -1,140 +1,147 @@
 #include "species.h"
-#include "../../../include/common/utils.h"
 #include "../../../include/common/logger.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-Species *species_create(const char *name)
+size_t species_find_misplaced_question(
+    const Species *species,
+    const QuestionAnswer *characteristics,
+    size_t num_questions)
 {
-    Species *species = malloc(sizeof(Species));
-    if (!species)
-    {
-        logger_error("Failed to allocate memory for species");
-        return NULL;
-    }
+    const QuestionAnswer *own = characteristics + species->first_characteristic;
+    size_t i = 0;
 
-    species->name = my_strdup(name);
-    if (!species->name)
+    while (i < species->num_characteristics &&
+           own[i].question == i &&
+           i < num_questions)
     {
-        logger_error("Failed to allocate memory for species name");
-        free(species);
-        return NULL;
+        i++;
     }
 
-    species->characteristics = NULL;
-    species->num_characteristics = 0;
-
-    return species;
+    return i;
 }
 
-bool species_add_characteristic(Species *species, const char *question, bool answer)
+bool species_follows_question_order(
+    const Species *species,
+    const QuestionAnswer *characteristics,
+    const char **questions,
+    size_t num_questions)
 {
-    if (!species || !question)
+    if (!species || !characteristics || !questions || num_questions == 0)
     {
-        logger_error("Invalid species or question");
+        logger_error("Invalid parameters for species_follows_question_order");
         return false;
     }
 
-    // Resize characteristics array
-    QuestionAnswer *new_characteristics = realloc(
-        species->characteristics,
-        (species->num_characteristics + 1) * sizeof(QuestionAnswer));
-
-    if (!new_characteristics)
+    size_t i = species_find_misplaced_question(species, characteristics, num_questions);
+    if (i == species->num_characteristics)
     {
-        logger_error("Failed to resize characteristics array");
-        return false;
+        return true;
     }
 
-    species->characteristics = new_characteristics;
+    size_t id = characteristics[species->first_characteristic + i].question;
 
-    // Add new characteristic
-    QuestionAnswer *characteristic = &species->characteristics[species->num_characteristics];
-    characteristic->question = my_strdup(question);
-    if (!characteristic->question)
+    if (id < i || id >= num_questions)
     {
-        logger_error("Failed to allocate memory for question");
-        return false;
+        // Question not found among the questions still expected
+        logger_warning(
+            "Question '%s' for species '%s' not found in expected questions",
+            (id < num_questions) ? questions[id] : "", species->name);
+    }
+    else
+    {
+        // Question found but out of order
+        logger_warning(
+            "Question '%s' for species '%s' is out of order (expected at position %zu, found at %zu)",
+            questions[id], species->name, i, id);
     }
 
-    characteristic->answer = answer;
-    species->num_characteristics++;
-
-    return true;
+    return false;
 }
 
-void species_free(Species *species)
+static int compare_positioned_characteristics(const void *a, const void *b)
 {
-    if (!species)
+    const PositionedCharacteristic *first = a;
+    const PositionedCharacteristic *second = b;
+
+    if (first->characteristic.question != second->characteristic.question)
     {
-        return;
+        return first->characteristic.question < second->characteristic.question ? -1 : 1;
     }
+    return first->position < second->position ? -1 : (first->position > second->position);
+}
 
-    // Free name
-    free(species->name);
-
-    // Free characteristics
-    for (int i = 0; i < species->num_characteristics; i++)
+void species_sort_positioned(PositionedCharacteristic *characteristics, size_t count)
+{
+    if (count > 1)
     {
-        free(species->characteristics[i].question);
+        qsort(characteristics, count, sizeof(PositionedCharacteristic), compare_positioned_characteristics);
     }
-    free(species->characteristics);
-
-    // Free species
-    free(species);
 }
 
-bool species_follows_question_order(
+bool species_path(
     const Species *species,
-    const char **expected_questions,
-    int num_expected_questions)
+    const QuestionAnswer *characteristics,
+    size_t num_questions,
+    const QuestionAnswer **path,
+    size_t *count,
+    QuestionAnswer **sorted)
 {
-    if (!species || !expected_questions || num_expected_questions <= 0)
+    const QuestionAnswer *own = characteristics + species->first_characteristic;
+    size_t num_characteristics = species->num_characteristics;
+
+    *path = own;
+    *count = num_characteristics;
+    *sorted = NULL;
+
+    size_t i = 0;
+    while (i < num_characteristics &&
+           own[i].question < num_questions &&
+           (i == 0 || own[i].question > own[i - 1].question))
     {
-        logger_error("Invalid parameters for species_follows_question_order");
-        return false;
+        i++;
     }
 
-    // Check that each characteristic follows the expected order
-    int expected_index = 0;
+    if (i == num_characteristics)
+    {
+        return true;
+    }
 
-    for (int i = 0; i < species->num_characteristics; i++)
+    // Only the characteristics of the species are sorted, whatever the number of questions
+    PositionedCharacteristic *positioned = malloc(num_characteristics * sizeof(PositionedCharacteristic));
+    *sorted = malloc(num_characteristics * sizeof(QuestionAnswer));
+    if (!positioned || !*sorted)
     {
-        const char *question = species->characteristics[i].question;
-        bool found = false;
+        free(positioned);
+        free(*sorted);
+        *sorted = NULL;
+        return false;
+    }
 
-        // Find the question in the expected questions
-        for (int j = expected_index; j < num_expected_questions; j++)
+    size_t num_known = 0;
+    for (i = 0; i < num_characteristics; i++)
+    {
+        if (own[i].question < num_questions)
         {
-            if (strcmp(question, expected_questions[j]) == 0)
-            {
-                // Question found at position j
-                if (j != expected_index)
-                {
-                    // Question found but out of order
-                    logger_warning(
-                        "Question '%s' for species '%s' is out of order (expected at position %d, found at %d)",
-                        question, species->name, expected_index, j);
-                    return false;
-                }
-
-                found = true;
-                expected_index++;
-                break;
-            }
+            positioned[num_known].characteristic = own[i];
+            positioned[num_known++].position = i;
         }
+    }
+    species_sort_positioned(positioned, num_known);
 
-        if (!found)
+    // The first answer to a repeated question sorts first and is the one kept
+    *count = 0;
+    for (i = 0; i < num_known; i++)
+    {
+        if (*count == 0 || positioned[i].characteristic.question != (*sorted)[*count - 1].question)
         {
-            // Question not found in expected questions
-            logger_warning(
-                "Question '%s' for species '%s' not found in expected questions",
-                question, species->name);
-            return false;
+            (*sorted)[(*count)++] = positioned[i].characteristic;
         }
     }
 
+    free(positioned);
+    *path = *sorted;
     return true;
-}
\ No newline at end of file
+}
@@ -2,59 +2,112 @@
 #define SPECIES_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Dense id of a question interned in a dicotomic tree
+ */
+typedef uint32_t QuestionId;
+
+#define QUESTION_ID_MAX UINT32_MAX
 
 /**
  * @brief Represents a question-answer pair
  */
 typedef struct
 {
-    char *question;
+    QuestionId question;
     bool answer;
 } QuestionAnswer;
 
+/**
+ * @brief A characteristic with its position in its species, to sort stably
+ */
+typedef struct
+{
+    QuestionAnswer characteristic;
+    size_t position;
+} PositionedCharacteristic;
+
 /**
  * @brief Represents a species with its characteristics
+ *
+ * Species are records stored one after another in their tree, and their
+ * characteristics are a run of the flat characteristics array of the tree.
  */
 typedef struct
 {
     char *name;
-    QuestionAnswer *characteristics;
-    int num_characteristics;
+    size_t first_characteristic;
+    size_t num_characteristics;
 } Species;
 
 /**
- * @brief Create a new species
+ * @brief Find the first characteristic that breaks the expected question order
+ *
+ * Characteristics must be the first questions of the tree, in order, so each
+ * id is compared with its position. Nothing is logged.
  *
- * @param name The name of the species
- * @return Species* The created species or NULL if memory allocation failed
+ * @param species The species to check
+ * @param characteristics The characteristics of the tree of the species
+ * @param num_questions The number of questions of the tree
+ * @return size_t The position of the first misplaced characteristic, or
+ *         num_characteristics if the species follows the order
  */
-Species *species_create(const char *name);
+size_t species_find_misplaced_question(
+    const Species *species,
+    const QuestionAnswer *characteristics,
+    size_t num_questions);
 
 /**
- * @brief Add a characteristic to a species
+ * @brief Check if the species follows the expected question order
  *
- * @param species The species
- * @param question The question
- * @param answer The answer
- * @return bool true if successful, false otherwise
+ * Its characteristics must be the first questions of the tree, in order.
+ *
+ * @param species The species to check
+ * @param characteristics The characteristics of the tree of the species
+ * @param questions The questions of the tree, indexed by id
+ * @param num_questions The number of questions
+ * @return bool true if the species follows the expected order, false otherwise
  */
-bool species_add_characteristic(Species *species, const char *question, bool answer);
+bool species_follows_question_order(
+    const Species *species,
+    const QuestionAnswer *characteristics,
+    const char **questions,
+    size_t num_questions);
 
 /**
- * @brief Free the memory allocated for a species
+ * @brief Sort characteristics by question id, keeping their positions in order among equal ids
  *
- * @param species The species to free
+ * @param characteristics The characteristics
+ * @param count The number of characteristics
  */
-void species_free(Species *species);
+void species_sort_positioned(PositionedCharacteristic *characteristics, size_t count);
 
 /**
- * @brief Check if the species follows the expected question order
+ * @brief Get the path of a species: its characteristics ordered by question id
  *
- * @param species The species to check
- * @param expected_questions The expected questions in order
- * @param num_expected_questions The number of expected questions
- * @return bool true if the species follows the expected order, false otherwise
+ * Species that follow the question order of their tree already list their
+ * answers by increasing id and are used as they are. Otherwise a question
+ * repeated in the species keeps its first answer, questions the tree does
+ * not know are dropped, and the path is an ordered copy, made by sorting
+ * the characteristics of the species alone.
+ *
+ * @param species The species
+ * @param characteristics The characteristics of the tree of the species
+ * @param num_questions The number of questions of the tree
+ * @param path Pointer to store the characteristics of the path
+ * @param count Pointer to store the number of characteristics in the path
+ * @param sorted Pointer to store the ordered copy, freed by the caller, or NULL when none was needed
+ * @return bool true if successful, false if memory allocation failed
  */
-bool species_follows_question_order(const Species *species, const char **expected_questions, int num_expected_questions);
+bool species_path(
+    const Species *species,
+    const QuestionAnswer *characteristics,
+    size_t num_questions,
+    const QuestionAnswer **path,
+    size_t *count,
+    QuestionAnswer **sorted);
 
-#endif /* SPECIES_H */
\ No newline at end of file
+#endif /* SPECIES_H */
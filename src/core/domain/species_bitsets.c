@@ -0,0 +1,123 @@
+#include "species_bitsets.h"
+#include "../../../include/common/logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+SpeciesBitsets *species_bitsets_build(const DicotomicTree *tree)
+{
+    if (!tree)
+    {
+        logger_error("Invalid tree");
+        return NULL;
+    }
+
+    SpeciesBitsets *bitsets = malloc(sizeof(SpeciesBitsets));
+    if (!bitsets)
+    {
+        logger_error("Failed to allocate memory for species bitsets");
+        return NULL;
+    }
+
+    bitsets->num_species = tree->num_species;
+    bitsets->num_questions = tree->num_questions;
+    bitsets->num_words = (tree->num_species + 63) / 64;
+
+    size_t num_words = bitsets->num_words ? bitsets->num_words : 1;
+    size_t num_questions = tree->num_questions ? tree->num_questions : 1;
+    bool fits = num_questions <= SIZE_MAX / sizeof(uint64_t) / num_words;
+
+    bitsets->asked = fits ? calloc(num_questions * num_words, sizeof(uint64_t)) : NULL;
+    bitsets->answers = fits ? calloc(num_questions * num_words, sizeof(uint64_t)) : NULL;
+    if (!bitsets->asked || !bitsets->answers)
+    {
+        logger_error("Failed to allocate memory for species bitsets");
+        species_bitsets_free(bitsets);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < tree->num_species; i++)
+    {
+        const Species *species = &tree->species[i];
+        const QuestionAnswer *characteristics = tree->characteristics + species->first_characteristic;
+        size_t word = i / 64;
+        uint64_t bit = (uint64_t)1 << (i % 64);
+
+        for (size_t j = 0; j < species->num_characteristics; j++)
+        {
+            QuestionId id = characteristics[j].question;
+            size_t offset = (size_t)id * bitsets->num_words + word;
+
+            if (id >= tree->num_questions || (bitsets->asked[offset] & bit))
+            {
+                continue;
+            }
+
+            bitsets->asked[offset] |= bit;
+            if (characteristics[j].answer)
+            {
+                bitsets->answers[offset] |= bit;
+            }
+        }
+    }
+
+    return bitsets;
+}
+
+size_t species_bitsets_match(
+    const SpeciesBitsets *bitsets,
+    const QuestionAnswer *answers,
+    size_t num_answers,
+    uint64_t *candidates)
+{
+    size_t num_words = bitsets->num_words;
+
+    for (size_t w = 0; w < num_words; w++)
+    {
+        candidates[w] = ~(uint64_t)0;
+    }
+    if (bitsets->num_species % 64 != 0)
+    {
+        candidates[num_words - 1] = ((uint64_t)1 << (bitsets->num_species % 64)) - 1;
+    }
+
+    // Whole words per answer, a loop the compiler turns into vector instructions
+    for (size_t i = 0; i < num_answers; i++)
+    {
+        if (answers[i].question >= bitsets->num_questions)
+        {
+            continue;
+        }
+
+        const uint64_t *asked = bitsets->asked + (size_t)answers[i].question * num_words;
+        const uint64_t *answered = bitsets->answers + (size_t)answers[i].question * num_words;
+        uint64_t flip = answers[i].answer ? ~(uint64_t)0 : 0;
+
+        // A species is ruled out when it asks the question and its answer differs
+        for (size_t w = 0; w < num_words; w++)
+        {
+            candidates[w] &= ~(asked[w] & (answered[w] ^ flip));
+        }
+    }
+
+    size_t count = 0;
+    for (size_t w = 0; w < num_words; w++)
+    {
+        count += (size_t)__builtin_popcountll(candidates[w]);
+    }
+
+    return count;
+}
+
+void species_bitsets_free(SpeciesBitsets *bitsets)
+{
+    if (!bitsets)
+    {
+        return;
+    }
+
+    free(bitsets->asked);
+    free(bitsets->answers);
+    free(bitsets);
+}
@@ -0,0 +1,62 @@
+#ifndef SPECIES_BITSETS_H
+#define SPECIES_BITSETS_H
+
+#include "dicotomic_tree.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The answers of every species of a tree as bitsets, for candidate queries
+ *
+ * Each species has an "asked" mask, the questions it answers, and an
+ * "answer" mask, the ones it answers true. They are stored transposed: for
+ * each question, one bit per species, so a query only reads the questions it
+ * answers and handles 64 species per word.
+ */
+typedef struct
+{
+    size_t num_species;
+    size_t num_questions;
+    size_t num_words;   // Words of a bitset over the species
+    uint64_t *asked;    // num_words words per question, bit set when the species answers it
+    uint64_t *answers;  // num_words words per question, bit set when the species answers it true
+} SpeciesBitsets;
+
+/**
+ * @brief Build the bitsets of the species of a tree
+ *
+ * A question repeated in a species keeps its first answer, as in its path.
+ *
+ * @param tree The tree
+ * @return SpeciesBitsets* The bitsets or NULL if memory allocation failed
+ */
+SpeciesBitsets *species_bitsets_build(const DicotomicTree *tree);
+
+/**
+ * @brief Find the species still possible given some answers
+ *
+ * A species is a candidate unless it answers one of the questions
+ * differently. Questions the tree does not know rule out nothing.
+ *
+ * @param bitsets The bitsets of the tree
+ * @param answers The answers known so far
+ * @param num_answers The number of answers
+ * @param candidates Bitset of num_words words to store the candidate species
+ * @return size_t The number of candidate species
+ */
+size_t species_bitsets_match(
+    const SpeciesBitsets *bitsets,
+    const QuestionAnswer *answers,
+    size_t num_answers,
+    uint64_t *candidates);
+
+/**
+ * @brief Free the memory allocated for species bitsets
+ *
+ * @param bitsets The bitsets to free
+ */
+void species_bitsets_free(SpeciesBitsets *bitsets);
+
+#endif /* SPECIES_BITSETS_H */
@@ -0,0 +1,73 @@
+#include "trigrams.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool is_word_byte(unsigned char c)
+{
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static unsigned char normalize(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static int compare_trigrams(const void *a, const void *b)
+{
+    Trigram first = *(const Trigram *)a;
+    Trigram second = *(const Trigram *)b;
+
+    return first < second ? -1 : (first > second);
+}
+
+size_t trigrams_capacity(const char *text)
+{
+    // A word of n bytes has n + 1 trigrams, and words take at least one byte
+    return 2 * strlen(text) + 1;
+}
+
+size_t trigrams_extract(const char *text, Trigram *trigrams)
+{
+    size_t count = 0;
+    const unsigned char *c = (const unsigned char *)text;
+
+    while (*c)
+    {
+        if (!is_word_byte(*c))
+        {
+            c++;
+            continue;
+        }
+
+        // The window starts on the two spaces padding the word
+        Trigram window = ((Trigram)' ' << 8) | ' ';
+        for (; is_word_byte(*c); c++)
+        {
+            window = ((window << 8) | normalize(*c)) & 0xffffffu;
+            trigrams[count++] = window;
+        }
+        trigrams[count++] = ((window << 8) | ' ') & 0xffffffu;
+    }
+
+    qsort(trigrams, count, sizeof(Trigram), compare_trigrams);
+
+    size_t distinct = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (distinct == 0 || trigrams[distinct - 1] != trigrams[i])
+        {
+            trigrams[distinct++] = trigrams[i];
+        }
+    }
+
+    return distinct;
+}
+
+double trigrams_similarity(size_t shared, size_t first, size_t second)
+{
+    size_t all = first + second - shared;
+
+    return all > 0 ? (double)shared / (double)all : 0.0;
+}
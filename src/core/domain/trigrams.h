@@ -0,0 +1,45 @@
+#ifndef TRIGRAMS_H
+#define TRIGRAMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Three bytes of a normalized text, packed as first << 16 | second << 8 | third
+ */
+typedef uint32_t Trigram;
+
+/**
+ * @brief Get the most trigrams a text can have
+ *
+ * @param text The text
+ * @return size_t The size of the array to give trigrams_extract
+ */
+size_t trigrams_capacity(const char *text);
+
+/**
+ * @brief Get the distinct trigrams of a text, sorted
+ *
+ * ASCII letters are lowercased and any other ASCII byte that is not a digit
+ * separates words, so "Roble-blanco" and "roble blanco" are alike. Each word
+ * is padded with two spaces before and one after, which gives its start more
+ * weight than its end. Other bytes, UTF-8 sequences included, are compared
+ * as they are.
+ *
+ * @param text The text
+ * @param trigrams Array of trigrams_capacity(text) trigrams to store them
+ * @return size_t The number of distinct trigrams
+ */
+size_t trigrams_extract(const char *text, Trigram *trigrams);
+
+/**
+ * @brief Get the similarity of two texts from their trigrams
+ *
+ * @param shared The number of trigrams the texts share
+ * @param first The number of trigrams of the first text
+ * @param second The number of trigrams of the second text
+ * @return double The shared trigrams over all trigrams of either text, from 0 to 1
+ */
+double trigrams_similarity(size_t shared, size_t first, size_t second);
+
+#endif /* TRIGRAMS_H */
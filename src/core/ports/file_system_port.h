@@ -2,15 +2,34 @@
 #define FILE_SYSTEM_PORT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "../../../include/common/types.h"
 
+/**
+ * @brief A directory or file to create in an open directory
+ */
+typedef struct
+{
+    int parent;         // The handle of the open directory
+    const char *name;   // The name of the entry, or a path relative to parent
+    bool is_directory;  // Whether the entry is a directory rather than a file
+} FileSystemEntry;
+
 /**
  * @brief Interface for file system operations
+ *
+ * Besides paths, an implementation may work relative to open directories,
+ * given as handles it defines. Those operations resolve a single name, so
+ * their cost does not grow with depth and paths are never longer than a
+ * name. They are NULL in implementations that only take paths.
+ *
+ * An implementation may also create many independent entries at once, so
+ * they are issued together instead of one system call after another.
  */
 typedef struct
 {
     /**
-     * @brief Create a directory
+     * @brief Create a directory, succeeding if it exists
      *
      * @param path The path of the directory to create
      * @return StatusCode SUCCESS if successful, an error code otherwise
@@ -18,7 +37,7 @@ typedef struct
     StatusCode (*create_directory)(const char *path);
 
     /**
-     * @brief Create an empty file
+     * @brief Create an empty file, keeping it if it exists
      *
      * @param path The path of the file to create
      * @return StatusCode SUCCESS if successful, an error code otherwise
@@ -40,6 +59,54 @@ typedef struct
      * @return bool true if the file exists, false otherwise
      */
     bool (*file_exists)(const char *path);
+
+    /**
+     * @brief Open a directory to create entries in it
+     *
+     * @param path The path of the directory
+     * @param directory Pointer to store the handle of the directory
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*open_directory)(const char *path, int *directory);
+
+    /**
+     * @brief Create a directory in an open directory, succeeding if it exists
+     *
+     * @param parent The handle of the parent directory
+     * @param name The name of the directory, or a path relative to parent
+     * @param directory Pointer to store the handle of the new directory, NULL to leave it closed
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*create_directory_at)(int parent, const char *name, int *directory);
+
+    /**
+     * @brief Create a file in an open directory, keeping it if it exists
+     *
+     * @param parent The handle of the directory
+     * @param name The name of the file, or a path relative to the directory
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*create_file_at)(int parent, const char *name);
+
+    /**
+     * @brief Close a directory opened by open_directory or create_directory_at
+     *
+     * @param directory The handle of the directory
+     */
+    void (*close_directory)(int directory);
+
+    /**
+     * @brief Create entries in open directories, in no particular order
+     *
+     * Directories that exist and files that exist are kept, as with
+     * create_directory_at and create_file_at. No entry may be inside another
+     * of the same call. NULL in implementations that create one at a time.
+     *
+     * @param entries The entries
+     * @param num_entries The number of entries
+     * @return StatusCode SUCCESS if every entry was created, an error code otherwise
+     */
+    StatusCode (*create_entries_at)(const FileSystemEntry *entries, size_t num_entries);
 } FileSystemPort;
 
 #endif /* FILE_SYSTEM_PORT_H */
\ No newline at end of file
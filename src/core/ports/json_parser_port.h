@@ -4,18 +4,75 @@
 #include "../domain/dicotomic_tree.h"
 #include "../../../include/common/types.h"
 
+/**
+ * @brief Callbacks invoked while a key is streamed
+ *
+ * Strings passed to a callback are only valid during that call. Returning
+ * anything other than SUCCESS stops the parse and is returned to the caller.
+ * Unset callbacks are skipped.
+ */
+typedef struct
+{
+    StatusCode (*on_tree_start)(void *context, const char *tree_name);
+    StatusCode (*on_species_start)(void *context, const char *species_name);
+    StatusCode (*on_characteristic)(void *context, const char *question, bool answer);
+    StatusCode (*on_species_end)(void *context);
+    StatusCode (*on_tree_end)(void *context);
+} JsonParserCallbacks;
+
 /**
  * @brief Interface for JSON parsing operations
  */
 typedef struct
 {
     /**
-     * @brief Parse a JSON file into a dicotomic tree
+     * @brief Parse a JSON file holding a single tree into a dicotomic tree
      *
      * @param file_path The path of the JSON file
      * @return DicotomicTree* The parsed tree or NULL if parsing failed
      */
     DicotomicTree *(*parse_file)(const char *file_path);
+
+    /**
+     * @brief Parse a JSON file into a dicotomic tree using several threads
+     *
+     * The species are split into chunks parsed at the same time; the tree is
+     * the same one parse_file returns.
+     *
+     * @param file_path The path of the JSON file
+     * @param num_threads The number of threads, 0 for one per processor
+     * @return DicotomicTree* The parsed tree or NULL if parsing failed
+     */
+    DicotomicTree *(*parse_file_parallel)(const char *file_path, int num_threads);
+
+    /**
+     * @brief Parse every tree of a JSON file
+     *
+     * A key may hold several trees, one per member of its top-level object.
+     * Trees are returned in key order and may share the buffer they borrow
+     * strings from; each one is freed on its own with dicotomic_tree_free.
+     *
+     * @param file_path The path of the JSON file
+     * @param num_threads The number of threads, 0 for one per processor
+     * @param trees Pointer to store the array of trees, freed by the caller
+     * @param num_trees Pointer to store the number of trees
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*parse_file_trees)(const char *file_path, int num_threads, DicotomicTree ***trees, int *num_trees);
+
+    /**
+     * @brief Parse a JSON key incrementally, reporting each element as it is read
+     *
+     * Only a window of the input is kept in memory, so pipes and keys larger
+     * than memory can be consumed. Each tree of the key is reported between
+     * on_tree_start and on_tree_end.
+     *
+     * @param file_path The path of the JSON file, or "-" for standard input
+     * @param callbacks The callbacks to invoke
+     * @param context Opaque pointer passed to every callback
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*parse_stream)(const char *file_path, const JsonParserCallbacks *callbacks, void *context);
 } JsonParserPort;
 
-#endif /* JSON_PARSER_PORT_H */
\ No newline at end of file
+#endif /* JSON_PARSER_PORT_H */
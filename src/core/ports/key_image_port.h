@@ -0,0 +1,59 @@
+#ifndef KEY_IMAGE_PORT_H
+#define KEY_IMAGE_PORT_H
+
+#include "../domain/dicotomic_tree.h"
+#include "../../../include/common/types.h"
+
+/**
+ * @brief Interface for compiled keys
+ *
+ * An image holds a parsed tree ready to be mapped: its strings, its questions
+ * and the answers of every species by question id. Loading one does not parse
+ * anything.
+ */
+typedef struct
+{
+    /**
+     * @brief Check if a file is a key image
+     *
+     * @param path The path of the file
+     * @return bool true if the file starts like a key image, false otherwise
+     */
+    bool (*is_image)(const char *path);
+
+    /**
+     * @brief Write a tree as a key image
+     *
+     * @param tree The tree
+     * @param image_path The path of the image
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*save)(const DicotomicTree *tree, const char *image_path);
+
+    /**
+     * @brief Load a key image into a dicotomic tree
+     *
+     * @param image_path The path of the image
+     * @return DicotomicTree* The tree or NULL if the image is invalid
+     */
+    DicotomicTree *(*load)(const char *image_path);
+
+    /**
+     * @brief Load the image cached next to a key if it is up to date
+     *
+     * @param key_path The path of the JSON key
+     * @return DicotomicTree* The tree or NULL if there is no usable image
+     */
+    DicotomicTree *(*load_cached)(const char *key_path);
+
+    /**
+     * @brief Cache a tree next to the key it was parsed from
+     *
+     * @param tree The tree parsed from the key
+     * @param key_path The path of the JSON key
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*save_cached)(const DicotomicTree *tree, const char *key_path);
+} KeyImagePort;
+
+#endif /* KEY_IMAGE_PORT_H */
@@ -0,0 +1,64 @@
+#ifndef OBSERVATION_PARSER_PORT_H
+#define OBSERVATION_PARSER_PORT_H
+
+#include "../../../include/common/types.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Called for each answer of an observation
+ *
+ * The question is only valid during the call. Returning anything other than
+ * SUCCESS stops the parse of the observation.
+ *
+ * @param context The context given to parse_record
+ * @param question The question answered
+ * @param answer The answer
+ * @return StatusCode SUCCESS to go on, an error code otherwise
+ */
+typedef StatusCode (*ObservationAnswerCallback)(void *context, const char *question, bool answer);
+
+/**
+ * @brief Interface for parsing field observations, one per line
+ *
+ * An observation is a set of answers to questions of a key. Records are
+ * parsed independently of each other, so several threads may parse records
+ * of the same stream at once.
+ */
+typedef struct
+{
+    /**
+     * @brief Read the header of an observation stream
+     *
+     * Formats that name their fields once, like CSV, keep the names in the
+     * state that records are parsed with.
+     *
+     * @param line The first line of the stream, without its line break
+     * @param state Pointer to store the state, NULL when the format needs none
+     * @param consumed Pointer to store whether the line was a header rather than a record
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*read_header)(const char *line, void **state, bool *consumed);
+
+    /**
+     * @brief Parse one observation, reporting each of its answers
+     *
+     * Strings are unescaped in place, so the line is modified.
+     *
+     * @param state The state returned by read_header
+     * @param line The line of the observation, without its line break
+     * @param on_answer The callback invoked for each answer
+     * @param context Opaque pointer passed to the callback
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*parse_record)(const void *state, char *line, ObservationAnswerCallback on_answer, void *context);
+
+    /**
+     * @brief Free the state returned by read_header, unset when the format needs none
+     *
+     * @param state The state, may be NULL
+     */
+    void (*free_state)(void *state);
+} ObservationParserPort;
+
+#endif /* OBSERVATION_PARSER_PORT_H */
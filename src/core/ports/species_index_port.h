@@ -0,0 +1,97 @@
+#ifndef SPECIES_INDEX_PORT_H
+#define SPECIES_INDEX_PORT_H
+
+#include "../../../include/common/types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief A species name and the path of its file
+ */
+typedef struct
+{
+    const char *name;
+    const char *path;
+} SpeciesIndexEntry;
+
+/**
+ * @brief Called with each path found for a name
+ *
+ * @param context The context given to the lookup
+ * @param path The path
+ */
+typedef void (*SpeciesIndexMatch)(void *context, const char *path);
+
+/**
+ * @brief Called with each path of a name similar to the one searched
+ *
+ * @param context The context given to the search
+ * @param name The name found
+ * @param path A path of the name
+ * @param similarity The similarity of the name to the one searched, from 0 to 1
+ */
+typedef void (*SpeciesIndexFound)(void *context, const char *name, const char *path, double similarity);
+
+/**
+ * @brief Interface for indexes of species names
+ *
+ * An index maps every species name to the paths of its files, so a name is
+ * found without reading the key or the directory tree.
+ */
+typedef struct
+{
+    /**
+     * @brief Write an index of species
+     *
+     * @param entries The species, a name may appear several times
+     * @param num_entries The number of species
+     * @param with_trigrams Whether to store the trigrams of the names, needed to search them
+     * @param index_path The path of the index
+     * @return StatusCode SUCCESS if successful, an error code otherwise
+     */
+    StatusCode (*save)(const SpeciesIndexEntry *entries, size_t num_entries, bool with_trigrams, const char *index_path);
+
+    /**
+     * @brief Find the paths of a species name in an index
+     *
+     * @param index_path The path of the index
+     * @param name The species name
+     * @param on_match Called with each path of the name, in the order they were saved
+     * @param context The context given to on_match
+     * @param num_matches Pointer to store the number of paths found
+     * @return StatusCode SUCCESS if the index could be read, an error code otherwise
+     */
+    StatusCode (*lookup)(
+        const char *index_path,
+        const char *name,
+        SpeciesIndexMatch on_match,
+        void *context,
+        size_t *num_matches);
+
+    /**
+     * @brief Find the names most similar to a text in an index saved with trigrams
+     *
+     * Names are ranked by the trigrams they share with the text, the most
+     * similar first and alike ones by name.
+     *
+     * @param index_path The path of the index
+     * @param text The text, usually a misspelled name
+     * @param min_similarity The similarity below which names are left out
+     * @param max_names The most names to report
+     * @param on_found Called with each path of each name reported, in rank order
+     * @param context The context given to on_found
+     * @param num_found Pointer to store the number of names reported
+     * @return StatusCode SUCCESS if the index could be searched, an error code otherwise
+     */
+    StatusCode (*search)(
+        const char *index_path,
+        const char *text,
+        double min_similarity,
+        size_t max_names,
+        SpeciesIndexFound on_found,
+        void *context,
+        size_t *num_found);
+} SpeciesIndexPort;
+
+#endif /* SPECIES_INDEX_PORT_H */
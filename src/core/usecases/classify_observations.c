@@ -0,0 +1,468 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "classify_observations.h"
+#include "../domain/decision_trie.h"
+#include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+// Observations read before the threads classify them
+#define OBSERVATIONS_PER_BATCH 65536
+
+// Observations classified by a thread each time it takes work
+#define OBSERVATIONS_PER_CHUNK 1024
+
+/**
+ * @brief The decision trie of a tree with its species in depth-first order
+ */
+typedef struct
+{
+    const DicotomicTree *tree;
+    DecisionTrie *trie;
+    size_t *order;
+    size_t *first;
+    size_t *num_own;
+    size_t *num_below;
+} Classifier;
+
+static void classifier_free(Classifier *classifier)
+{
+    decision_trie_free(classifier->trie);
+    free(classifier->order);
+    free(classifier->first);
+    free(classifier->num_own);
+    free(classifier->num_below);
+}
+
+static StatusCode classifier_init(Classifier *classifier, const DicotomicTree *tree)
+{
+    classifier->tree = tree;
+    classifier->trie = decision_trie_build(tree);
+    classifier->order = NULL;
+    classifier->first = NULL;
+    classifier->num_own = NULL;
+    classifier->num_below = NULL;
+
+    if (!classifier->trie)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t num_nodes = classifier->trie->num_nodes;
+    classifier->order = malloc((tree->num_species ? tree->num_species : 1) * sizeof(size_t));
+    classifier->first = malloc(num_nodes * sizeof(size_t));
+    classifier->num_own = malloc(num_nodes * sizeof(size_t));
+    classifier->num_below = malloc(num_nodes * sizeof(size_t));
+
+    if (!classifier->order || !classifier->first || !classifier->num_own || !classifier->num_below)
+    {
+        classifier_free(classifier);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    decision_trie_order_species(
+        classifier->trie, classifier->order, classifier->first, classifier->num_own, classifier->num_below);
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Walk the trie following the answers of an observation
+ *
+ * @param classifier The classifier
+ * @param known The answer to each question: -1 when unanswered, 0 for false, 1 for true
+ * @param first Pointer to store where the candidates start in the order
+ * @param count Pointer to store the number of candidates
+ */
+static void classify(const Classifier *classifier, const signed char *known, size_t *first, size_t *count)
+{
+    const DecisionNode *nodes = classifier->trie->nodes;
+    size_t node = 0;
+    bool unanswered;
+
+    for (;;)
+    {
+        size_t next = DECISION_TRIE_NONE;
+        unanswered = false;
+
+        for (size_t child = nodes[node].first_child; child != DECISION_TRIE_NONE; child = nodes[child].next_sibling)
+        {
+            signed char answer = known[nodes[child].question];
+            if (answer < 0)
+            {
+                unanswered = true;
+            }
+            else if ((answer != 0) == nodes[child].answer)
+            {
+                next = child;
+                break;
+            }
+        }
+
+        if (next == DECISION_TRIE_NONE)
+        {
+            break;
+        }
+        node = next;
+    }
+
+    *first = classifier->first[node];
+    *count = unanswered ? classifier->num_below[node] : classifier->num_own[node];
+}
+
+/**
+ * @brief The answers of the observation being classified
+ */
+typedef struct
+{
+    const DicotomicTree *tree;
+    signed char *known;
+    QuestionId *answered; // Questions set in known, to reset them afterwards
+    size_t num_answered;
+} Observation;
+
+static StatusCode observation_on_answer(void *context, const char *question, bool answer)
+{
+    Observation *observation = context;
+    QuestionId id;
+
+    // Questions the key does not ask identify nothing, and the first answer
+    // to a question wins as it does in species
+    if (dicotomic_tree_find_question(observation->tree, question, &id) && observation->known[id] < 0)
+    {
+        observation->known[id] = answer ? 1 : 0;
+        observation->answered[observation->num_answered++] = id;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Text written for a chunk of observations
+ */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} OutputBuffer;
+
+static bool output_append(OutputBuffer *output, const char *text, size_t length)
+{
+    if (output->length + length > output->capacity)
+    {
+        size_t capacity = output->capacity ? output->capacity : 4096;
+        while (capacity < output->length + length)
+        {
+            capacity *= 2;
+        }
+
+        char *data = realloc(output->data, capacity);
+        if (!data)
+        {
+            return false;
+        }
+        output->data = data;
+        output->capacity = capacity;
+    }
+
+    memcpy(output->data + output->length, text, length);
+    output->length += length;
+    return true;
+}
+
+/**
+ * @brief Observations read from the stream, classified together
+ */
+typedef struct
+{
+    char *text;             // The lines, each one terminated
+    size_t text_size;
+    size_t text_capacity;
+    size_t *offsets;        // Where each line starts in text
+    size_t *line_numbers;   // The line of the stream each observation comes from
+    size_t num_lines;
+} ObservationBatch;
+
+/**
+ * @brief Work shared by the threads classifying a batch
+ */
+typedef struct
+{
+    const Classifier *classifier;
+    const ObservationParserPort *parser;
+    const void *parser_state;
+    ObservationBatch *batch;
+    OutputBuffer *outputs; // One per chunk of the batch
+    StatusCode error;
+} BatchClassification;
+
+static void classify_chunk_task(void *context, size_t index)
+{
+    BatchClassification *classification = context;
+    const Classifier *classifier = classification->classifier;
+    const DicotomicTree *tree = classifier->tree;
+    ObservationBatch *batch = classification->batch;
+    OutputBuffer *output = &classification->outputs[index];
+
+    size_t begin = index * OBSERVATIONS_PER_CHUNK;
+    size_t end = begin + OBSERVATIONS_PER_CHUNK < batch->num_lines ? begin + OBSERVATIONS_PER_CHUNK : batch->num_lines;
+    size_t num_questions = tree->num_questions ? tree->num_questions : 1;
+
+    Observation observation = {
+        .tree = tree,
+        .known = malloc(num_questions),
+        .answered = malloc(num_questions * sizeof(QuestionId)),
+        .num_answered = 0};
+
+    bool valid = observation.known && observation.answered;
+    if (valid)
+    {
+        memset(observation.known, -1, num_questions);
+    }
+
+    output->length = 0;
+    for (size_t i = begin; i < end && valid; i++)
+    {
+        size_t first = 0;
+        size_t count = 0;
+
+        StatusCode error = classification->parser->parse_record(
+            classification->parser_state, batch->text + batch->offsets[i], observation_on_answer, &observation);
+
+        if (error != SUCCESS)
+        {
+            logger_warning("Invalid observation at line %zu", batch->line_numbers[i]);
+        }
+        else
+        {
+            classify(classifier, observation.known, &first, &count);
+        }
+
+        for (size_t j = 0; j < observation.num_answered; j++)
+        {
+            observation.known[observation.answered[j]] = -1;
+        }
+        observation.num_answered = 0;
+
+        char number[32];
+        int length = sprintf(number, "%zu", count);
+        valid = output_append(output, number, (size_t)length);
+
+        for (size_t j = first; j < first + count && valid; j++)
+        {
+            const char *name = tree->species[classifier->order[j]].name;
+            valid = output_append(output, "\t", 1) && output_append(output, name, strlen(name));
+        }
+
+        valid = valid && output_append(output, "\n", 1);
+    }
+
+    free(observation.known);
+    free(observation.answered);
+
+    if (!valid)
+    {
+        StatusCode expected = SUCCESS;
+        __atomic_compare_exchange_n(
+            &classification->error, &expected, ERROR_MEMORY_ALLOCATION, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Add a line to a batch
+ *
+ * @param batch The batch
+ * @param line The line, without its line break
+ * @param length The length of the line
+ * @param line_number The line of the stream
+ * @return bool true if successful, false otherwise
+ */
+static bool batch_add_line(ObservationBatch *batch, const char *line, size_t length, size_t line_number)
+{
+    if (batch->text_size + length + 1 > batch->text_capacity)
+    {
+        size_t capacity = batch->text_capacity ? batch->text_capacity : 65536;
+        while (capacity < batch->text_size + length + 1)
+        {
+            capacity *= 2;
+        }
+
+        char *text = realloc(batch->text, capacity);
+        if (!text)
+        {
+            return false;
+        }
+        batch->text = text;
+        batch->text_capacity = capacity;
+    }
+
+    batch->offsets[batch->num_lines] = batch->text_size;
+    batch->line_numbers[batch->num_lines] = line_number;
+    batch->num_lines++;
+
+    memcpy(batch->text + batch->text_size, line, length);
+    batch->text[batch->text_size + length] = '\0';
+    batch->text_size += length + 1;
+
+    return true;
+}
+
+/**
+ * @brief Remove the line break of a line read with getline
+ *
+ * @param line The line
+ * @param length The length of the line
+ * @return size_t The length without the line break
+ */
+static size_t trim_line_break(char *line, size_t length)
+{
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+    {
+        length--;
+    }
+    line[length] = '\0';
+
+    return length;
+}
+
+StatusCode classify_observations(
+    const DicotomicTree *tree,
+    FILE *input,
+    FILE *output,
+    const ObservationParserPort *parser,
+    int num_threads)
+{
+    Classifier classifier;
+    StatusCode error = classifier_init(&classifier, tree);
+    if (error != SUCCESS)
+    {
+        return error;
+    }
+
+    size_t num_chunks = (OBSERVATIONS_PER_BATCH + OBSERVATIONS_PER_CHUNK - 1) / OBSERVATIONS_PER_CHUNK;
+    ObservationBatch batch = {
+        .text = NULL,
+        .text_size = 0,
+        .text_capacity = 0,
+        .offsets = malloc(OBSERVATIONS_PER_BATCH * sizeof(size_t)),
+        .line_numbers = malloc(OBSERVATIONS_PER_BATCH * sizeof(size_t)),
+        .num_lines = 0};
+    OutputBuffer *outputs = calloc(num_chunks, sizeof(OutputBuffer));
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_size;
+    size_t line_number = 0;
+    void *parser_state = NULL;
+    bool header_read = false;
+
+    if (!batch.offsets || !batch.line_numbers || !outputs)
+    {
+        error = ERROR_MEMORY_ALLOCATION;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = parallel_available_threads();
+    }
+
+    bool more = true;
+    while (error == SUCCESS && more)
+    {
+        // Read a batch, then classify it on the threads and write it in order
+        batch.text_size = 0;
+        batch.num_lines = 0;
+
+        while (batch.num_lines < OBSERVATIONS_PER_BATCH)
+        {
+            line_size = getline(&line, &line_capacity, input);
+            if (line_size < 0)
+            {
+                more = false;
+                break;
+            }
+            line_number++;
+
+            size_t length = trim_line_break(line, (size_t)line_size);
+            if (length == 0)
+            {
+                continue;
+            }
+
+            if (!header_read)
+            {
+                bool consumed;
+                header_read = true;
+                error = parser->read_header(line, &parser_state, &consumed);
+                if (error != SUCCESS)
+                {
+                    break;
+                }
+                if (consumed)
+                {
+                    continue;
+                }
+            }
+
+            if (!batch_add_line(&batch, line, length, line_number))
+            {
+                error = ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+        }
+
+        if (error != SUCCESS || batch.num_lines == 0)
+        {
+            break;
+        }
+
+        BatchClassification classification = {
+            .classifier = &classifier,
+            .parser = parser,
+            .parser_state = parser_state,
+            .batch = &batch,
+            .outputs = outputs,
+            .error = SUCCESS};
+
+        size_t batch_chunks = (batch.num_lines + OBSERVATIONS_PER_CHUNK - 1) / OBSERVATIONS_PER_CHUNK;
+        parallel_for(batch_chunks, num_threads, classify_chunk_task, &classification);
+        error = classification.error;
+
+        for (size_t i = 0; i < batch_chunks && error == SUCCESS; i++)
+        {
+            if (fwrite(outputs[i].data, 1, outputs[i].length, output) != outputs[i].length)
+            {
+                logger_error("Failed to write the classified observations");
+                error = ERROR_FILE_CREATION;
+            }
+        }
+    }
+
+    if (error == SUCCESS && ferror(input))
+    {
+        logger_error("Failed to read the observations");
+        error = ERROR_FILE_NOT_FOUND;
+    }
+
+    if (parser->free_state)
+    {
+        parser->free_state(parser_state);
+    }
+    for (size_t i = 0; outputs && i < num_chunks; i++)
+    {
+        free(outputs[i].data);
+    }
+    free(outputs);
+    free(batch.text);
+    free(batch.offsets);
+    free(batch.line_numbers);
+    free(line);
+    classifier_free(&classifier);
+
+    return error;
+}
@@ -0,0 +1,38 @@
+#ifndef CLASSIFY_OBSERVATIONS_H
+#define CLASSIFY_OBSERVATIONS_H
+
+#include "../domain/dicotomic_tree.h"
+#include "../ports/observation_parser_port.h"
+#include "../../../include/common/types.h"
+
+#include <stdio.h>
+
+/**
+ * @brief Identify the species of each observation of a stream
+ *
+ * Each observation walks the decision trie of the tree from its root,
+ * following the answers it gives. One line is written per observation, in
+ * input order: the number of candidate species, then their names, separated
+ * by tabs. A single candidate is the identified species. When the walk stops
+ * at a question the observation does not answer, the candidates are all the
+ * species below that point; otherwise they are the species ending there.
+ *
+ * Observations are read in batches and each batch is classified on several
+ * threads. Blank lines are skipped, and invalid observations are reported
+ * and get no candidates.
+ *
+ * @param tree The tree the observations are classified against
+ * @param input The stream of observations, one per line
+ * @param output The stream the candidates are written to
+ * @param parser The parser for the format of the observations
+ * @param num_threads The number of threads, 0 for one per processor
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode classify_observations(
+    const DicotomicTree *tree,
+    FILE *input,
+    FILE *output,
+    const ObservationParserPort *parser,
+    int num_threads);
+
+#endif /* CLASSIFY_OBSERVATIONS_H */
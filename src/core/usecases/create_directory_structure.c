@@ -1,6 +1,11 @@
 #include "create_directory_structure.h"
-#include "../../../include/common/utils.h"
+#include "create_species_directories.h"
+#include "create_species_from_tries.h"
+#include "create_species_stealing.h"
+#include "create_species_workers.h"
+#include "../domain/directory_set.h"
 #include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
 #include "../../infrastructure/process/process_manager.h"
 
 #include <stdio.h>
@@ -9,139 +14,180 @@
 #include <unistd.h>
 #include <sys/wait.h>
 
-// Helper function to create the path for a characteristic
-static char *create_characteristic_path(
-    const char *root_dir,
-    const char *question,
-    bool answer,
-    const char *true_text,
-    const char *false_text,
-    ConcatMode concat_mode)
+// Directories remembered while creating from a stream, whose size is unknown
+#define STREAM_DIRECTORIES (1 << 19)
+
+// Most directories remembered for whole trees; past it the rest are created
+// as if unknown, so the shared memory stays small for large keys
+#define MAX_REMEMBERED_DIRECTORIES (1 << 22)
+
+/**
+ * @brief Create the directories of a species in a child process
+ *
+ * Waits for a running child first when max_processes are already active.
+ *
+ * @param tree The tree of the species
+ * @param species The species
+ * @param tree_root_dir The directory of the tree
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation
+ * @param created The directories known to exist, in memory shared with the children
+ * @param max_processes The maximum number of children running at once
+ * @param active_processes The number of running children, updated
+ * @return StatusCode SUCCESS if the child was created, an error code otherwise
+ */
+static StatusCode spawn_species_process(
+    const DicotomicTree *tree,
+    const Species *species,
+    char *tree_root_dir,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created,
+    int max_processes,
+    int *active_processes)
 {
-    const char *text = answer ? true_text : false_text;
-    char *path = NULL;
+    // Wait if we've reached the maximum number of processes
+    if (*active_processes >= max_processes)
+    {
+        wait(NULL);
+        (*active_processes)--;
+    }
+
+    // Create a child process
+    pid_t pid = create_child_process();
 
-    switch (concat_mode)
+    if (pid == 0)
     {
-    case PREFIX_MODE:
-        path = malloc(strlen(root_dir) + strlen(text) + strlen(question) + 3);
-        if (path)
-        {
-            sprintf(path, "%s/%s %s", root_dir, text, question);
-        }
-        break;
-    case SUFFIX_MODE:
-        path = malloc(strlen(root_dir) + strlen(question) + strlen(text) + 3);
-        if (path)
-        {
-            sprintf(path, "%s/%s %s", root_dir, question, text);
-        }
-        break;
-    case BOTH_MODES:
-        path = malloc(strlen(root_dir) + strlen(text) + strlen(question) + strlen(text) + 4);
-        if (path)
-        {
-            sprintf(path, "%s/%s %s %s", root_dir, text, question, text);
-        }
-        break;
+        // Child process
+        StatusCode error = create_species_directories(
+            tree,
+            species,
+            tree_root_dir,
+            config,
+            file_system,
+            created);
+
+        free(tree_root_dir);
+        exit(error);
+    }
+    else if (pid > 0)
+    {
+        // Parent process
+        (*active_processes)++;
+        logger_info("Created process %d for species %s", pid, species->name);
+    }
+    else
+    {
+        // Error creating process
+        logger_error("Failed to create process for species %s", species->name);
+        return ERROR_MEMORY_ALLOCATION;
     }
 
-    return path;
+    return SUCCESS;
 }
 
-// Helper function to create directories for a species
-static StatusCode create_species_directories(
-    const Species *species,
-    const char *root_dir,
-    const char **questions,
-    int num_questions,
-    const DirectoryCreationConfig *config,
-    const FileSystemPort *file_system)
+/**
+ * @brief Allocate an empty set of directories known to exist
+ *
+ * The set is only a cache, so failing to allocate it is not an error:
+ * without it every directory is created, which succeeds if it exists.
+ *
+ * @param num_directories The number of directories the set should hold
+ * @param shared Whether the set is shared with child processes
+ * @return DirectorySet* The set or NULL if allocation failed
+ */
+static DirectorySet *create_directory_set(size_t num_directories, bool shared)
 {
-    char *current_path = my_strdup(root_dir);
+    size_t size = directory_set_size(num_directories);
+    void *memory = shared ? create_shared_memory(size) : calloc(1, size);
 
-    if (!current_path)
+    if (!memory)
     {
-        return ERROR_MEMORY_ALLOCATION;
+        logger_warning("Not enough memory to remember %zu directories, creating every one", num_directories);
+        return NULL;
     }
 
-    StatusCode error = SUCCESS;
+    return directory_set_init(memory, num_directories);
+}
 
-    // Create directories for each characteristic
-    for (int i = 0; i < num_questions; i++)
+static void free_directory_set(DirectorySet *set, bool shared)
+{
+    if (set && shared)
     {
-        const char *question = questions[i];
-
-        // Find the answer for this question
-        bool found = false;
-        bool answer = false;
+        free_shared_memory(set, sizeof(DirectorySet) + set->capacity * sizeof(uint64_t));
+    }
+    else
+    {
+        free(set);
+    }
+}
 
-        for (int j = 0; j < species->num_characteristics; j++)
-        {
-            if (strcmp(species->characteristics[j].question, question) == 0)
-            {
-                found = true;
-                answer = species->characteristics[j].answer;
-                break;
-            }
-        }
+/**
+ * @brief Create the directory structures of several trees
+ *
+ * @param trees The trees
+ * @param num_trees The number of trees
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode create_structures(
+    const DicotomicTree *const *trees,
+    int num_trees,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system)
+{
+    char **tree_root_dirs = calloc((size_t)num_trees, sizeof(char *));
+    if (!tree_root_dirs)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
 
-        if (!found)
-        {
-            // Skip questions that don't apply to this species
-            continue;
-        }
+    // Children or threads creating species share the directories known to
+    // exist, at most one per characteristic, while tries create each
+    // directory once and only the roots need remembering
+    bool shared = config->use_multiple_processes;
+    bool per_species = shared || config->use_work_stealing;
+    size_t num_directories = 1;
+    for (int i = 0; i < num_trees; i++)
+    {
+        num_directories += 1 + (per_species ? trees[i]->num_characteristics : 0);
+    }
+    if (num_directories > MAX_REMEMBERED_DIRECTORIES)
+    {
+        num_directories = MAX_REMEMBERED_DIRECTORIES;
+    }
 
-        // Create the path for this characteristic
-        char *new_path = create_characteristic_path(
-            current_path,
-            question,
-            answer,
-            config->true_text,
-            config->false_text,
-            config->concat_mode);
+    DirectorySet *created = create_directory_set(num_directories, shared);
+    StatusCode error = SUCCESS;
 
-        if (!new_path)
-        {
-            free(current_path);
-            return ERROR_MEMORY_ALLOCATION;
-        }
+    for (int i = 0; i < num_trees && error == SUCCESS; i++)
+    {
+        error = create_tree_root(config, trees[i]->name, file_system, created, &tree_root_dirs[i]);
+    }
 
-        // Create the directory if it doesn't exist
-        if (!file_system->directory_exists(new_path))
-        {
-            error = file_system->create_directory(new_path);
-            if (error != SUCCESS)
-            {
-                free(current_path);
-                free(new_path);
-                return error;
-            }
-        }
+    int num_threads = (config->num_threads > 0) ? config->num_threads : parallel_available_threads();
 
-        // Update the current path
-        free(current_path);
-        current_path = new_path;
+    // If using multiple processes, worker processes share out the species
+    if (error == SUCCESS && config->use_multiple_processes)
+    {
+        error = create_species_workers(trees, num_trees, tree_root_dirs, config, file_system, created);
     }
-
-    // Create the species file
-    char *species_file_path = malloc(strlen(current_path) + strlen(species->name) + 6);
-    if (!species_file_path)
+    else if (error == SUCCESS && config->use_work_stealing)
     {
-        free(current_path);
-        return ERROR_MEMORY_ALLOCATION;
+        error = create_species_stealing(trees, num_trees, tree_root_dirs, num_threads, config, file_system, created);
     }
-
-    sprintf(species_file_path, "%s/%s.txt", current_path, species->name);
-
-    // Create the file if it doesn't exist
-    if (!file_system->file_exists(species_file_path))
+    else if (error == SUCCESS)
     {
-        error = file_system->create_file(species_file_path);
+        error = create_species_from_tries(trees, num_trees, tree_root_dirs, num_threads, config, file_system);
     }
 
-    free(species_file_path);
-    free(current_path);
+    for (int i = 0; i < num_trees; i++)
+    {
+        free(tree_root_dirs[i]);
+    }
+    free(tree_root_dirs);
+    free_directory_set(created, shared);
 
     return error;
 }
@@ -151,111 +197,206 @@ StatusCode create_directory_structure(
     const DirectoryCreationConfig *config,
     const FileSystemPort *file_system)
 {
-    char *tree_root_dir = malloc(strlen(config->root_dir) + strlen(tree->name) + 2); // +2 for '/' and '\0'
+    return create_structures(&tree, 1, config, file_system);
+}
+
+StatusCode create_directory_structures(
+    DicotomicTree *const *trees,
+    int num_trees,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system)
+{
+    return create_structures((const DicotomicTree *const *)trees, num_trees, config, file_system);
+}
+
+/**
+ * @brief State of a directory creation fed by parser events
+ *
+ * Only the species being read is kept in memory: the tree being read holds
+ * its name, the questions interned so far and that one species, whose name
+ * is copied to a buffer reused from species to species.
+ */
+typedef struct
+{
+    const DirectoryCreationConfig *config;
+    const FileSystemPort *file_system;
+    DicotomicTree *tree;
+    char *species_name;
+    size_t species_name_capacity;
+    char *tree_root_dir;
+    DirectorySet *created;
+    size_t num_species;
+    int num_trees;
+    int max_processes;
+    int active_processes;
+} StreamingCreation;
+
+static StatusCode streaming_on_tree_start(void *context, const char *tree_name)
+{
+    StreamingCreation *creation = context;
 
-    if (!tree_root_dir)
+    creation->num_species = 0;
+    creation->tree = dicotomic_tree_create(tree_name);
+    if (!creation->tree)
     {
         return ERROR_MEMORY_ALLOCATION;
     }
 
-    sprintf(tree_root_dir, "%s/%s", config->root_dir, tree->name);
+    return create_tree_root(
+        creation->config, tree_name, creation->file_system, creation->created, &creation->tree_root_dir);
+}
+
+static StatusCode streaming_on_species_start(void *context, const char *species_name)
+{
+    StreamingCreation *creation = context;
+
+    size_t size = strlen(species_name) + 1;
 
-    // Create the root directory if it doesn't exist
-    if (!file_system->directory_exists(config->root_dir))
+    // The parser only keeps the name until the next token
+    if (size > creation->species_name_capacity)
     {
-        StatusCode error = file_system->create_directory(config->root_dir);
-        if (error != SUCCESS)
+        char *new_name = realloc(creation->species_name, size);
+        if (!new_name)
         {
-            return error;
+            return ERROR_MEMORY_ALLOCATION;
         }
+        creation->species_name = new_name;
+        creation->species_name_capacity = size;
     }
+    memcpy(creation->species_name, species_name, size);
 
-    // Create the family directory if it doesn't exist
-    if (!file_system->directory_exists(tree_root_dir))
+    return dicotomic_tree_add_species_view(creation->tree, creation->species_name) ? SUCCESS
+                                                                                     : ERROR_MEMORY_ALLOCATION;
+}
+
+static StatusCode streaming_on_characteristic(void *context, const char *question, bool answer)
+{
+    StreamingCreation *creation = context;
+    QuestionId id;
+
+    // Interning as questions are read gives them their final positions, so
+    // paths and order checks match the ones computed on the whole tree
+    if (!dicotomic_tree_intern_question(creation->tree, question, &id) ||
+        !dicotomic_tree_add_characteristic(creation->tree, id, answer))
     {
-        StatusCode error = file_system->create_directory(tree_root_dir);
-        if (error != SUCCESS)
-        {
-            free(tree_root_dir);
-            return error;
-        }
+        return ERROR_MEMORY_ALLOCATION;
     }
 
-    // If using multiple processes, create a child process for each species
-    if (config->use_multiple_processes)
-    {
-        int max_processes = get_max_processes();
-        int active_processes = 0;
+    return SUCCESS;
+}
 
-        for (int i = 0; i < tree->num_species; i++)
-        {
-            // Wait if we've reached the maximum number of processes
-            if (active_processes >= max_processes)
-            {
-                wait(NULL);
-                active_processes--;
-            }
-
-            // Create a child process
-            pid_t pid = create_child_process();
-
-            if (pid == 0)
-            {
-                // Child process
-                StatusCode error = create_species_directories(
-                    tree->species[i],
-                    tree_root_dir,
-                    (const char **)tree->questions,
-                    tree->num_questions,
-                    config,
-                    file_system);
-
-                free(tree_root_dir);
-                exit(error);
-            }
-            else if (pid > 0)
-            {
-                // Parent process
-                active_processes++;
-                logger_info("Created process %d for species %s", pid, tree->species[i]->name);
-            }
-            else
-            {
-                // Error creating process
-                logger_error("Failed to create process for species %s", tree->species[i]->name);
-                free(tree_root_dir);
-                return ERROR_MEMORY_ALLOCATION;
-            }
-        }
+static StatusCode streaming_on_species_end(void *context)
+{
+    StreamingCreation *creation = context;
+    DicotomicTree *tree = creation->tree;
+    const Species *species = &tree->species[0];
+    StatusCode error;
+
+    if (tree->num_questions > 0 &&
+        !species_follows_question_order(
+            species, tree->characteristics, (const char **)tree->questions, tree->num_questions))
+    {
+        logger_warning("Species '%s' does not follow the expected question order", species->name);
+    }
 
-        // Wait for all child processes to finish
-        if (!wait_for_child_processes())
-        {
-            free(tree_root_dir);
-            return ERROR_DIRECTORY_CREATION;
-        }
+    if (creation->config->use_multiple_processes)
+    {
+        error = spawn_species_process(
+            tree,
+            species,
+            creation->tree_root_dir,
+            creation->config,
+            creation->file_system,
+            creation->created,
+            creation->max_processes,
+            &creation->active_processes);
     }
     else
     {
-        // Create directories sequentially
-        for (int i = 0; i < tree->num_species; i++)
+        error = create_species_directories(
+            tree,
+            species,
+            creation->tree_root_dir,
+            creation->config,
+            creation->file_system,
+            creation->created);
+
+        if (error != SUCCESS)
         {
-            StatusCode error = create_species_directories(
-                tree->species[i],
-                tree_root_dir,
-                (const char **)tree->questions,
-                tree->num_questions,
-                config,
-                file_system);
-
-            if (error != SUCCESS)
-            {
-                logger_error("Failed to create directories for species %s", tree->species[i]->name);
-                free(tree_root_dir);
-                return error;
-            }
+            logger_error("Failed to create directories for species %s", species->name);
         }
     }
 
+    dicotomic_tree_clear_species(tree);
+    creation->num_species++;
+
+    return error;
+}
+
+static StatusCode streaming_on_tree_end(void *context)
+{
+    StreamingCreation *creation = context;
+
+    if (creation->num_species == 0)
+    {
+        logger_error("Invalid tree or no species");
+        return ERROR_INVALID_JSON;
+    }
+
+    // Questions are not shared between trees
+    dicotomic_tree_free(creation->tree);
+    free(creation->tree_root_dir);
+    creation->tree = NULL;
+    creation->tree_root_dir = NULL;
+    creation->num_trees++;
+
     return SUCCESS;
-}
\ No newline at end of file
+}
+
+static const JsonParserCallbacks streaming_callbacks = {
+    .on_tree_start = streaming_on_tree_start,
+    .on_species_start = streaming_on_species_start,
+    .on_characteristic = streaming_on_characteristic,
+    .on_species_end = streaming_on_species_end,
+    .on_tree_end = streaming_on_tree_end};
+
+StatusCode create_directory_structure_from_stream(
+    const char *key_path,
+    const DirectoryCreationConfig *config,
+    const JsonParserPort *json_parser,
+    const FileSystemPort *file_system)
+{
+    StreamingCreation creation = {
+        .config = config,
+        .file_system = file_system,
+        .tree = NULL,
+        .species_name = NULL,
+        .species_name_capacity = 0,
+        .tree_root_dir = NULL,
+        .created = create_directory_set(STREAM_DIRECTORIES, config->use_multiple_processes),
+        .num_species = 0,
+        .num_trees = 0,
+        .max_processes = get_max_processes(),
+        .active_processes = 0};
+
+    StatusCode error = json_parser->parse_stream(key_path, &streaming_callbacks, &creation);
+
+    if (error == SUCCESS && creation.num_trees == 0)
+    {
+        logger_error("Invalid tree or no species");
+        error = ERROR_INVALID_JSON;
+    }
+
+    // Wait for all child processes to finish
+    if (config->use_multiple_processes && !wait_for_child_processes() && error == SUCCESS)
+    {
+        error = ERROR_DIRECTORY_CREATION;
+    }
+
+    dicotomic_tree_free(creation.tree);
+    free(creation.species_name);
+    free(creation.tree_root_dir);
+    free_directory_set(creation.created, config->use_multiple_processes);
+
+    return error;
+}
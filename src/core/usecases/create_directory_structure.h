@@ -3,6 +3,7 @@
 
 #include "../domain/dicotomic_tree.h"
 #include "../ports/file_system_port.h"
+#include "../ports/json_parser_port.h"
 #include "../../../include/common/types.h"
 
 /**
@@ -15,8 +16,41 @@ typedef struct
     const char *false_text;
     ConcatMode concat_mode;
     bool use_multiple_processes;
+    bool stream_input;
+    int num_threads; // Threads used to parse keys and create directories, 0 for one per processor
+    const char *compile_path; // Where to write the key as an image, NULL to create directories
+    bool use_cache; // Whether to keep and reuse an image next to the key
+    bool ndjson_input; // Whether every key is NDJSON, whatever its extension
+    char **query_questions; // Questions answered to list the candidate species instead of creating directories
+    bool *query_answers; // The answer given to each query question
+    int num_queries;
+    const char *classify_path; // Observations to identify instead of creating directories, "-" for standard input
+    const char *emit_path; // Where to write a C source identifying species of the key, NULL to create directories
+    bool optimize_order; // Whether to reorder the questions so species are identified sooner
+    bool diagnose; // Whether to list the problems of the key instead of creating directories
+    const char *index_path; // Where to write the index of species names after creating directories, NULL for none
+    const char *lookup_name; // Species to find in the indexes given instead of keys
+    bool index_trigrams; // Whether the index also stores the trigrams of the names, to search them
+    const char *search_text; // Text to search among the names of the indexes given instead of keys
+    bool use_io_uring; // Whether to create directories in batches through io_uring when the kernel allows it
+    bool use_work_stealing; // Whether to create each species as a task of a pool of threads instead of a process
 } DirectoryCreationConfig;
 
+/**
+ * @brief Get the path of the file created for a species
+ *
+ * @param tree The dicotomic tree of the species
+ * @param species The species
+ * @param tree_dir The directory of the tree, which the path starts with
+ * @param config The configuration for directory creation, for the texts and concat mode
+ * @return char* The path, to be freed by the caller, or NULL if memory allocation failed
+ */
+char *species_file_path(
+    const DicotomicTree *tree,
+    const Species *species,
+    const char *tree_dir,
+    const DirectoryCreationConfig *config);
+
 /**
  * @brief Create the directory structure for a dicotomic tree
  *
@@ -30,4 +64,41 @@ StatusCode create_directory_structure(
     const DirectoryCreationConfig *config,
     const FileSystemPort *file_system);
 
+/**
+ * @brief Create the directory structures of several dicotomic trees
+ *
+ * The species of all trees are shared out among the same workers: child
+ * processes when use_multiple_processes is set, threads when num_threads is
+ * not 1, the calling thread otherwise.
+ *
+ * @param trees The dicotomic trees
+ * @param num_trees The number of trees
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_directory_structures(
+    DicotomicTree *const *trees,
+    int num_trees,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system);
+
+/**
+ * @brief Create the directory structure while the key is being parsed
+ *
+ * Each species is materialized as soon as it has been read and then dropped,
+ * so memory is bounded by the largest species instead of the whole key.
+ *
+ * @param key_path The path of the key, or "-" for standard input
+ * @param config The configuration for directory creation
+ * @param json_parser The parser used to stream the key
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_directory_structure_from_stream(
+    const char *key_path,
+    const DirectoryCreationConfig *config,
+    const JsonParserPort *json_parser,
+    const FileSystemPort *file_system);
+
 #endif /* CREATE_DIRECTORY_STRUCTURE_H */
\ No newline at end of file
@@ -0,0 +1,496 @@
+#include "create_species_directories.h"
+#include "../../../include/common/utils.h"
+#include "../../../include/common/logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char *create_characteristic_name(
+    const char *question,
+    bool answer,
+    const char *true_text,
+    const char *false_text,
+    ConcatMode concat_mode)
+{
+    const char *text = answer ? true_text : false_text;
+    char *name = NULL;
+
+    switch (concat_mode)
+    {
+    case PREFIX_MODE:
+        name = malloc(strlen(text) + strlen(question) + 2);
+        if (name)
+        {
+            sprintf(name, "%s %s", text, question);
+        }
+        break;
+    case SUFFIX_MODE:
+        name = malloc(strlen(question) + strlen(text) + 2);
+        if (name)
+        {
+            sprintf(name, "%s %s", question, text);
+        }
+        break;
+    case BOTH_MODES:
+        name = malloc(strlen(text) + strlen(question) + strlen(text) + 3);
+        if (name)
+        {
+            sprintf(name, "%s %s %s", text, question, text);
+        }
+        break;
+    }
+
+    return name;
+}
+
+char *create_characteristic_path(
+    const char *root_dir,
+    const char *question,
+    bool answer,
+    const char *true_text,
+    const char *false_text,
+    ConcatMode concat_mode)
+{
+    char *name = create_characteristic_name(question, answer, true_text, false_text, concat_mode);
+    char *path = name ? malloc(strlen(root_dir) + strlen(name) + 2) : NULL;
+
+    if (path)
+    {
+        sprintf(path, "%s/%s", root_dir, name);
+    }
+    free(name);
+
+    return path;
+}
+
+StatusCode create_species_file_at(
+    int directory,
+    const char *subdirectory,
+    const char *name,
+    const FileSystemPort *file_system)
+{
+    size_t size = (subdirectory ? strlen(subdirectory) + 1 : 0) + strlen(name) + 5;
+    char *file_name = malloc(size);
+    if (!file_name)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    if (subdirectory)
+    {
+        sprintf(file_name, "%s/%s.txt", subdirectory, name);
+    }
+    else
+    {
+        sprintf(file_name, "%s.txt", name);
+    }
+
+    StatusCode error = file_system->create_file_at(directory, file_name);
+    free(file_name);
+
+    return error;
+}
+
+/**
+ * @brief Append a name to a path that may be empty
+ *
+ * @param path The path, reallocated as needed
+ * @param length The length of the path, updated
+ * @param capacity The size of the path buffer, updated
+ * @param name The name
+ * @return bool true if successful, false if memory allocation failed
+ */
+static bool append_path_name(char **path, size_t *length, size_t *capacity, const char *name)
+{
+    size_t name_length = strlen(name);
+    size_t needed = *length + name_length + 2;
+
+    if (needed > *capacity)
+    {
+        size_t new_capacity = (*capacity > 0) ? *capacity * 2 : 256;
+        while (new_capacity < needed)
+        {
+            new_capacity *= 2;
+        }
+
+        char *new_path = realloc(*path, new_capacity);
+        if (!new_path)
+        {
+            return false;
+        }
+        *path = new_path;
+        *capacity = new_capacity;
+    }
+
+    if (*length > 0)
+    {
+        (*path)[(*length)++] = '/';
+    }
+    memcpy(*path + *length, name, name_length + 1);
+    *length += name_length;
+
+    return true;
+}
+
+/**
+ * @brief Create the directories of a species relative to an open directory
+ *
+ * Directories are reached by their path from the open directory, so known
+ * ones cost nothing and new ones a single creation. The open directory only
+ * moves down when that path grows past MAX_RELATIVE_PATH.
+ *
+ * @param tree The tree of the species
+ * @param species The species
+ * @param root_dir The directory of the tree
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation, with directory handles
+ * @param created The directories known to exist, NULL to create every one
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode create_species_directories_at(
+    const DicotomicTree *tree,
+    const Species *species,
+    const char *root_dir,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created)
+{
+    const QuestionAnswer *characteristics;
+    size_t num_characteristics;
+    QuestionAnswer *sorted;
+
+    if (!species_path(species, tree->characteristics, tree->num_questions, &characteristics, &num_characteristics, &sorted))
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    int directory;
+    StatusCode error = file_system->open_directory(root_dir, &directory);
+    if (error != SUCCESS)
+    {
+        free(sorted);
+        return error;
+    }
+
+    char *relative = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    uint64_t key = directory_set_key(0, root_dir);
+
+    for (size_t i = 0; i < num_characteristics && error == SUCCESS; i++)
+    {
+        char *name = create_characteristic_name(
+            tree->questions[characteristics[i].question],
+            characteristics[i].answer,
+            config->true_text,
+            config->false_text,
+            config->concat_mode);
+
+        if (!name || !append_path_name(&relative, &length, &capacity, name))
+        {
+            free(name);
+            error = ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+        key = directory_set_key(key, name);
+        free(name);
+
+        bool known = created && directory_set_contains(created, key);
+        if (length > MAX_RELATIVE_PATH)
+        {
+            int child;
+            error = file_system->create_directory_at(directory, relative, &child);
+            if (error == SUCCESS)
+            {
+                file_system->close_directory(directory);
+                directory = child;
+                length = 0;
+            }
+        }
+        else if (!known)
+        {
+            error = file_system->create_directory_at(directory, relative, NULL);
+        }
+
+        if (error == SUCCESS && created && !known)
+        {
+            directory_set_add(created, key);
+        }
+    }
+    free(sorted);
+
+    if (error == SUCCESS)
+    {
+        error = create_species_file_at(directory, (length > 0) ? relative : NULL, species->name, file_system);
+    }
+    file_system->close_directory(directory);
+    free(relative);
+
+    return error;
+}
+
+/**
+ * @brief Create a directory unless it is known to exist
+ *
+ * @param path The path of the directory
+ * @param key The key of the directory
+ * @param created The directories known to exist, NULL to create it anyway
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode create_directory_once(
+    const char *path,
+    uint64_t key,
+    DirectorySet *created,
+    const FileSystemPort *file_system)
+{
+    if (created && directory_set_contains(created, key))
+    {
+        return SUCCESS;
+    }
+
+    // Creating an existing directory succeeds, so it is not checked first
+    StatusCode error = file_system->create_directory(path);
+    if (error == SUCCESS && created)
+    {
+        directory_set_add(created, key);
+    }
+
+    return error;
+}
+
+char *species_file_path(
+    const DicotomicTree *tree,
+    const Species *species,
+    const char *tree_dir,
+    const DirectoryCreationConfig *config)
+{
+    const QuestionAnswer *characteristics;
+    size_t num_characteristics;
+    QuestionAnswer *sorted;
+
+    if (!species_path(species, tree->characteristics, tree->num_questions, &characteristics, &num_characteristics, &sorted))
+    {
+        return NULL;
+    }
+
+    char *path = my_strdup(tree_dir);
+    for (size_t i = 0; i < num_characteristics && path; i++)
+    {
+        char *new_path = create_characteristic_path(
+            path,
+            tree->questions[characteristics[i].question],
+            characteristics[i].answer,
+            config->true_text,
+            config->false_text,
+            config->concat_mode);
+
+        free(path);
+        path = new_path;
+    }
+    free(sorted);
+
+    char *file_path = path ? malloc(strlen(path) + strlen(species->name) + 6) : NULL;
+    if (file_path)
+    {
+        sprintf(file_path, "%s/%s.txt", path, species->name);
+    }
+    free(path);
+
+    return file_path;
+}
+
+StatusCode create_species_directories(
+    const DicotomicTree *tree,
+    const Species *species,
+    const char *root_dir,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created)
+{
+    if (file_system->create_directory_at)
+    {
+        return create_species_directories_at(tree, species, root_dir, config, file_system, created);
+    }
+
+    const char *const *questions = (const char *const *)tree->questions;
+    size_t num_questions = tree->num_questions;
+    char *current_path = my_strdup(root_dir);
+
+    if (!current_path)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    StatusCode error = SUCCESS;
+    uint64_t key = directory_set_key(0, root_dir);
+
+    const QuestionAnswer *characteristics;
+    size_t num_characteristics;
+    QuestionAnswer *sorted;
+
+    if (!species_path(species, tree->characteristics, num_questions, &characteristics, &num_characteristics, &sorted))
+    {
+        free(current_path);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Create directories for each characteristic
+    for (size_t i = 0; i < num_characteristics; i++)
+    {
+        const char *question = questions[characteristics[i].question];
+        bool answer = characteristics[i].answer;
+
+        // Create the path for this characteristic
+        char *new_path = create_characteristic_path(
+            current_path,
+            question,
+            answer,
+            config->true_text,
+            config->false_text,
+            config->concat_mode);
+
+        if (!new_path)
+        {
+            free(current_path);
+            free(sorted);
+            return ERROR_MEMORY_ALLOCATION;
+        }
+
+        // The key chains the name, which is what follows the last '/'
+        key = directory_set_key(key, strrchr(new_path, '/') + 1);
+        error = create_directory_once(new_path, key, created, file_system);
+        if (error != SUCCESS)
+        {
+            free(current_path);
+            free(new_path);
+            free(sorted);
+            return error;
+        }
+
+        // Update the current path
+        free(current_path);
+        current_path = new_path;
+    }
+    free(sorted);
+
+    // Create the species file
+    char *species_file_path = malloc(strlen(current_path) + strlen(species->name) + 6);
+    if (!species_file_path)
+    {
+        free(current_path);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    sprintf(species_file_path, "%s/%s.txt", current_path, species->name);
+
+    // Creating the file keeps an existing one, so it is not checked first
+    error = file_system->create_file(species_file_path);
+
+    free(species_file_path);
+    free(current_path);
+
+    return error;
+}
+
+StatusCode create_tree_root(
+    const DirectoryCreationConfig *config,
+    const char *tree_name,
+    const FileSystemPort *file_system,
+    DirectorySet *created,
+    char **tree_root_dir)
+{
+    *tree_root_dir = malloc(strlen(config->root_dir) + strlen(tree_name) + 2); // +2 for '/' and '\0'
+
+    if (!*tree_root_dir)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    sprintf(*tree_root_dir, "%s/%s", config->root_dir, tree_name);
+
+    // Create the root directory, shared by every tree, and the family directory
+    StatusCode error = create_directory_once(
+        config->root_dir, directory_set_key(0, config->root_dir), created, file_system);
+    if (error == SUCCESS)
+    {
+        error = create_directory_once(*tree_root_dir, directory_set_key(0, *tree_root_dir), created, file_system);
+    }
+
+    if (error != SUCCESS)
+    {
+        free(*tree_root_dir);
+        *tree_root_dir = NULL;
+    }
+
+    return error;
+}
+
+size_t *number_species(const DicotomicTree *const *trees, int num_trees)
+{
+    size_t *first_species = malloc(((size_t)num_trees + 1) * sizeof(size_t));
+    if (!first_species)
+    {
+        return NULL;
+    }
+
+    first_species[0] = 0;
+    for (int i = 0; i < num_trees; i++)
+    {
+        first_species[i + 1] = first_species[i] + trees[i]->num_species;
+    }
+
+    return first_species;
+}
+
+/**
+ * @brief Find the tree of a species numbered by number_species
+ *
+ * @param first_species The numbers given by number_species
+ * @param num_trees The number of trees
+ * @param item The number of the species
+ * @return int The index of the tree
+ */
+static int tree_of_species(const size_t *first_species, int num_trees, size_t item)
+{
+    // The last tree starting at or before the item
+    int low = 0;
+    int high = num_trees - 1;
+    while (low < high)
+    {
+        int middle = low + (high - low + 1) / 2;
+        if (first_species[middle] <= item)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
+
+void create_numbered_species(SpeciesCreation *creation, size_t item)
+{
+    // Stop as soon as any species failed
+    if (__atomic_load_n(&creation->error, __ATOMIC_RELAXED) != SUCCESS)
+    {
+        return;
+    }
+
+    int i = tree_of_species(creation->first_species, creation->num_trees, item);
+    const DicotomicTree *tree = creation->trees[i];
+    const Species *species = &tree->species[item - creation->first_species[i]];
+    StatusCode error = create_species_directories(
+        tree, species, creation->tree_root_dirs[i], creation->config, creation->file_system, creation->created);
+
+    if (error != SUCCESS)
+    {
+        StatusCode expected = SUCCESS;
+        logger_error("Failed to create directories for species %s", species->name);
+        __atomic_compare_exchange_n(&creation->error, &expected, error, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+}
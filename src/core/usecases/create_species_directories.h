@@ -0,0 +1,138 @@
+#ifndef CREATE_SPECIES_DIRECTORIES_H
+#define CREATE_SPECIES_DIRECTORIES_H
+
+#include "create_directory_structure.h"
+#include "../domain/dicotomic_tree.h"
+#include "../domain/directory_set.h"
+#include "../ports/file_system_port.h"
+#include "../../../include/common/types.h"
+
+// Longest path from an open directory before moving down to a deeper one
+#define MAX_RELATIVE_PATH 1024
+
+/**
+ * @brief Work shared by the threads or processes creating species one at a time
+ */
+typedef struct
+{
+    const DicotomicTree *const *trees;
+    int num_trees;
+    size_t *first_species; // Number of the first species of each tree among all, then the total
+    char **tree_root_dirs;
+    const DirectoryCreationConfig *config;
+    const FileSystemPort *file_system;
+    DirectorySet *created;
+    StatusCode error;
+} SpeciesCreation;
+
+/**
+ * @brief Create the directory name for a characteristic
+ *
+ * @param question The question
+ * @param answer The answer
+ * @param true_text The text of a true answer
+ * @param false_text The text of a false answer
+ * @param concat_mode Where the text goes around the question
+ * @return char* The name, to be freed by the caller, or NULL if memory allocation failed
+ */
+char *create_characteristic_name(
+    const char *question,
+    bool answer,
+    const char *true_text,
+    const char *false_text,
+    ConcatMode concat_mode);
+
+/**
+ * @brief Create the path for a characteristic inside a directory
+ *
+ * @param root_dir The directory
+ * @param question The question
+ * @param answer The answer
+ * @param true_text The text of a true answer
+ * @param false_text The text of a false answer
+ * @param concat_mode Where the text goes around the question
+ * @return char* The path, to be freed by the caller, or NULL if memory allocation failed
+ */
+char *create_characteristic_path(
+    const char *root_dir,
+    const char *question,
+    bool answer,
+    const char *true_text,
+    const char *false_text,
+    ConcatMode concat_mode);
+
+/**
+ * @brief Create the file of a species in an open directory
+ *
+ * @param directory The handle of the directory
+ * @param subdirectory The directory of the file inside it, NULL for the directory itself
+ * @param name The name of the species
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_species_file_at(
+    int directory,
+    const char *subdirectory,
+    const char *name,
+    const FileSystemPort *file_system);
+
+/**
+ * @brief Create the directories of a species and its file
+ *
+ * Directories are created relative to open ones when the file system
+ * supports it, by their full path otherwise.
+ *
+ * @param tree The tree of the species
+ * @param species The species
+ * @param root_dir The directory of the tree
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation
+ * @param created The directories known to exist, NULL to create every one
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_species_directories(
+    const DicotomicTree *tree,
+    const Species *species,
+    const char *root_dir,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created);
+
+/**
+ * @brief Create the root directory and the directory of the tree inside it
+ *
+ * @param config The configuration for directory creation
+ * @param tree_name The name of the tree
+ * @param file_system The file system implementation
+ * @param created The directories known to exist, NULL to create them anyway
+ * @param tree_root_dir Pointer to store the path of the tree directory
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_tree_root(
+    const DirectoryCreationConfig *config,
+    const char *tree_name,
+    const FileSystemPort *file_system,
+    DirectorySet *created,
+    char **tree_root_dir);
+
+/**
+ * @brief Number all species of several trees one after another
+ *
+ * @param trees The trees
+ * @param num_trees The number of trees
+ * @return size_t* The number of the first species of each tree, then the total, or NULL if allocation failed
+ */
+size_t *number_species(const DicotomicTree *const *trees, int num_trees);
+
+/**
+ * @brief Create the directories of a species numbered by number_species
+ *
+ * Does nothing once any species failed; the first error is kept in the
+ * creation.
+ *
+ * @param creation The species and how to create them
+ * @param item The number of the species
+ */
+void create_numbered_species(SpeciesCreation *creation, size_t item);
+
+#endif /* CREATE_SPECIES_DIRECTORIES_H */
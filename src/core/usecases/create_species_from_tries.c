@@ -0,0 +1,519 @@
+#include "create_species_from_tries.h"
+#include "create_species_directories.h"
+#include "create_trie_levels.h"
+#include "../domain/decision_trie.h"
+#include "../../../include/common/utils.h"
+#include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Subtrees of the decision tries handed to each thread creating directories
+#define SUBTREES_PER_THREAD 8
+
+// Longest path of a node expanded before handing out subtrees; deeper ones are
+// left to the threads, which create directories relative to their parents
+#define MAX_EXPANDED_PATH 1024
+
+/**
+ * @brief A directory of a decision trie waiting to be created
+ */
+typedef struct
+{
+    int tree;
+    size_t node;
+    char *path;
+} TrieVisit;
+
+/**
+ * @brief A growable list of directories waiting to be created
+ */
+typedef struct
+{
+    TrieVisit *visits;
+    size_t count;
+    size_t capacity;
+} TrieVisits;
+
+static void trie_visits_free(TrieVisits *visits, size_t first)
+{
+    for (size_t i = first; i < visits->count; i++)
+    {
+        free(visits->visits[i].path);
+    }
+    free(visits->visits);
+
+    visits->visits = NULL;
+    visits->count = 0;
+    visits->capacity = 0;
+}
+
+/**
+ * @brief Work shared by the threads walking the decision tries
+ */
+typedef struct
+{
+    const DicotomicTree *const *trees;
+    DecisionTrie **tries;
+    const TrieVisit *subtrees;
+    const DirectoryCreationConfig *config;
+    const FileSystemPort *file_system;
+    StatusCode error;
+} TrieCreation;
+
+/**
+ * @brief Create the directory of a trie node and the files of its species
+ *
+ * Each directory is visited once, and creating an existing directory or
+ * file succeeds, so they are created without checking first.
+ *
+ * @param tree The tree of the trie
+ * @param trie The decision trie of the tree
+ * @param node The node
+ * @param path The path of the directory of the node
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode create_trie_node(
+    const DicotomicTree *tree,
+    const DecisionTrie *trie,
+    size_t node,
+    const char *path,
+    const FileSystemPort *file_system)
+{
+    // The root is the directory of the tree, created beforehand
+    StatusCode error = (node != 0) ? file_system->create_directory(path) : SUCCESS;
+
+    size_t i = trie->nodes[node].first_species;
+    for (; i != DECISION_TRIE_NONE && error == SUCCESS; i = trie->next_species[i])
+    {
+        const char *name = tree->species[i].name;
+        char *species_file_path = malloc(strlen(path) + strlen(name) + 6);
+        if (!species_file_path)
+        {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+
+        sprintf(species_file_path, "%s/%s.txt", path, name);
+        error = file_system->create_file(species_file_path);
+
+        if (error != SUCCESS)
+        {
+            logger_error("Failed to create the file of species %s", name);
+        }
+        free(species_file_path);
+    }
+
+    return error;
+}
+
+/**
+ * @brief Queue the children of a trie node after the pending directories
+ *
+ * @param visits The pending directories
+ * @param tree_index The index of the tree of the trie
+ * @param tree The tree
+ * @param trie The decision trie of the tree
+ * @param node The node
+ * @param path The path of the directory of the node
+ * @param config The configuration for directory creation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode push_trie_children(
+    TrieVisits *visits,
+    int tree_index,
+    const DicotomicTree *tree,
+    const DecisionTrie *trie,
+    size_t node,
+    const char *path,
+    const DirectoryCreationConfig *config)
+{
+    size_t child = trie->nodes[node].first_child;
+    for (; child != DECISION_TRIE_NONE; child = trie->nodes[child].next_sibling)
+    {
+        if (visits->count == visits->capacity)
+        {
+            size_t capacity = visits->capacity ? visits->capacity * 2 : 64;
+            TrieVisit *new_visits = realloc(visits->visits, capacity * sizeof(TrieVisit));
+            if (!new_visits)
+            {
+                return ERROR_MEMORY_ALLOCATION;
+            }
+            visits->visits = new_visits;
+            visits->capacity = capacity;
+        }
+
+        const DecisionNode *child_node = &trie->nodes[child];
+        char *child_path = create_characteristic_path(
+            path,
+            tree->questions[child_node->question],
+            child_node->answer,
+            config->true_text,
+            config->false_text,
+            config->concat_mode);
+
+        if (!child_path)
+        {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+
+        visits->visits[visits->count].tree = tree_index;
+        visits->visits[visits->count].node = child;
+        visits->visits[visits->count].path = child_path;
+        visits->count++;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief A directory of a decision trie kept open while its children are created
+ */
+typedef struct
+{
+    size_t next_child;
+    int directory;
+} OpenTrieNode;
+
+/**
+ * @brief Create the files of the species of a trie node in an open directory
+ *
+ * @param tree The tree of the trie
+ * @param trie The decision trie of the tree
+ * @param node The node
+ * @param directory The handle of the directory
+ * @param subdirectory The directory of the node inside it, NULL for the directory itself
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode create_trie_species_at(
+    const DicotomicTree *tree,
+    const DecisionTrie *trie,
+    size_t node,
+    int directory,
+    const char *subdirectory,
+    const FileSystemPort *file_system)
+{
+    StatusCode error = SUCCESS;
+
+    size_t i = trie->nodes[node].first_species;
+    for (; i != DECISION_TRIE_NONE && error == SUCCESS; i = trie->next_species[i])
+    {
+        error = create_species_file_at(directory, subdirectory, tree->species[i].name, file_system);
+        if (error != SUCCESS)
+        {
+            logger_error("Failed to create the file of species %s", tree->species[i].name);
+        }
+    }
+
+    return error;
+}
+
+/**
+ * @brief Create a subtree of a decision trie relative to open directories
+ *
+ * The directories along the current path stay open, so each directory and
+ * file is created by name in its parent. Leaves are not opened: their files
+ * are created through the parent as <directory>/<species>.txt.
+ *
+ * @param creation The work shared by the threads
+ * @param subtree The root of the subtree, whose path is created and opened
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode create_trie_subtree_at(TrieCreation *creation, const TrieVisit *subtree)
+{
+    const DicotomicTree *tree = creation->trees[subtree->tree];
+    const DecisionTrie *trie = creation->tries[subtree->tree];
+    const DirectoryCreationConfig *config = creation->config;
+    const FileSystemPort *file_system = creation->file_system;
+
+    // The root is the directory of the tree, created beforehand
+    int directory;
+    StatusCode error = (subtree->node != 0) ? file_system->create_directory(subtree->path) : SUCCESS;
+    if (error == SUCCESS)
+    {
+        error = file_system->open_directory(subtree->path, &directory);
+    }
+    if (error != SUCCESS)
+    {
+        return error;
+    }
+
+    OpenTrieNode *stack = malloc(sizeof(OpenTrieNode));
+    size_t depth = 0;
+    size_t capacity = 1;
+
+    error = stack ? create_trie_species_at(tree, trie, subtree->node, directory, NULL, file_system)
+                  : ERROR_MEMORY_ALLOCATION;
+    if (error != SUCCESS)
+    {
+        file_system->close_directory(directory);
+        free(stack);
+        return error;
+    }
+    stack[depth++] = (OpenTrieNode){trie->nodes[subtree->node].first_child, directory};
+
+    while (error == SUCCESS && depth > 0)
+    {
+        // Stop as soon as any subtree failed
+        if (__atomic_load_n(&creation->error, __ATOMIC_RELAXED) != SUCCESS)
+        {
+            break;
+        }
+
+        OpenTrieNode *top = &stack[depth - 1];
+        size_t child = top->next_child;
+        if (child == DECISION_TRIE_NONE)
+        {
+            file_system->close_directory(top->directory);
+            depth--;
+            continue;
+        }
+
+        const DecisionNode *child_node = &trie->nodes[child];
+        int parent = top->directory;
+        bool leaf = child_node->first_child == DECISION_TRIE_NONE;
+        top->next_child = child_node->next_sibling;
+
+        char *name = create_characteristic_name(
+            tree->questions[child_node->question],
+            child_node->answer,
+            config->true_text,
+            config->false_text,
+            config->concat_mode);
+        if (!name)
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+
+        int child_directory;
+        error = file_system->create_directory_at(parent, name, leaf ? NULL : &child_directory);
+        if (error == SUCCESS)
+        {
+            error = leaf ? create_trie_species_at(tree, trie, child, parent, name, file_system)
+                         : create_trie_species_at(tree, trie, child, child_directory, NULL, file_system);
+
+            if (!leaf && error == SUCCESS && depth == capacity)
+            {
+                OpenTrieNode *grown = realloc(stack, capacity * 2 * sizeof(OpenTrieNode));
+                error = grown ? SUCCESS : ERROR_MEMORY_ALLOCATION;
+                stack = grown ? grown : stack;
+                capacity *= grown ? 2 : 1;
+            }
+
+            if (!leaf && error == SUCCESS)
+            {
+                stack[depth++] = (OpenTrieNode){child_node->first_child, child_directory};
+            }
+            else if (!leaf)
+            {
+                file_system->close_directory(child_directory);
+            }
+        }
+        free(name);
+    }
+
+    while (depth > 0)
+    {
+        file_system->close_directory(stack[--depth].directory);
+    }
+    free(stack);
+
+    return error;
+}
+
+/**
+ * @brief Create a subtree of a decision trie in batches of entries
+ *
+ * @param creation The work shared by the threads
+ * @param subtree The root of the subtree, whose path is created and opened
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode create_trie_subtree_batched(TrieCreation *creation, const TrieVisit *subtree)
+{
+    const FileSystemPort *file_system = creation->file_system;
+
+    // The root is the directory of the tree, created beforehand
+    int directory;
+    StatusCode error = (subtree->node != 0) ? file_system->create_directory(subtree->path) : SUCCESS;
+    if (error == SUCCESS)
+    {
+        error = file_system->open_directory(subtree->path, &directory);
+    }
+    if (error == SUCCESS)
+    {
+        error = create_trie_levels(
+            creation->trees[subtree->tree],
+            creation->tries[subtree->tree],
+            directory,
+            subtree->node,
+            creation->config,
+            file_system,
+            &creation->error);
+        file_system->close_directory(directory);
+    }
+
+    return error;
+}
+
+static void create_trie_subtree_task(void *context, size_t index)
+{
+    TrieCreation *creation = context;
+    const TrieVisit *subtree = &creation->subtrees[index];
+    const DicotomicTree *tree = creation->trees[subtree->tree];
+    const DecisionTrie *trie = creation->tries[subtree->tree];
+
+    if (creation->file_system->create_entries_at || creation->file_system->create_directory_at)
+    {
+        StatusCode error = creation->file_system->create_entries_at ? create_trie_subtree_batched(creation, subtree)
+                                                                    : create_trie_subtree_at(creation, subtree);
+        StatusCode expected = SUCCESS;
+        if (error != SUCCESS)
+        {
+            __atomic_compare_exchange_n(&creation->error, &expected, error, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    // Depth first, so only the siblings along one path wait in memory
+    TrieVisits stack = {.visits = NULL, .count = 0, .capacity = 0};
+    StatusCode error = create_trie_node(tree, trie, subtree->node, subtree->path, creation->file_system);
+
+    if (error == SUCCESS)
+    {
+        error = push_trie_children(&stack, subtree->tree, tree, trie, subtree->node, subtree->path, creation->config);
+    }
+
+    while (error == SUCCESS && stack.count > 0)
+    {
+        // Stop as soon as any subtree failed
+        if (__atomic_load_n(&creation->error, __ATOMIC_RELAXED) != SUCCESS)
+        {
+            break;
+        }
+
+        TrieVisit visit = stack.visits[--stack.count];
+
+        error = create_trie_node(tree, trie, visit.node, visit.path, creation->file_system);
+        if (error == SUCCESS)
+        {
+            error = push_trie_children(&stack, visit.tree, tree, trie, visit.node, visit.path, creation->config);
+        }
+        free(visit.path);
+    }
+
+    trie_visits_free(&stack, 0);
+
+    if (error != SUCCESS)
+    {
+        StatusCode expected = SUCCESS;
+        __atomic_compare_exchange_n(&creation->error, &expected, error, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+}
+
+static void build_trie_task(void *context, size_t index)
+{
+    TrieCreation *creation = context;
+
+    creation->tries[index] = decision_trie_build(creation->trees[index]);
+}
+
+StatusCode create_species_from_tries(
+    const DicotomicTree *const *trees,
+    int num_trees,
+    char **tree_root_dirs,
+    int num_threads,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system)
+{
+    TrieCreation creation = {
+        .trees = trees,
+        .tries = calloc((size_t)num_trees, sizeof(DecisionTrie *)),
+        .subtrees = NULL,
+        .config = config,
+        .file_system = file_system,
+        .error = SUCCESS};
+
+    if (!creation.tries)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    parallel_for((size_t)num_trees, num_threads, build_trie_task, &creation);
+
+    TrieVisits queue = {.visits = NULL, .count = 0, .capacity = 0};
+    StatusCode error = SUCCESS;
+
+    for (int i = 0; i < num_trees && error == SUCCESS; i++)
+    {
+        if (!creation.tries[i])
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+
+        // Start from the root of every trie
+        if (queue.count == queue.capacity)
+        {
+            size_t capacity = queue.capacity ? queue.capacity * 2 : 64;
+            TrieVisit *new_visits = realloc(queue.visits, capacity * sizeof(TrieVisit));
+            if (!new_visits)
+            {
+                error = ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            queue.visits = new_visits;
+            queue.capacity = capacity;
+        }
+
+        queue.visits[queue.count].tree = i;
+        queue.visits[queue.count].node = 0;
+        queue.visits[queue.count].path = my_strdup(tree_root_dirs[i]);
+        if (!queue.visits[queue.count++].path)
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    // Expand the top of the tries until every thread has several subtrees
+    size_t head = 0;
+    size_t target = (num_threads > 1) ? (size_t)num_threads * SUBTREES_PER_THREAD : 1;
+
+    while (error == SUCCESS && head < queue.count && queue.count - head < target)
+    {
+        if (file_system->create_directory_at && strlen(queue.visits[head].path) > MAX_EXPANDED_PATH)
+        {
+            break;
+        }
+
+        // Queuing children may move the visits, so copy the one taken
+        TrieVisit visit = queue.visits[head++];
+
+        error = create_trie_node(trees[visit.tree], creation.tries[visit.tree], visit.node, visit.path, file_system);
+        if (error == SUCCESS)
+        {
+            error = push_trie_children(
+                &queue, visit.tree, trees[visit.tree], creation.tries[visit.tree], visit.node, visit.path, config);
+        }
+        free(visit.path);
+    }
+
+    if (error == SUCCESS)
+    {
+        creation.subtrees = queue.visits + head;
+        parallel_for(queue.count - head, num_threads, create_trie_subtree_task, &creation);
+        error = creation.error;
+    }
+
+    trie_visits_free(&queue, head);
+    for (int i = 0; i < num_trees; i++)
+    {
+        decision_trie_free(creation.tries[i]);
+    }
+    free(creation.tries);
+
+    return error;
+}
@@ -0,0 +1,32 @@
+#ifndef CREATE_SPECIES_FROM_TRIES_H
+#define CREATE_SPECIES_FROM_TRIES_H
+
+#include "create_directory_structure.h"
+#include "../domain/dicotomic_tree.h"
+#include "../ports/file_system_port.h"
+#include "../../../include/common/types.h"
+
+/**
+ * @brief Create the directories of several trees by walking their decision tries
+ *
+ * Each distinct directory is created once, however many species share it.
+ * The top of the tries is created breadth first until there are enough
+ * subtrees to keep the threads busy, then threads take whole subtrees.
+ *
+ * @param trees The trees
+ * @param num_trees The number of trees
+ * @param tree_root_dirs The directory of each tree, already created
+ * @param num_threads The number of threads
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_species_from_tries(
+    const DicotomicTree *const *trees,
+    int num_trees,
+    char **tree_root_dirs,
+    int num_threads,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system);
+
+#endif /* CREATE_SPECIES_FROM_TRIES_H */
@@ -0,0 +1,40 @@
+#include "create_species_stealing.h"
+#include "create_species_directories.h"
+#include "../../../include/common/parallel.h"
+
+#include <stdlib.h>
+
+static void create_species_task(void *context, size_t item)
+{
+    create_numbered_species(context, item);
+}
+
+StatusCode create_species_stealing(
+    const DicotomicTree *const *trees,
+    int num_trees,
+    char **tree_root_dirs,
+    int num_threads,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created)
+{
+    SpeciesCreation creation = {
+        .trees = trees,
+        .num_trees = num_trees,
+        .first_species = number_species(trees, num_trees),
+        .tree_root_dirs = tree_root_dirs,
+        .config = config,
+        .file_system = file_system,
+        .created = created,
+        .error = SUCCESS};
+
+    if (!creation.first_species)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    bool ran = parallel_steal(creation.first_species[num_trees], num_threads, create_species_task, &creation);
+    free(creation.first_species);
+
+    return ran ? creation.error : ERROR_MEMORY_ALLOCATION;
+}
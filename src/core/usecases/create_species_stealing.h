@@ -0,0 +1,34 @@
+#ifndef CREATE_SPECIES_STEALING_H
+#define CREATE_SPECIES_STEALING_H
+
+#include "create_directory_structure.h"
+#include "../domain/dicotomic_tree.h"
+#include "../domain/directory_set.h"
+#include "../ports/file_system_port.h"
+#include "../../../include/common/types.h"
+
+/**
+ * @brief Create every species as a task of a pool of threads
+ *
+ * Species are tiny tasks, and each thread starts with a contiguous range of
+ * them, whose directories mostly share their first levels.
+ *
+ * @param trees The trees
+ * @param num_trees The number of trees
+ * @param tree_root_dirs The directory of each tree
+ * @param num_threads The number of threads
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation
+ * @param created The directories known to exist, NULL to create every one
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_species_stealing(
+    const DicotomicTree *const *trees,
+    int num_trees,
+    char **tree_root_dirs,
+    int num_threads,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created);
+
+#endif /* CREATE_SPECIES_STEALING_H */
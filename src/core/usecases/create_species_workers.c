@@ -0,0 +1,199 @@
+#include "create_species_workers.h"
+#include "create_species_directories.h"
+#include "../../../include/common/logger.h"
+#include "../../infrastructure/process/process_manager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+// Chunks claimed by workers hold the unclaimed species over this many per worker
+#define CHUNKS_PER_WORKER 2
+
+/**
+ * @brief What a worker process reports back to its parent
+ */
+typedef struct
+{
+    size_t num_species; // Species created
+    size_t num_chunks;  // Chunks claimed
+    StatusCode error;
+} WorkerReport;
+
+/**
+ * @brief Species handed out to worker processes, in memory shared with them
+ */
+typedef struct
+{
+    size_t next; // First species not claimed yet
+    size_t num_species;
+    int num_workers;
+    StatusCode error; // Set once any worker fails, so the others stop claiming
+    WorkerReport reports[];
+} SpeciesSchedule;
+
+/**
+ * @brief Claim the next chunk of species
+ *
+ * Guided self-scheduling: chunks hold the unclaimed species over
+ * CHUNKS_PER_WORKER per worker, so they start large, keeping neighbouring
+ * species in one worker, and shrink to single species at the end, leaving
+ * little for the last worker to finish alone.
+ *
+ * @param schedule The species handed out
+ * @param first The first species of the chunk, set
+ * @return size_t The number of species of the chunk, 0 once none are left
+ */
+static size_t claim_species_chunk(SpeciesSchedule *schedule, size_t *first)
+{
+    size_t next = __atomic_load_n(&schedule->next, __ATOMIC_RELAXED);
+    size_t chunk;
+
+    do
+    {
+        if (next >= schedule->num_species || __atomic_load_n(&schedule->error, __ATOMIC_RELAXED) != SUCCESS)
+        {
+            return 0;
+        }
+
+        chunk = (schedule->num_species - next) / ((size_t)schedule->num_workers * CHUNKS_PER_WORKER);
+        chunk = chunk ? chunk : 1;
+    } while (!__atomic_compare_exchange_n(
+        &schedule->next, &next, next + chunk, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    *first = next;
+    return chunk;
+}
+
+/**
+ * @brief Create species claimed from the schedule until none are left
+ *
+ * Runs in a worker process, which reports into its slot of the schedule.
+ *
+ * @param schedule The species handed out
+ * @param worker The index of the worker
+ * @param creation The species and how to create them
+ */
+static void run_species_worker(SpeciesSchedule *schedule, int worker, SpeciesCreation *creation)
+{
+    WorkerReport *report = &schedule->reports[worker];
+    size_t first;
+    size_t chunk;
+
+    while ((chunk = claim_species_chunk(schedule, &first)) > 0)
+    {
+        report->num_chunks++;
+        for (size_t item = first; item < first + chunk && creation->error == SUCCESS; item++)
+        {
+            create_numbered_species(creation, item);
+            report->num_species += (creation->error == SUCCESS);
+        }
+
+        if (creation->error != SUCCESS)
+        {
+            StatusCode expected = SUCCESS;
+            report->error = creation->error;
+            __atomic_compare_exchange_n(
+                &schedule->error, &expected, creation->error, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+StatusCode create_species_workers(
+    const DicotomicTree *const *trees,
+    int num_trees,
+    char **tree_root_dirs,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created)
+{
+    SpeciesCreation creation = {
+        .trees = trees,
+        .num_trees = num_trees,
+        .first_species = number_species(trees, num_trees),
+        .tree_root_dirs = tree_root_dirs,
+        .config = config,
+        .file_system = file_system,
+        .created = created,
+        .error = SUCCESS};
+
+    if (!creation.first_species)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t num_species = creation.first_species[num_trees];
+    int num_workers = get_max_processes();
+    if ((size_t)num_workers > num_species)
+    {
+        num_workers = num_species > 0 ? (int)num_species : 1;
+    }
+
+    size_t size = sizeof(SpeciesSchedule) + (size_t)num_workers * sizeof(WorkerReport);
+    SpeciesSchedule *schedule = create_shared_memory(size);
+    if (!schedule)
+    {
+        free(creation.first_species);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    schedule->num_species = num_species;
+    schedule->num_workers = num_workers;
+
+    StatusCode error = SUCCESS;
+    for (int i = 0; i < num_workers; i++)
+    {
+        // Workers would otherwise write again the messages buffered so far
+        fflush(NULL);
+        pid_t pid = create_child_process();
+
+        if (pid == 0)
+        {
+            // Worker process
+            run_species_worker(schedule, i, &creation);
+            exit(schedule->reports[i].error);
+        }
+        else if (pid > 0)
+        {
+            logger_info("Created worker process %d", pid);
+        }
+        else
+        {
+            // The other workers claim the species it would have; if none
+            // starts, the count of species created below fails the run
+            logger_warning("Failed to create worker process %d, the others take its species", i);
+        }
+    }
+
+    // Wait for all worker processes to finish
+    if (!wait_for_child_processes() && error == SUCCESS)
+    {
+        error = ERROR_DIRECTORY_CREATION;
+    }
+
+    size_t num_created = 0;
+    for (int i = 0; i < num_workers; i++)
+    {
+        const WorkerReport *report = &schedule->reports[i];
+        logger_info("Worker %d created %zu species in %zu chunks", i, report->num_species, report->num_chunks);
+
+        num_created += report->num_species;
+        if (report->error != SUCCESS && error == SUCCESS)
+        {
+            error = report->error;
+        }
+    }
+
+    // A worker killed before finishing its chunk leaves species uncreated
+    if (num_created != num_species && error == SUCCESS)
+    {
+        logger_error("Created %zu of %zu species", num_created, num_species);
+        error = ERROR_DIRECTORY_CREATION;
+    }
+
+    free_shared_memory(schedule, size);
+    free(creation.first_species);
+
+    return error;
+}
@@ -0,0 +1,33 @@
+#ifndef CREATE_SPECIES_WORKERS_H
+#define CREATE_SPECIES_WORKERS_H
+
+#include "create_directory_structure.h"
+#include "../domain/dicotomic_tree.h"
+#include "../domain/directory_set.h"
+#include "../ports/file_system_port.h"
+#include "../../../include/common/types.h"
+
+/**
+ * @brief Create every species in long-lived worker processes
+ *
+ * Starts one worker per processor, which claim chunks of species from a
+ * counter in shared memory until none are left, and reads back what each
+ * one created.
+ *
+ * @param trees The trees
+ * @param num_trees The number of trees
+ * @param tree_root_dirs The directory of each tree
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation
+ * @param created The directories known to exist, in memory shared with the workers, NULL to create every one
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_species_workers(
+    const DicotomicTree *const *trees,
+    int num_trees,
+    char **tree_root_dirs,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    DirectorySet *created);
+
+#endif /* CREATE_SPECIES_WORKERS_H */
@@ -0,0 +1,257 @@
+#include "create_trie_levels.h"
+#include "create_species_directories.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief The nodes of a level of a decision trie, with paths relative to an open directory
+ *
+ * Names holds the paths of the nodes and of the entries created with them,
+ * so a level is freed, or reused, at once.
+ */
+typedef struct
+{
+    size_t *nodes;
+    size_t *paths; // Offset of the path of each node in names
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_length;
+    size_t names_capacity;
+} TrieLevel;
+
+/**
+ * @brief The entries created together for a level, naming them by offset until names stops moving
+ */
+typedef struct
+{
+    FileSystemEntry *entries;
+    size_t *names;
+    size_t count;
+    size_t capacity;
+} TrieBatch;
+
+/**
+ * @brief Append a path to the names of a level
+ *
+ * @param level The level
+ * @param directory The path of the directory, empty for the open directory itself
+ * @param name The name in the directory
+ * @param extension Text appended to the name, such as ".txt"
+ * @param offset Pointer to store the offset of the path in names
+ * @return bool true if successful, false if memory allocation failed
+ */
+static bool trie_level_add_name(
+    TrieLevel *level,
+    const char *directory,
+    const char *name,
+    const char *extension,
+    size_t *offset)
+{
+    size_t directory_length = strlen(directory);
+    size_t name_length = strlen(name);
+    size_t extension_length = strlen(extension);
+    size_t needed = level->names_length + directory_length + name_length + extension_length + 2;
+
+    if (needed > level->names_capacity)
+    {
+        size_t capacity = level->names_capacity ? level->names_capacity * 2 : 4096;
+        while (capacity < needed)
+        {
+            capacity *= 2;
+        }
+
+        char *names = realloc(level->names, capacity);
+        if (!names)
+        {
+            return false;
+        }
+        level->names = names;
+        level->names_capacity = capacity;
+    }
+
+    char *path = level->names + level->names_length;
+    if (directory_length > 0)
+    {
+        memcpy(path, directory, directory_length);
+        path[directory_length++] = '/';
+    }
+    memcpy(path + directory_length, name, name_length);
+    memcpy(path + directory_length + name_length, extension, extension_length + 1);
+
+    *offset = level->names_length;
+    level->names_length += directory_length + name_length + extension_length + 1;
+
+    return true;
+}
+
+static bool trie_level_add_node(TrieLevel *level, size_t node, size_t path)
+{
+    if (level->count == level->capacity)
+    {
+        size_t capacity = level->capacity ? level->capacity * 2 : 64;
+        size_t *nodes = realloc(level->nodes, capacity * sizeof(size_t));
+        if (nodes)
+        {
+            level->nodes = nodes;
+        }
+        size_t *paths = nodes ? realloc(level->paths, capacity * sizeof(size_t)) : NULL;
+        if (!paths)
+        {
+            return false;
+        }
+        level->paths = paths;
+        level->capacity = capacity;
+    }
+
+    level->nodes[level->count] = node;
+    level->paths[level->count++] = path;
+
+    return true;
+}
+
+static bool trie_batch_add(TrieBatch *batch, int parent, size_t name, bool is_directory)
+{
+    if (batch->count == batch->capacity)
+    {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+        FileSystemEntry *entries = realloc(batch->entries, capacity * sizeof(FileSystemEntry));
+        if (entries)
+        {
+            batch->entries = entries;
+        }
+        size_t *names = entries ? realloc(batch->names, capacity * sizeof(size_t)) : NULL;
+        if (!names)
+        {
+            return false;
+        }
+        batch->names = names;
+        batch->capacity = capacity;
+    }
+
+    batch->entries[batch->count] = (FileSystemEntry){parent, NULL, is_directory};
+    batch->names[batch->count++] = name;
+
+    return true;
+}
+
+StatusCode create_trie_levels(
+    const DicotomicTree *tree,
+    const DecisionTrie *trie,
+    int directory,
+    size_t node,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    const StatusCode *shared_error)
+{
+    TrieLevel levels[2] = {{NULL, NULL, 0, 0, NULL, 0, 0}, {NULL, NULL, 0, 0, NULL, 0, 0}};
+    TrieLevel deep = {NULL, NULL, 0, 0, NULL, 0, 0};
+    TrieBatch batch = {NULL, NULL, 0, 0};
+    TrieLevel *current = &levels[0];
+    TrieLevel *next = &levels[1];
+
+    size_t root_path;
+    StatusCode error = (trie_level_add_name(current, "", "", "", &root_path) &&
+                        trie_level_add_node(current, node, root_path))
+                           ? SUCCESS
+                           : ERROR_MEMORY_ALLOCATION;
+
+    while (error == SUCCESS && current->count > 0)
+    {
+        // Stop as soon as any subtree failed
+        if (__atomic_load_n(shared_error, __ATOMIC_RELAXED) != SUCCESS)
+        {
+            break;
+        }
+
+        next->count = 0;
+        next->names_length = 0;
+        batch.count = 0;
+
+        for (size_t i = 0; i < current->count && error == SUCCESS; i++)
+        {
+            const DecisionNode *level_node = &trie->nodes[current->nodes[i]];
+            size_t name;
+
+            size_t species = level_node->first_species;
+            for (; species != DECISION_TRIE_NONE && error == SUCCESS; species = trie->next_species[species])
+            {
+                bool added = trie_level_add_name(
+                                 next, current->names + current->paths[i], tree->species[species].name, ".txt", &name) &&
+                             trie_batch_add(&batch, directory, name, false);
+                error = added ? SUCCESS : ERROR_MEMORY_ALLOCATION;
+            }
+
+            size_t child = level_node->first_child;
+            for (; child != DECISION_TRIE_NONE && error == SUCCESS; child = trie->nodes[child].next_sibling)
+            {
+                const DecisionNode *child_node = &trie->nodes[child];
+                char *child_name = create_characteristic_name(
+                    tree->questions[child_node->question],
+                    child_node->answer,
+                    config->true_text,
+                    config->false_text,
+                    config->concat_mode);
+
+                bool added = child_name &&
+                             trie_level_add_name(next, current->names + current->paths[i], child_name, "", &name) &&
+                             trie_batch_add(&batch, directory, name, true);
+                free(child_name);
+
+                // Long paths go on from the directory of the node, once it is created
+                size_t deep_name;
+                if (added && strlen(next->names + name) > MAX_RELATIVE_PATH)
+                {
+                    added = trie_level_add_name(&deep, "", next->names + name, "", &deep_name) &&
+                            trie_level_add_node(&deep, child, deep_name);
+                }
+                else if (added)
+                {
+                    added = trie_level_add_node(next, child, name);
+                }
+                error = added ? SUCCESS : ERROR_MEMORY_ALLOCATION;
+            }
+        }
+
+        if (error == SUCCESS && batch.count > 0)
+        {
+            for (size_t i = 0; i < batch.count; i++)
+            {
+                batch.entries[i].name = next->names + batch.names[i];
+            }
+            error = file_system->create_entries_at(batch.entries, batch.count);
+        }
+
+        TrieLevel *created = current;
+        current = next;
+        next = created;
+    }
+
+    for (size_t i = 0; i < deep.count && error == SUCCESS; i++)
+    {
+        // The directory exists, and creating it again opens it
+        int deep_directory;
+        error = file_system->create_directory_at(directory, deep.names + deep.paths[i], &deep_directory);
+        if (error == SUCCESS)
+        {
+            error = create_trie_levels(
+                tree, trie, deep_directory, deep.nodes[i], config, file_system, shared_error);
+            file_system->close_directory(deep_directory);
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        free(levels[i].nodes);
+        free(levels[i].paths);
+        free(levels[i].names);
+    }
+    free(deep.nodes);
+    free(deep.paths);
+    free(deep.names);
+    free(batch.entries);
+    free(batch.names);
+
+    return error;
+}
@@ -0,0 +1,37 @@
+#ifndef CREATE_TRIE_LEVELS_H
+#define CREATE_TRIE_LEVELS_H
+
+#include "create_directory_structure.h"
+#include "../domain/decision_trie.h"
+#include "../domain/dicotomic_tree.h"
+#include "../ports/file_system_port.h"
+#include "../../../include/common/types.h"
+
+/**
+ * @brief Create a subtree of a decision trie a level at a time
+ *
+ * Each batch creates the directories of a level and the species files of
+ * the level above, which exists by then, so the file system may issue them
+ * all at once. Entries are named by their path from the open directory;
+ * nodes whose path grows past MAX_RELATIVE_PATH are walked afterwards from
+ * their own directory.
+ *
+ * @param tree The tree of the trie
+ * @param trie The decision trie of the tree
+ * @param directory The handle of the directory of the node
+ * @param node The root of the subtree, whose directory exists
+ * @param config The configuration for directory creation
+ * @param file_system The file system implementation, with create_entries_at
+ * @param shared_error The first error of any thread, to stop as soon as one fails
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode create_trie_levels(
+    const DicotomicTree *tree,
+    const DecisionTrie *trie,
+    int directory,
+    size_t node,
+    const DirectoryCreationConfig *config,
+    const FileSystemPort *file_system,
+    const StatusCode *shared_error);
+
+#endif /* CREATE_TRIE_LEVELS_H */
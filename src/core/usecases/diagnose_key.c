@@ -0,0 +1,123 @@
+#include "diagnose_key.h"
+#include "../domain/key_diagnostics.h"
+#include "../../../include/common/logger.h"
+
+static void write_field(FILE *output, const char *text)
+{
+    fputc('\t', output);
+    for (const char *c = text; *c; c++)
+    {
+        if (*c == '\t')
+        {
+            fputs("\\t", output);
+        }
+        else if (*c == '\n')
+        {
+            fputs("\\n", output);
+        }
+        else if (*c == '\\')
+        {
+            fputs("\\\\", output);
+        }
+        else
+        {
+            fputc(*c, output);
+        }
+    }
+}
+
+/**
+ * @brief Write a finding that relates two species
+ *
+ * @param output The stream
+ * @param kind The kind of finding
+ * @param tree The tree
+ * @param species The species the finding is about
+ * @param other The species it relates to
+ */
+static void write_species_finding(
+    FILE *output,
+    const char *kind,
+    const DicotomicTree *tree,
+    size_t species,
+    size_t other)
+{
+    fputs(kind, output);
+    write_field(output, tree->name);
+    write_field(output, tree->species[species].name);
+    fprintf(output, "\t%zu", species);
+    write_field(output, tree->species[other].name);
+    fprintf(output, "\t%zu\n", other);
+}
+
+StatusCode diagnose_trees(
+    DicotomicTree *const *trees,
+    int num_trees,
+    int num_threads,
+    FILE *output,
+    size_t *num_findings)
+{
+    *num_findings = 0;
+
+    for (int i = 0; i < num_trees; i++)
+    {
+        const DicotomicTree *tree = trees[i];
+        KeyDiagnostics diagnostics;
+
+        if (!key_diagnostics_run(tree, num_threads, &diagnostics))
+        {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+
+        size_t counts[4] = {0, 0, 0, 0};
+        for (size_t j = 0; j < tree->num_species; j++)
+        {
+            if (diagnostics.same_name[j] != KEY_DIAGNOSTICS_NONE)
+            {
+                write_species_finding(output, "duplicate-name", tree, j, diagnostics.same_name[j]);
+                counts[0]++;
+            }
+            if (diagnostics.same_path[j] != KEY_DIAGNOSTICS_NONE)
+            {
+                write_species_finding(output, "duplicate-path", tree, j, diagnostics.same_path[j]);
+                counts[1]++;
+            }
+            if (diagnostics.extended_by[j] != KEY_DIAGNOSTICS_NONE)
+            {
+                write_species_finding(output, "prefix-path", tree, j, diagnostics.extended_by[j]);
+                counts[2]++;
+            }
+        }
+
+        for (size_t q = 0; q < diagnostics.num_questions; q++)
+        {
+            unsigned char given = diagnostics.answers_given[q];
+            if (given == 1 || given == 2)
+            {
+                fputs("constant-answer", output);
+                write_field(output, tree->name);
+                write_field(output, tree->questions[q]);
+                fprintf(output, "\t%zu\t%s\n", q, given == 2 ? "si" : "no");
+                counts[3]++;
+            }
+        }
+
+        key_diagnostics_free(&diagnostics);
+
+        logger_info("Tree '%s': %zu duplicate names, %zu duplicate paths, %zu prefix paths, %zu constant answers",
+                    tree->name,
+                    counts[0],
+                    counts[1],
+                    counts[2],
+                    counts[3]);
+        *num_findings += counts[0] + counts[1] + counts[2] + counts[3];
+    }
+
+    if (ferror(output))
+    {
+        logger_error("Failed to write the diagnostics");
+        return ERROR_FILE_CREATION;
+    }
+
+    return SUCCESS;
+}
@@ -0,0 +1,39 @@
+#ifndef DIAGNOSE_KEY_H
+#define DIAGNOSE_KEY_H
+
+#include "../domain/dicotomic_tree.h"
+#include "../../../include/common/types.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Write the problems of each tree, one tab-separated line each
+ *
+ * Lines are written tree by tree, in species order, then question order:
+ *
+ *   duplicate-name   <tree> <species> <index> <first species> <index>
+ *   duplicate-path   <tree> <species> <index> <first species> <index>
+ *   prefix-path      <tree> <species> <index> <extending species> <index>
+ *   constant-answer  <tree> <question> <id> <si|no>
+ *
+ * A duplicate path puts two species in the same directory, and a duplicate
+ * name in the same directory overwrites its file. A prefix path leaves a
+ * species in a directory that leads on to another. Tabs, line breaks and
+ * backslashes in names are escaped as \t, \n and \\.
+ *
+ * @param trees The trees
+ * @param num_trees The number of trees
+ * @param num_threads The number of threads, 0 for one per processor
+ * @param output The stream the lines are written to
+ * @param num_findings Pointer to store the number of lines written
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode diagnose_trees(
+    DicotomicTree *const *trees,
+    int num_trees,
+    int num_threads,
+    FILE *output,
+    size_t *num_findings);
+
+#endif /* DIAGNOSE_KEY_H */
@@ -0,0 +1,287 @@
+#include "emit_classifier.h"
+#include "../domain/decision_trie.h"
+#include "../../../include/common/logger.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Characters of a question kept in the name of its enum constant
+#define QUESTION_NAME_LENGTH 32
+
+/**
+ * @brief Write a string as a C string literal
+ *
+ * Everything outside printable ASCII is written as an octal escape, so the
+ * literal is the same bytes whatever the charset of the compiler. Question
+ * marks are escaped too, as they could form trigraphs.
+ *
+ * @param output The stream
+ * @param text The string
+ */
+static void emit_string(FILE *output, const char *text)
+{
+    fputc('"', output);
+
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\' || *c == '?')
+        {
+            fprintf(output, "\\%c", *c);
+        }
+        else if (*c < 0x20 || *c >= 0x7f)
+        {
+            fprintf(output, "\\%03o", *c);
+        }
+        else
+        {
+            fputc(*c, output);
+        }
+    }
+
+    fputc('"', output);
+}
+
+/**
+ * @brief Write the enum constant of a question
+ *
+ * The id keeps the constant unique and the text, reduced to upper case
+ * letters, digits and underscores, keeps it readable.
+ *
+ * @param output The stream
+ * @param upper_prefix The prefix of the constant
+ * @param id The id of the question
+ * @param question The text of the question
+ */
+static void emit_question_name(FILE *output, const char *upper_prefix, size_t id, const char *question)
+{
+    char name[QUESTION_NAME_LENGTH + 1];
+    size_t length = 0;
+    bool separator = true;
+
+    for (const unsigned char *c = (const unsigned char *)question; *c && length < QUESTION_NAME_LENGTH; c++)
+    {
+        if (isalnum(*c) && *c < 0x80)
+        {
+            name[length++] = (char)toupper(*c);
+            separator = false;
+        }
+        else if (!separator)
+        {
+            name[length++] = '_';
+            separator = true;
+        }
+    }
+    while (length > 0 && name[length - 1] == '_')
+    {
+        length--;
+    }
+    name[length] = '\0';
+
+    fprintf(output, "%s_Q%zu%s%s", upper_prefix, id, length ? "_" : "", name);
+}
+
+/**
+ * @brief Write the constant tables and the identification function
+ *
+ * @param tree The tree
+ * @param trie The decision trie of the tree
+ * @param order The species in depth-first order
+ * @param first Where the species of each node start in the order
+ * @param num_own The number of species ending at each node
+ * @param num_below The number of species at or below each node
+ * @param prefix The prefix of the generated names
+ * @param upper_prefix The prefix in upper case
+ * @param output The stream
+ */
+static void emit_source(
+    const DicotomicTree *tree,
+    const DecisionTrie *trie,
+    const size_t *order,
+    const size_t *first,
+    const size_t *num_own,
+    const size_t *num_below,
+    const char *prefix,
+    const char *upper_prefix,
+    FILE *output)
+{
+    fprintf(output, "/* Generated by dicotodir from the tree \"");
+    for (const char *c = tree->name; *c; c++)
+    {
+        // Keep the comment closed whatever the name holds
+        fputc((*c == '*' || *c == '\n') ? '_' : *c, output);
+    }
+    fprintf(output, "\". Do not edit. */\n\n");
+    fprintf(output, "#include <stddef.h>\n#include <stdint.h>\n\n");
+
+    fprintf(output, "enum\n{\n");
+    for (size_t i = 0; i < tree->num_questions; i++)
+    {
+        fprintf(output, "    ");
+        emit_question_name(output, upper_prefix, i, tree->questions[i]);
+        fprintf(output, " = %zu,\n", i);
+    }
+    fprintf(output, "    %s_NUM_QUESTIONS = %zu,\n", upper_prefix, tree->num_questions);
+    fprintf(output, "    %s_NUM_SPECIES = %zu\n};\n\n", upper_prefix, tree->num_species);
+
+    fprintf(output, "const char *const %s_questions[%s_NUM_QUESTIONS + 1] = {\n", prefix, upper_prefix);
+    for (size_t i = 0; i < tree->num_questions; i++)
+    {
+        fprintf(output, "    ");
+        emit_string(output, tree->questions[i]);
+        fprintf(output, ",\n");
+    }
+    fprintf(output, "    NULL};\n\n");
+
+    fprintf(output, "/* In depth-first order, so the candidates of every node are consecutive */\n");
+    fprintf(output, "const char *const %s_species[%s_NUM_SPECIES + 1] = {\n", prefix, upper_prefix);
+    for (size_t i = 0; i < tree->num_species; i++)
+    {
+        fprintf(output, "    ");
+        emit_string(output, tree->species[order[i]].name);
+        fprintf(output, ",\n");
+    }
+    fprintf(output, "    NULL};\n\n");
+
+    fprintf(output, "#define %s_NONE UINT32_MAX\n\n", upper_prefix);
+    fprintf(output, "static const struct\n{\n");
+    fprintf(output, "    uint32_t question;\n    uint8_t answer;\n    uint32_t first_child;\n");
+    fprintf(output, "    uint32_t next_sibling;\n    uint32_t first;\n    uint32_t num_own;\n");
+    fprintf(output, "    uint32_t num_below;\n} %s_nodes[%zu] = {\n", prefix, trie->num_nodes);
+    for (size_t i = 0; i < trie->num_nodes; i++)
+    {
+        const DecisionNode *node = &trie->nodes[i];
+        fprintf(output, "    {%zu, %d, ", i == 0 ? (size_t)0 : (size_t)node->question, node->answer ? 1 : 0);
+
+        if (node->first_child == DECISION_TRIE_NONE)
+        {
+            fprintf(output, "%s_NONE, ", upper_prefix);
+        }
+        else
+        {
+            fprintf(output, "%zu, ", node->first_child);
+        }
+
+        if (node->next_sibling == DECISION_TRIE_NONE)
+        {
+            fprintf(output, "%s_NONE, ", upper_prefix);
+        }
+        else
+        {
+            fprintf(output, "%zu, ", node->next_sibling);
+        }
+
+        fprintf(output, "%zu, %zu, %zu},\n", first[i], num_own[i], num_below[i]);
+    }
+    fprintf(output, "};\n\n");
+
+    fprintf(output,
+            "/*\n"
+            " * Identify a species from its answers: answers[q] is -1 when question q is\n"
+            " * unanswered, 0 for no and 1 for yes. Returns the number of candidates,\n"
+            " * found at %s_species[*first] onwards. When an unanswered question stops\n"
+            " * the search, every species below that point is a candidate.\n"
+            " */\n",
+            prefix);
+    fprintf(output, "size_t %s_identify(const signed char *answers, size_t *first)\n{\n", prefix);
+    fprintf(output,
+            "    uint32_t node = 0;\n"
+            "    int unanswered;\n"
+            "\n"
+            "    for (;;)\n"
+            "    {\n"
+            "        uint32_t next = %s_NONE;\n"
+            "        uint32_t child;\n"
+            "        unanswered = 0;\n"
+            "\n"
+            "        for (child = %s_nodes[node].first_child; child != %s_NONE; child = %s_nodes[child].next_sibling)\n"
+            "        {\n"
+            "            signed char answer = answers[%s_nodes[child].question];\n"
+            "            if (answer < 0)\n"
+            "            {\n"
+            "                unanswered = 1;\n"
+            "            }\n"
+            "            else if ((answer != 0) == (%s_nodes[child].answer != 0))\n"
+            "            {\n"
+            "                next = child;\n"
+            "                break;\n"
+            "            }\n"
+            "        }\n"
+            "\n"
+            "        if (next == %s_NONE)\n"
+            "        {\n"
+            "            break;\n"
+            "        }\n"
+            "        node = next;\n"
+            "    }\n"
+            "\n"
+            "    *first = %s_nodes[node].first;\n"
+            "    return unanswered ? %s_nodes[node].num_below : %s_nodes[node].num_own;\n"
+            "}\n",
+            upper_prefix, prefix, upper_prefix, prefix, prefix, prefix, upper_prefix, prefix, prefix, prefix);
+}
+
+StatusCode emit_classifier(const DicotomicTree *tree, const char *prefix, FILE *output)
+{
+    if (!tree || !prefix || !output)
+    {
+        logger_error("Invalid arguments for emitting a classifier");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    DecisionTrie *trie = decision_trie_build(tree);
+    if (!trie)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // The generated tables index nodes and species with 32 bits
+    if (trie->num_nodes >= UINT32_MAX || tree->num_species >= UINT32_MAX || tree->num_questions >= UINT32_MAX)
+    {
+        logger_error("The tree '%s' is too large to emit as C", tree->name);
+        decision_trie_free(trie);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    size_t num_nodes = trie->num_nodes;
+    size_t *order = malloc((tree->num_species ? tree->num_species : 1) * sizeof(size_t));
+    size_t *first = malloc(num_nodes * sizeof(size_t));
+    size_t *num_own = malloc(num_nodes * sizeof(size_t));
+    size_t *num_below = malloc(num_nodes * sizeof(size_t));
+    char *upper_prefix = malloc(strlen(prefix) + 1);
+
+    StatusCode error = SUCCESS;
+    if (!order || !first || !num_own || !num_below || !upper_prefix)
+    {
+        logger_error("Failed to allocate memory for the classifier");
+        error = ERROR_MEMORY_ALLOCATION;
+    }
+    else
+    {
+        size_t length = 0;
+        for (; prefix[length]; length++)
+        {
+            upper_prefix[length] = (char)toupper((unsigned char)prefix[length]);
+        }
+        upper_prefix[length] = '\0';
+
+        decision_trie_order_species(trie, order, first, num_own, num_below);
+        emit_source(tree, trie, order, first, num_own, num_below, prefix, upper_prefix, output);
+
+        if (ferror(output))
+        {
+            logger_error("Failed to write the classifier");
+            error = ERROR_FILE_CREATION;
+        }
+    }
+
+    free(order);
+    free(first);
+    free(num_own);
+    free(num_below);
+    free(upper_prefix);
+    decision_trie_free(trie);
+
+    return error;
+}
@@ -0,0 +1,33 @@
+#ifndef EMIT_CLASSIFIER_H
+#define EMIT_CLASSIFIER_H
+
+#include "../domain/dicotomic_tree.h"
+#include "../../../include/common/types.h"
+
+#include <stdio.h>
+
+/**
+ * @brief Write a standalone C source file that identifies species of a tree
+ *
+ * The decision trie of the tree is baked into constant tables, so the
+ * generated code parses nothing and allocates nothing. For a prefix p it
+ * defines:
+ *
+ * - an enum P_Q<id>_<QUESTION> with the id of each question, and
+ *   P_NUM_QUESTIONS and P_NUM_SPECIES;
+ * - p_questions and p_species, the texts of the questions and the names of
+ *   the species, each followed by NULL;
+ * - size_t p_identify(const signed char *answers, size_t *first), which
+ *   takes an answer per question (-1 unanswered, 0 no, 1 yes) and returns
+ *   the number of candidates, p_species[*first] onwards.
+ *
+ * The candidates are the same classify_observations finds.
+ *
+ * @param tree The tree, already validated
+ * @param prefix The prefix of the generated names, a C identifier
+ * @param output The stream the source is written to
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode emit_classifier(const DicotomicTree *tree, const char *prefix, FILE *output);
+
+#endif /* EMIT_CLASSIFIER_H */
@@ -0,0 +1,267 @@
+#include "index_species.h"
+#include "../../../include/common/logger.h"
+#include "../../../include/common/parallel.h"
+#include "../../../include/common/utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Species whose paths are built by a thread each time it takes work
+#define SPECIES_PER_TASK 4096
+
+// Share of trigrams a name needs in common with a search to be found
+#define SEARCH_MIN_SIMILARITY 0.3
+
+// Names found by a search in each index
+#define SEARCH_MAX_NAMES 10
+
+/**
+ * @brief The species of several trees being indexed
+ *
+ * Species are numbered across the trees, those of tree i starting at
+ * first_species[i].
+ */
+typedef struct
+{
+    DicotomicTree *const *trees;
+    int num_trees;
+    const size_t *first_species;
+    size_t num_species;
+    const DirectoryCreationConfig *config;
+    SpeciesIndexEntry *entries;
+    bool failed;
+} Indexing;
+
+static void build_paths_task(void *context, size_t index)
+{
+    Indexing *indexing = context;
+    size_t first = index * SPECIES_PER_TASK;
+    size_t end = first + SPECIES_PER_TASK < indexing->num_species ? first + SPECIES_PER_TASK : indexing->num_species;
+
+    int tree = 0;
+    for (size_t i = first; i < end; i++)
+    {
+        while (indexing->first_species[tree + 1] <= i)
+        {
+            tree++;
+        }
+
+        const DicotomicTree *species_tree = indexing->trees[tree];
+        const Species *species = &species_tree->species[i - indexing->first_species[tree]];
+        char *path = species_file_path(species_tree, species, species_tree->name, indexing->config);
+
+        if (!path)
+        {
+            __atomic_store_n(&indexing->failed, true, __ATOMIC_RELAXED);
+            return;
+        }
+
+        indexing->entries[i].name = species->name;
+        indexing->entries[i].path = path;
+    }
+}
+
+StatusCode index_species(
+    DicotomicTree *const *trees,
+    int num_trees,
+    const DirectoryCreationConfig *config,
+    const SpeciesIndexPort *species_index)
+{
+    if (!trees || num_trees < 0 || !config || !config->index_path || !species_index)
+    {
+        logger_error("Invalid trees or index path");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    size_t *first_species = malloc(((size_t)num_trees + 1) * sizeof(size_t));
+    if (!first_species)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    first_species[0] = 0;
+    for (int i = 0; i < num_trees; i++)
+    {
+        first_species[i + 1] = first_species[i] + trees[i]->num_species;
+    }
+
+    Indexing indexing = {
+        .trees = trees,
+        .num_trees = num_trees,
+        .first_species = first_species,
+        .num_species = first_species[num_trees],
+        .config = config,
+        .entries = calloc(first_species[num_trees] ? first_species[num_trees] : 1, sizeof(SpeciesIndexEntry)),
+        .failed = false};
+
+    if (!indexing.entries)
+    {
+        free(first_species);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    int num_threads = (config->num_threads > 0) ? config->num_threads : parallel_available_threads();
+    size_t num_tasks = (indexing.num_species + SPECIES_PER_TASK - 1) / SPECIES_PER_TASK;
+    parallel_for(num_tasks, num_threads, build_paths_task, &indexing);
+
+    StatusCode error = SUCCESS;
+    if (indexing.failed)
+    {
+        logger_error("Failed to allocate memory for the paths of the species");
+        error = ERROR_MEMORY_ALLOCATION;
+    }
+    else
+    {
+        error = species_index->save(
+            indexing.entries, indexing.num_species, config->index_trigrams, config->index_path);
+    }
+
+    for (size_t i = 0; i < indexing.num_species; i++)
+    {
+        free((char *)indexing.entries[i].path);
+    }
+    free(indexing.entries);
+    free(first_species);
+
+    return error;
+}
+
+static void print_path(void *context, const char *path)
+{
+    fprintf((FILE *)context, "%s\n", path);
+}
+
+StatusCode lookup_species(
+    char *const *index_paths,
+    int num_indexes,
+    const char *name,
+    const SpeciesIndexPort *species_index,
+    FILE *output,
+    size_t *num_matches)
+{
+    StatusCode error = SUCCESS;
+    *num_matches = 0;
+
+    for (int i = 0; i < num_indexes && error == SUCCESS; i++)
+    {
+        size_t found = 0;
+        error = species_index->lookup(index_paths[i], name, print_path, output, &found);
+        *num_matches += found;
+    }
+
+    return error;
+}
+
+/**
+ * @brief A path found by a search, copied out of its index
+ */
+typedef struct
+{
+    char *name;
+    char *path;
+    double similarity;
+    size_t order; // The order it was found in, for species alike
+} FoundSpecies;
+
+/**
+ * @brief The paths found by a search in every index
+ */
+typedef struct
+{
+    FoundSpecies *found;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} Search;
+
+static void add_found(void *context, const char *name, const char *path, double similarity)
+{
+    Search *search = context;
+
+    if (search->count == search->capacity)
+    {
+        size_t capacity = search->capacity ? search->capacity * 2 : 16;
+        FoundSpecies *grown = realloc(search->found, capacity * sizeof(FoundSpecies));
+        if (!grown)
+        {
+            search->failed = true;
+            return;
+        }
+        search->found = grown;
+        search->capacity = capacity;
+    }
+
+    FoundSpecies *found = &search->found[search->count];
+    found->name = my_strdup(name);
+    found->path = my_strdup(path);
+    found->similarity = similarity;
+    found->order = search->count;
+    search->count++;
+
+    if (!found->name || !found->path)
+    {
+        search->failed = true;
+    }
+}
+
+static int compare_found(const void *a, const void *b)
+{
+    const FoundSpecies *first = a;
+    const FoundSpecies *second = b;
+
+    if (first->similarity != second->similarity)
+    {
+        return first->similarity > second->similarity ? -1 : 1;
+    }
+
+    int order = strcmp(first->name, second->name);
+    if (order != 0)
+    {
+        return order;
+    }
+    return first->order < second->order ? -1 : (first->order > second->order);
+}
+
+StatusCode search_species(
+    char *const *index_paths,
+    int num_indexes,
+    const char *text,
+    const SpeciesIndexPort *species_index,
+    FILE *output,
+    size_t *num_found)
+{
+    Search search = {NULL, 0, 0, false};
+    StatusCode error = SUCCESS;
+    *num_found = 0;
+
+    for (int i = 0; i < num_indexes && error == SUCCESS; i++)
+    {
+        size_t found = 0;
+        error = species_index->search(
+            index_paths[i], text, SEARCH_MIN_SIMILARITY, SEARCH_MAX_NAMES, add_found, &search, &found);
+        *num_found += found;
+
+        if (error == SUCCESS && search.failed)
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    if (error == SUCCESS && search.count > 0)
+    {
+        qsort(search.found, search.count, sizeof(FoundSpecies), compare_found);
+        for (size_t i = 0; i < search.count; i++)
+        {
+            fprintf(output, "%.2f\t%s\t%s\n", search.found[i].similarity, search.found[i].name, search.found[i].path);
+        }
+    }
+
+    for (size_t i = 0; i < search.count; i++)
+    {
+        free(search.found[i].name);
+        free(search.found[i].path);
+    }
+    free(search.found);
+
+    return error;
+}
@@ -0,0 +1,76 @@
+#ifndef INDEX_SPECIES_H
+#define INDEX_SPECIES_H
+
+#include "create_directory_structure.h"
+#include "../domain/dicotomic_tree.h"
+#include "../ports/species_index_port.h"
+#include "../../../include/common/types.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Write the index of the species of several trees
+ *
+ * Each species is indexed by its name with the path of its file relative to
+ * the root directory, <tree>/<directories>/<species>.txt, as created with
+ * the same configuration. Paths are built on several threads. With
+ * index_trigrams set the trigrams of the names are stored too, so the index
+ * can be searched with search_species.
+ *
+ * @param trees The dicotomic trees
+ * @param num_trees The number of trees
+ * @param config The configuration for directory creation, with the path of the index
+ * @param species_index The species index implementation
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode index_species(
+    DicotomicTree *const *trees,
+    int num_trees,
+    const DirectoryCreationConfig *config,
+    const SpeciesIndexPort *species_index);
+
+/**
+ * @brief Print the paths of a species name in several indexes, one per line
+ *
+ * @param index_paths The paths of the indexes
+ * @param num_indexes The number of indexes
+ * @param name The species name
+ * @param species_index The species index implementation
+ * @param output The stream the paths are written to
+ * @param num_matches Pointer to store the number of paths written
+ * @return StatusCode SUCCESS if every index could be read, an error code otherwise
+ */
+StatusCode lookup_species(
+    char *const *index_paths,
+    int num_indexes,
+    const char *name,
+    const SpeciesIndexPort *species_index,
+    FILE *output,
+    size_t *num_matches);
+
+/**
+ * @brief Print the species whose names are most like a text in several indexes
+ *
+ * Names are ranked across the indexes by the trigrams they share with the
+ * text, and each path is printed on its own line as
+ * <similarity>\t<name>\t<path>. Names sharing under 30% of their trigrams
+ * are left out, and each index gives its 10 best names at most.
+ *
+ * @param index_paths The paths of the indexes, written with trigrams
+ * @param num_indexes The number of indexes
+ * @param text The text, usually a misspelled name
+ * @param species_index The species index implementation
+ * @param output The stream the species are written to
+ * @param num_found Pointer to store the number of names found
+ * @return StatusCode SUCCESS if every index could be searched, an error code otherwise
+ */
+StatusCode search_species(
+    char *const *index_paths,
+    int num_indexes,
+    const char *text,
+    const SpeciesIndexPort *species_index,
+    FILE *output,
+    size_t *num_found);
+
+#endif /* INDEX_SPECIES_H */
@@ -0,0 +1,82 @@
+#include "optimize_question_order.h"
+#include "../domain/question_order.h"
+#include "../../../include/common/logger.h"
+
+#include <stdlib.h>
+
+static void log_shape(const DicotomicTree *tree, const char *label, const KeyShape *shape)
+{
+    logger_info("Tree '%s' %s: %zu directories, %.2f questions on average to identify a species, depth %zu",
+                tree->name,
+                label,
+                shape->num_directories,
+                shape->average_depth,
+                shape->max_depth);
+
+    if (shape->num_mixed > 0)
+    {
+        logger_warning("Tree '%s' %s: %zu directories have subdirectories of more than one question",
+                       tree->name,
+                       label,
+                       shape->num_mixed);
+    }
+}
+
+StatusCode optimize_question_order(DicotomicTree *tree, int num_threads)
+{
+    if (!tree)
+    {
+        logger_error("Invalid tree");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    size_t num_questions = tree->num_questions;
+    QuestionId *order = malloc((num_questions ? num_questions : 1) * sizeof(QuestionId));
+    QuestionId *inverse = malloc((num_questions ? num_questions : 1) * sizeof(QuestionId));
+    if (!order || !inverse)
+    {
+        free(order);
+        free(inverse);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    KeyShape before;
+    KeyShape after;
+    StatusCode error = SUCCESS;
+
+    if (!question_order_measure(tree, &before) || !question_order_optimize(tree, num_threads, order) ||
+        !dicotomic_tree_reorder_questions(tree, order) || !question_order_measure(tree, &after))
+    {
+        error = ERROR_MEMORY_ALLOCATION;
+    }
+    else
+    {
+        log_shape(tree, "before", &before);
+        log_shape(tree, "after", &after);
+
+        // The greedy order is not always better; undo it when it mixes
+        // questions in a directory, adds directories or is deeper
+        if (after.num_mixed > before.num_mixed || after.num_directories > before.num_directories ||
+            after.average_depth > before.average_depth)
+        {
+            for (size_t i = 0; i < num_questions; i++)
+            {
+                inverse[order[i]] = (QuestionId)i;
+            }
+
+            if (!dicotomic_tree_reorder_questions(tree, inverse))
+            {
+                error = ERROR_MEMORY_ALLOCATION;
+            }
+            else
+            {
+                logger_info("Tree '%s' keeps its question order", tree->name);
+            }
+        }
+    }
+
+    free(order);
+    free(inverse);
+
+    return error;
+}
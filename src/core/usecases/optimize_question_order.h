@@ -0,0 +1,22 @@
+#ifndef OPTIMIZE_QUESTION_ORDER_H
+#define OPTIMIZE_QUESTION_ORDER_H
+
+#include "../domain/dicotomic_tree.h"
+#include "../../../include/common/types.h"
+
+/**
+ * @brief Reorder the questions of a tree so species are identified sooner
+ *
+ * The directories and the average number of questions needed to identify a
+ * species are reported before and after. The new order is kept only if it
+ * asks a single question in as many directories as before, creates no more
+ * directories and identifies species at least as soon; otherwise the tree
+ * is left as it was.
+ *
+ * @param tree The tree, already validated
+ * @param num_threads The number of threads, 0 for one per processor
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode optimize_question_order(DicotomicTree *tree, int num_threads);
+
+#endif /* OPTIMIZE_QUESTION_ORDER_H */
@@ -0,0 +1,69 @@
+#include "query_species.h"
+#include "../domain/species_bitsets.h"
+#include "../../../include/common/logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+StatusCode print_candidate_species(
+    DicotomicTree *const *trees,
+    int num_trees,
+    char *const *questions,
+    const bool *answers,
+    int num_answers)
+{
+    QuestionAnswer *known = malloc((num_answers > 0 ? (size_t)num_answers : 1) * sizeof(QuestionAnswer));
+    if (!known)
+    {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    StatusCode error = SUCCESS;
+
+    for (int i = 0; i < num_trees && error == SUCCESS; i++)
+    {
+        const DicotomicTree *tree = trees[i];
+
+        // Answers are matched by question id, so translate them for each tree
+        size_t num_known = 0;
+        for (int j = 0; j < num_answers; j++)
+        {
+            QuestionId id;
+            if (!dicotomic_tree_find_question(tree, questions[j], &id))
+            {
+                logger_warning("Question '%s' is not in tree '%s'", questions[j], tree->name);
+                continue;
+            }
+            known[num_known].question = id;
+            known[num_known].answer = answers[j];
+            num_known++;
+        }
+
+        SpeciesBitsets *bitsets = species_bitsets_build(tree);
+        uint64_t *candidates = bitsets ? malloc((bitsets->num_words ? bitsets->num_words : 1) * sizeof(uint64_t)) : NULL;
+        if (!candidates)
+        {
+            species_bitsets_free(bitsets);
+            error = ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+
+        size_t count = species_bitsets_match(bitsets, known, num_known, candidates);
+        for (size_t w = 0; w < bitsets->num_words; w++)
+        {
+            // Visit only the set bits, candidates are usually few
+            for (uint64_t bits = candidates[w]; bits != 0; bits &= bits - 1)
+            {
+                size_t species = w * 64 + (size_t)__builtin_ctzll(bits);
+                printf("%s/%s\n", tree->name, tree->species[species].name);
+            }
+        }
+        logger_info("%zu of %zu species of tree '%s' match the answers", count, tree->num_species, tree->name);
+
+        free(candidates);
+        species_bitsets_free(bitsets);
+    }
+
+    free(known);
+    return error;
+}
@@ -0,0 +1,29 @@
+#ifndef QUERY_SPECIES_H
+#define QUERY_SPECIES_H
+
+#include "../domain/dicotomic_tree.h"
+#include "../../../include/common/types.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Print the species of each tree that do not contradict some answers
+ *
+ * Each candidate is printed on its own line as <tree>/<species>. Questions a
+ * tree does not have are reported and rule out none of its species.
+ *
+ * @param trees The dicotomic trees
+ * @param num_trees The number of trees
+ * @param questions The questions answered
+ * @param answers The answer to each question
+ * @param num_answers The number of answers
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+StatusCode print_candidate_species(
+    DicotomicTree *const *trees,
+    int num_trees,
+    char *const *questions,
+    const bool *answers,
+    int num_answers);
+
+#endif /* QUERY_SPECIES_H */
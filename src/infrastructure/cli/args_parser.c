@@ -9,22 +9,127 @@
 
 void print_usage(void)
 {
-    printf("Usage: dicotodir <clave> [-d|--dir <raiz>] [-t|--true <p1>] [-f|--false <p2>] [-p|--pre] [-s|--suf]\n");
+    printf("Usage: dicotodir <clave>... [-d|--dir <raiz>] [-t|--true <p1>] [-f|--false <p2>] [-p|--pre] [-s|--suf] [-m|--multi] [-S|--stream] [-j|--jobs <n>] [-c|--compile <imagen>] [-C|--cache] [-n|--ndjson] [-q|--query <pregunta=si|no>]... [-k|--classify <observaciones>] [-e|--emit-c <fuente.c>] [-O|--optimize-order] [-D|--diagnose] [-x|--index <indice>] [-T|--trigrams] [-u|--io-uring] [-w|--work-stealing]\n");
+    printf("       dicotodir <indice>... -l|--lookup <especie> | -z|--search <texto>\n");
     printf("Options:\n");
-    printf("  <clave>              JSON file containing the dicotomic key\n");
+    printf("  <clave>...           JSON files or compiled images containing dicotomic keys ('-' reads one from standard input)\n");
     printf("  -d, --dir <raiz>     Directory where to create the directory structure (default: current directory)\n");
     printf("  -t, --true <p1>      Text to concatenate to questions for true answers (default: \"si tiene\")\n");
     printf("  -f, --false <p2>     Text to concatenate to questions for false answers (default: \"no tiene\")\n");
     printf("  -p, --pre            Concatenate texts as prefixes (default: active)\n");
     printf("  -s, --suf            Concatenate texts as suffixes (default: inactive)\n");
     printf("  -m, --multi          Use multiple processes to create the directory structure\n");
+    printf("  -S, --stream         Create directories while the key is read, keeping one species in memory\n");
+    printf("  -j, --jobs <n>       Parse keys and create directories with n threads, 0 for one per processor (default: 1)\n");
+    printf("  -c, --compile <img>  Write the key as a compiled image to <img> instead of creating directories\n");
+    printf("  -C, --cache          Keep a compiled image next to the key and reuse it while the key is unchanged\n");
+    printf("  -n, --ndjson         Read keys as NDJSON, one record per line (default for .ndjson and .jsonl files)\n");
+    printf("  -q, --query <p=r>    List the species that do not contradict the answer r (si or no) to question p, repeatable\n");
+    printf("  -k, --classify <obs> Identify the species of each observation of <obs> (CSV or NDJSON, '-' for standard input)\n");
+    printf("  -e, --emit-c <src>   Write a C source that identifies species of the key without parsing it\n");
+    printf("  -O, --optimize-order Reorder the questions so species are identified sooner, reporting the change\n");
+    printf("  -D, --diagnose       List duplicate species, prefix paths and constant answers instead of creating directories\n");
+    printf("  -x, --index <idx>    Write an index of the species to <idx> after creating directories\n");
+    printf("  -T, --trigrams       Store the trigrams of the names in the index, so it can be searched with -z\n");
+    printf("  -u, --io-uring       Create directories in batches through io_uring, one at a time if the kernel lacks it\n");
+    printf("  -w, --work-stealing  Create each species as a task of the -j threads, which steal tasks from each other\n");
+    printf("  -l, --lookup <name>  Print the path of the species <name> in each index given instead of keys\n");
+    printf("  -z, --search <text>  Print the species whose names are most like <text> in each index given instead of keys\n");
     printf("  -h, --help           Show this help message\n");
 }
 
+/**
+ * @brief Add a query answer given as "question=answer" to the configuration
+ *
+ * @param config The configuration
+ * @param query The query answer
+ * @return bool true if successful, false if the answer is invalid or memory allocation failed
+ */
+static bool add_query(DirectoryCreationConfig *config, const char *query)
+{
+    // Questions may hold '=', answers never do
+    const char *separator = strrchr(query, '=');
+    if (!separator || separator == query)
+    {
+        logger_error("Invalid query answer, expected <question>=si|no: %s", query);
+        return false;
+    }
+
+    const char *value = separator + 1;
+    bool answer;
+    if (strcmp(value, "si") == 0 || strcmp(value, "true") == 0)
+    {
+        answer = true;
+    }
+    else if (strcmp(value, "no") == 0 || strcmp(value, "false") == 0)
+    {
+        answer = false;
+    }
+    else
+    {
+        logger_error("Invalid answer '%s' in query, expected si or no", value);
+        return false;
+    }
+
+    size_t count = (size_t)config->num_queries + 1;
+    char **new_questions = realloc(config->query_questions, count * sizeof(char *));
+    if (new_questions)
+    {
+        config->query_questions = new_questions;
+    }
+    bool *new_answers = realloc(config->query_answers, count * sizeof(bool));
+    if (new_answers)
+    {
+        config->query_answers = new_answers;
+    }
+
+    size_t length = (size_t)(separator - query);
+    char *question = malloc(length + 1);
+    if (!new_questions || !new_answers || !question)
+    {
+        logger_error("Failed to allocate memory for query");
+        free(question);
+        return false;
+    }
+
+    memcpy(question, query, length);
+    question[length] = '\0';
+    config->query_questions[config->num_queries] = question;
+    config->query_answers[config->num_queries] = answer;
+    config->num_queries++;
+
+    return true;
+}
+
+void free_queries(DirectoryCreationConfig *config)
+{
+    for (int i = 0; i < config->num_queries; i++)
+    {
+        free(config->query_questions[i]);
+    }
+    free(config->query_questions);
+    free(config->query_answers);
+
+    config->query_questions = NULL;
+    config->query_answers = NULL;
+    config->num_queries = 0;
+    config->classify_path = NULL;
+    config->emit_path = NULL;
+    config->optimize_order = false;
+    config->diagnose = false;
+    config->index_path = NULL;
+    config->lookup_name = NULL;
+    config->index_trigrams = false;
+    config->search_text = NULL;
+    config->use_io_uring = false;
+    config->use_work_stealing = false;
+}
+
 StatusCode parse_args(
     int argc,
     char *argv[],
-    char **json_file_path,
+    char ***key_paths,
+    int *num_keys,
     DirectoryCreationConfig *config)
 {
     // Define long options
@@ -35,6 +140,22 @@ StatusCode parse_args(
         {"pre", no_argument, 0, 'p'},
         {"suf", no_argument, 0, 's'},
         {"multi", no_argument, 0, 'm'},
+        {"stream", no_argument, 0, 'S'},
+        {"jobs", required_argument, 0, 'j'},
+        {"compile", required_argument, 0, 'c'},
+        {"cache", no_argument, 0, 'C'},
+        {"ndjson", no_argument, 0, 'n'},
+        {"query", required_argument, 0, 'q'},
+        {"classify", required_argument, 0, 'k'},
+        {"emit-c", required_argument, 0, 'e'},
+        {"optimize-order", no_argument, 0, 'O'},
+        {"diagnose", no_argument, 0, 'D'},
+        {"index", required_argument, 0, 'x'},
+        {"lookup", required_argument, 0, 'l'},
+        {"trigrams", no_argument, 0, 'T'},
+        {"search", required_argument, 0, 'z'},
+        {"io-uring", no_argument, 0, 'u'},
+        {"work-stealing", no_argument, 0, 'w'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}};
 
@@ -44,12 +165,20 @@ StatusCode parse_args(
     config->false_text = "no tiene";
     config->concat_mode = PREFIX_MODE;
     config->use_multiple_processes = false;
+    config->stream_input = false;
+    config->num_threads = 1;
+    config->compile_path = NULL;
+    config->use_cache = false;
+    config->ndjson_input = false;
+    config->query_questions = NULL;
+    config->query_answers = NULL;
+    config->num_queries = 0;
 
     int option_index = 0;
     int c;
 
     // Parse options
-    while ((c = getopt_long(argc, argv, "d:t:f:psmh", long_options, &option_index)) != -1)
+    while ((c = getopt_long(argc, argv, "d:t:f:psmSj:c:Cnq:k:e:ODx:l:Tz:uwh", long_options, &option_index)) != -1)
     {
         switch (c)
         {
@@ -71,6 +200,68 @@ StatusCode parse_args(
         case 'm':
             config->use_multiple_processes = true;
             break;
+        case 'S':
+            config->stream_input = true;
+            break;
+        case 'j':
+        {
+            char *end;
+            long jobs = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || jobs < 0 || jobs > 1024)
+            {
+                logger_error("Invalid number of threads: %s", optarg);
+                print_usage();
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            config->num_threads = (int)jobs;
+            break;
+        }
+        case 'c':
+            config->compile_path = optarg;
+            break;
+        case 'C':
+            config->use_cache = true;
+            break;
+        case 'n':
+            config->ndjson_input = true;
+            break;
+        case 'q':
+            if (!add_query(config, optarg))
+            {
+                print_usage();
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            break;
+        case 'k':
+            config->classify_path = optarg;
+            break;
+        case 'e':
+            config->emit_path = optarg;
+            break;
+        case 'O':
+            config->optimize_order = true;
+            break;
+        case 'D':
+            config->diagnose = true;
+            break;
+        case 'x':
+            config->index_path = optarg;
+            break;
+        case 'l':
+            config->lookup_name = optarg;
+            break;
+        case 'T':
+            config->index_trigrams = true;
+            break;
+        case 'z':
+            config->search_text = optarg;
+            break;
+        case 'u':
+            config->use_io_uring = true;
+            break;
+        case 'w':
+            config->use_work_stealing = true;
+            break;
         case 'h':
             print_usage();
             return ERROR_INVALID_ARGUMENTS;
@@ -98,13 +289,136 @@ StatusCode parse_args(
         return ERROR_INVALID_ARGUMENTS;
     }
 
-    // Get JSON file path
-    *json_file_path = my_strdup(argv[optind]);
-    if (!*json_file_path)
+    int count = argc - optind;
+    bool from_stdin = false;
+
+    for (int i = optind; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-") == 0)
+        {
+            from_stdin = true;
+        }
+    }
+
+    // Lookups and searches read indexes, not keys, and are the only output
+    if ((config->lookup_name || config->search_text) &&
+        ((config->lookup_name && config->search_text) || from_stdin || config->stream_input ||
+         config->compile_path || config->num_queries > 0 || config->classify_path || config->emit_path ||
+         config->diagnose || config->optimize_order || config->index_path))
+    {
+        logger_error("A lookup or search reads index files and cannot be combined with other outputs");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // Standard input can only be read once, so it is always streamed
+    if (from_stdin)
+    {
+        if (count > 1)
+        {
+            logger_error("Standard input cannot be read along with other keys");
+            return ERROR_INVALID_ARGUMENTS;
+        }
+        config->stream_input = true;
+    }
+
+    // Streamed keys are never held whole, so there is no tree to compile
+    if (config->compile_path && config->stream_input)
+    {
+        logger_error("A streamed key cannot be compiled");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // Tasks are taken from whole trees, and species get either threads or processes
+    if (config->use_work_stealing && (config->stream_input || config->use_multiple_processes))
+    {
+        logger_error("Work stealing cannot be combined with streaming or multiple processes");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // Batches hold the levels of the decision tries, which species created one at a time never walk
+    if (config->use_io_uring &&
+        (config->stream_input || config->use_multiple_processes || config->use_work_stealing))
+    {
+        logger_error("io_uring batches cannot be combined with streaming, multiple processes or work stealing");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // The order is chosen from every species, so it needs the whole tree
+    if (config->optimize_order && config->stream_input)
+    {
+        logger_error("The question order of a streamed key cannot be optimized");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // Queries read the species of whole trees and create nothing
+    if (config->num_queries > 0 && (config->stream_input || config->compile_path))
+    {
+        logger_error("A query cannot be combined with streaming or compiling");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // Observations are classified against a whole tree and create nothing
+    if (config->classify_path && (config->stream_input || config->compile_path || config->num_queries > 0))
+    {
+        logger_error("Classifying observations cannot be combined with streaming, compiling or queries");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // The generated source bakes in a whole tree, and is the only output
+    if (config->emit_path &&
+        (config->stream_input || config->compile_path || config->num_queries > 0 || config->classify_path))
+    {
+        logger_error("Emitting C cannot be combined with streaming, compiling, queries or classifying");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // Diagnostics compare every species of a tree and are the only output
+    if (config->diagnose && (config->stream_input || config->compile_path || config->num_queries > 0 ||
+                             config->classify_path || config->emit_path))
     {
-        logger_error("Failed to allocate memory for JSON file path");
+        logger_error("Diagnostics cannot be combined with streaming, compiling, queries, classifying or emitting C");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // The index lists the files created, from whole trees
+    if (config->index_path && (config->stream_input || config->compile_path || config->num_queries > 0 ||
+                               config->classify_path || config->emit_path || config->diagnose))
+    {
+        logger_error("An index is written with the directories, and cannot be combined with other outputs");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    if (config->index_trigrams && !config->index_path)
+    {
+        logger_error("Trigrams are stored in an index, which needs -x");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    // Get JSON file paths
+    *key_paths = malloc((size_t)count * sizeof(char *));
+    if (!*key_paths)
+    {
+        logger_error("Failed to allocate memory for JSON file paths");
         return ERROR_MEMORY_ALLOCATION;
     }
 
+    for (int i = 0; i < count; i++)
+    {
+        (*key_paths)[i] = my_strdup(argv[optind + i]);
+        if (!(*key_paths)[i])
+        {
+            logger_error("Failed to allocate memory for JSON file path");
+
+            for (int j = 0; j < i; j++)
+            {
+                free((*key_paths)[j]);
+            }
+            free(*key_paths);
+            *key_paths = NULL;
+            return ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    *num_keys = count;
+
     return SUCCESS;
 }
\ No newline at end of file
@@ -9,16 +9,25 @@
  *
  * @param argc The argument count
  * @param argv The argument values
- * @param json_file_path Pointer to store the JSON file path
+ * @param key_paths Pointer to store the array of key file paths
+ * @param num_keys Pointer to store the number of key files
  * @param config Pointer to store the directory creation configuration
  * @return StatusCode SUCCESS if successful, an error code otherwise
  */
 StatusCode parse_args(
     int argc,
     char *argv[],
-    char **json_file_path,
+    char ***key_paths,
+    int *num_keys,
     DirectoryCreationConfig *config);
 
+/**
+ * @brief Free the query answers parse_args stored in a configuration
+ *
+ * @param config The configuration
+ */
+void free_queries(DirectoryCreationConfig *config);
+
 /**
  * @brief Print the usage information
  */
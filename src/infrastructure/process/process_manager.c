@@ -1,9 +1,12 @@
+#define _DEFAULT_SOURCE
+
 #include "process_manager.h"
 #include "../../../include/common/logger.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <sys/sysinfo.h>
 
@@ -50,4 +53,25 @@ int get_max_processes(void)
 
     // Use at most num_processors processes
     return (num_processors > 0) ? num_processors : 1;
-}
\ No newline at end of file
+}
+
+void *create_shared_memory(size_t size)
+{
+    // Anonymous pages start zeroed and are only backed once touched
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        logger_error("Failed to allocate %zu bytes of shared memory", size);
+        return NULL;
+    }
+
+    return memory;
+}
+
+void free_shared_memory(void *memory, size_t size)
+{
+    if (memory)
+    {
+        munmap(memory, size);
+    }
+}
@@ -2,6 +2,7 @@
 #define PROCESS_MANAGER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * @brief Create a child process
@@ -24,4 +25,20 @@ bool wait_for_child_processes(void);
  */
 int get_max_processes(void);
 
+/**
+ * @brief Allocate zeroed memory shared with the child processes created afterwards
+ *
+ * @param size The size of the memory
+ * @return void* The memory or NULL if allocation failed
+ */
+void *create_shared_memory(size_t size);
+
+/**
+ * @brief Free memory allocated by create_shared_memory
+ *
+ * @param memory The memory
+ * @param size The size given to create_shared_memory
+ */
+void free_shared_memory(void *memory, size_t size);
+
 #endif /* PROCESS_MANAGER_H */
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,74 +6,578 @@
 #include "../include/common/types.h"
 #include "../include/common/errors.h"
 #include "../include/common/logger.h"
+#include "../include/common/parallel.h"
 
 #include "core/domain/dicotomic_tree.h"
+#include "core/usecases/classify_observations.h"
 #include "core/usecases/create_directory_structure.h"
+#include "core/usecases/diagnose_key.h"
+#include "core/usecases/emit_classifier.h"
+#include "core/usecases/index_species.h"
+#include "core/usecases/optimize_question_order.h"
+#include "core/usecases/query_species.h"
 
+#include "adapters/file_system/io_uring_file_system.h"
 #include "adapters/file_system/unix_file_system.h"
 #include "adapters/parsers/json_parser.h"
+#include "adapters/parsers/key_image.h"
+#include "adapters/parsers/observation_parser.h"
+#include "adapters/parsers/species_index.h"
 
 #include "infrastructure/cli/args_parser.h"
 #include "infrastructure/process/process_manager.h"
 
+/**
+ * @brief Select the parser for a key from the options and its extension
+ *
+ * @param key_path The path of the key
+ * @param config The configuration, for the NDJSON option
+ * @return const JsonParserPort* The parser for the key
+ */
+static const JsonParserPort *select_parser(const char *key_path, const DirectoryCreationConfig *config)
+{
+    const char *extension = strrchr(key_path, '.');
+
+    if (config->ndjson_input ||
+        (extension && (strcmp(extension, ".ndjson") == 0 || strcmp(extension, ".jsonl") == 0)))
+    {
+        return get_ndjson_parser();
+    }
+
+    return get_json_parser();
+}
+
+/**
+ * @brief Identify the species of the observations given on the command line
+ *
+ * Observations in a .csv file are read as CSV with a header row, any other
+ * as NDJSON.
+ *
+ * @param tree The tree to classify the observations against
+ * @param config The configuration, with the path of the observations
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode classify_observation_file(const DicotomicTree *tree, const DirectoryCreationConfig *config)
+{
+    const char *path = config->classify_path;
+    const char *extension = strrchr(path, '.');
+    const ObservationParserPort *parser =
+        (extension && strcmp(extension, ".csv") == 0) ? get_csv_observation_parser() : get_ndjson_observation_parser();
+
+    bool from_stdin = strcmp(path, "-") == 0;
+    FILE *input = from_stdin ? stdin : fopen(path, "r");
+    if (!input)
+    {
+        logger_error("Failed to open observations file: %s", path);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    StatusCode error = classify_observations(tree, input, stdout, parser, config->num_threads);
+
+    if (!from_stdin)
+    {
+        fclose(input);
+    }
+
+    return error;
+}
+
+/**
+ * @brief Write a C source that identifies species of a tree
+ *
+ * The names in the source are prefixed with the base name of the file,
+ * reduced to a C identifier: arboles.c defines arboles_identify.
+ *
+ * @param tree The tree
+ * @param path The path of the source
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode emit_classifier_file(const DicotomicTree *tree, const char *path)
+{
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    // Identifiers cannot start with a digit, nor be empty
+    char prefix[64] = "key_";
+    size_t length = isdigit((unsigned char)base[0]) ? 4 : 0;
+    for (const unsigned char *c = (const unsigned char *)base; *c && *c != '.' && length < sizeof(prefix) - 1; c++)
+    {
+        prefix[length++] = (*c < 0x80 && isalnum(*c)) ? (char)tolower(*c) : '_';
+    }
+    if (length == 0)
+    {
+        length = 3;
+    }
+    prefix[length] = '\0';
+
+    FILE *output = fopen(path, "w");
+    if (!output)
+    {
+        logger_error("Failed to create %s", path);
+        return ERROR_FILE_CREATION;
+    }
+
+    StatusCode error = emit_classifier(tree, prefix, output);
+
+    if (fclose(output) != 0 && error == SUCCESS)
+    {
+        logger_error("Failed to write %s", path);
+        error = ERROR_FILE_CREATION;
+    }
+
+    return error;
+}
+
+/**
+ * @brief The trees loaded from each key given on the command line
+ */
+typedef struct
+{
+    char **key_paths;
+    DicotomicTree ***trees;
+    int *num_trees;
+    const DirectoryCreationConfig *config;
+    int parse_threads;
+    const KeyImagePort *key_image;
+} KeyLoading;
+
+/**
+ * @brief Load the trees of a key given as a compiled image, from its cache or by parsing it
+ *
+ * @param key_path The path of the key
+ * @param config The configuration, for the cache option
+ * @param parse_threads The number of threads used to parse the key
+ * @param key_image The compiled image implementation
+ * @param trees Pointer to store the array of trees, freed by the caller
+ * @param num_trees Pointer to store the number of trees
+ * @return StatusCode SUCCESS if successful, an error code otherwise
+ */
+static StatusCode load_trees(
+    const char *key_path,
+    const DirectoryCreationConfig *config,
+    int parse_threads,
+    const KeyImagePort *key_image,
+    DicotomicTree ***trees,
+    int *num_trees)
+{
+    // Images hold a single tree
+    bool is_image = key_image->is_image(key_path);
+    DicotomicTree *tree = NULL;
+
+    if (is_image)
+    {
+        tree = key_image->load(key_path);
+    }
+    else if (config->use_cache)
+    {
+        tree = key_image->load_cached(key_path);
+    }
+
+    if (tree)
+    {
+        *trees = malloc(sizeof(DicotomicTree *));
+        if (!*trees)
+        {
+            dicotomic_tree_free(tree);
+            return ERROR_MEMORY_ALLOCATION;
+        }
+        (*trees)[0] = tree;
+        *num_trees = 1;
+        return SUCCESS;
+    }
+
+    if (is_image)
+    {
+        return ERROR_INVALID_JSON;
+    }
+
+    StatusCode error = select_parser(key_path, config)->parse_file_trees(key_path, parse_threads, trees, num_trees);
+
+    // A cache that cannot be written only costs the next run a parse
+    if (error == SUCCESS && config->use_cache && *num_trees == 1 &&
+        key_image->save_cached((*trees)[0], key_path) != SUCCESS)
+    {
+        logger_warning("Failed to cache the compiled key of %s", key_path);
+    }
+
+    return error;
+}
+
+static void load_key_task(void *context, size_t index)
+{
+    KeyLoading *loading = context;
+
+    StatusCode error = load_trees(
+        loading->key_paths[index],
+        loading->config,
+        loading->parse_threads,
+        loading->key_image,
+        &loading->trees[index],
+        &loading->num_trees[index]);
+
+    if (error != SUCCESS)
+    {
+        logger_error("Failed to parse key file: %s", loading->key_paths[index]);
+        loading->trees[index] = NULL;
+        loading->num_trees[index] = 0;
+    }
+}
+
+/**
+ * @brief Load every key on a shared pool of threads and gather their trees
+ *
+ * Keys are spread over the threads; a single key gets all of them to parse
+ * its species instead.
+ *
+ * @param key_paths The paths of the keys
+ * @param num_keys The number of keys
+ * @param config The configuration, for the thread, cache and format options
+ * @param key_image The compiled image implementation
+ * @param trees Pointer to store the trees of all keys in order, freed by the caller
+ * @param num_trees Pointer to store the number of trees
+ * @return StatusCode SUCCESS if every key was loaded, an error code otherwise
+ */
+static StatusCode load_keys(
+    char **key_paths,
+    int num_keys,
+    const DirectoryCreationConfig *config,
+    const KeyImagePort *key_image,
+    DicotomicTree ***trees,
+    int *num_trees)
+{
+    int num_threads = (config->num_threads > 0) ? config->num_threads : parallel_available_threads();
+
+    KeyLoading loading = {
+        .key_paths = key_paths,
+        .trees = calloc((size_t)num_keys, sizeof(DicotomicTree **)),
+        .num_trees = calloc((size_t)num_keys, sizeof(int)),
+        .config = config,
+        .parse_threads = (num_keys > 1) ? 1 : num_threads,
+        .key_image = key_image};
+
+    *trees = NULL;
+    *num_trees = 0;
+
+    if (!loading.trees || !loading.num_trees)
+    {
+        free(loading.trees);
+        free(loading.num_trees);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    parallel_for((size_t)num_keys, num_threads, load_key_task, &loading);
+
+    StatusCode error = SUCCESS;
+    int total = 0;
+    for (int i = 0; i < num_keys; i++)
+    {
+        if (!loading.trees[i])
+        {
+            error = ERROR_INVALID_JSON;
+        }
+        total += loading.num_trees[i];
+    }
+
+    if (error == SUCCESS)
+    {
+        *trees = malloc((size_t)total * sizeof(DicotomicTree *));
+        if (!*trees)
+        {
+            error = ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    // Gather the trees in command line order, or free them all on error
+    for (int i = 0; i < num_keys; i++)
+    {
+        for (int j = 0; j < loading.num_trees[i]; j++)
+        {
+            if (error == SUCCESS)
+            {
+                (*trees)[(*num_trees)++] = loading.trees[i][j];
+            }
+            else
+            {
+                dicotomic_tree_free(loading.trees[i][j]);
+            }
+        }
+        free(loading.trees[i]);
+    }
+    free(loading.trees);
+    free(loading.num_trees);
+
+    return error;
+}
+
+static void free_key_paths(char **key_paths, int num_keys)
+{
+    for (int i = 0; i < num_keys; i++)
+    {
+        free(key_paths[i]);
+    }
+    free(key_paths);
+}
+
 int main(int argc, char *argv[])
 {
     // Initialize logger
     logger_init(LOG_INFO);
 
     // Parse command line arguments
-    char *json_file_path = NULL;
+    char **key_paths = NULL;
+    int num_keys = 0;
     DirectoryCreationConfig config = {
         .root_dir = ".",
         .true_text = "si tiene",
         .false_text = "no tiene",
         .concat_mode = PREFIX_MODE,
-        .use_multiple_processes = false};
+        .use_multiple_processes = false,
+        .stream_input = false,
+        .num_threads = 1,
+        .compile_path = NULL,
+        .use_cache = false,
+        .ndjson_input = false,
+        .query_questions = NULL,
+        .query_answers = NULL,
+        .num_queries = 0,
+        .classify_path = NULL,
+        .emit_path = NULL,
+        .optimize_order = false,
+        .diagnose = false,
+        .index_path = NULL,
+        .lookup_name = NULL,
+        .index_trigrams = false,
+        .search_text = NULL,
+        .use_io_uring = false,
+        .use_work_stealing = false};
 
-    StatusCode error = parse_args(argc, argv, &json_file_path, &config);
+    StatusCode error = parse_args(argc, argv, &key_paths, &num_keys, &config);
 
     if (error != SUCCESS)
     {
         handle_error(error, true);
     }
 
-    // Parse JSON file
-    const JsonParserPort *json_parser = get_json_parser();
-    DicotomicTree *tree = json_parser->parse_file(json_file_path);
+    const FileSystemPort *file_system = config.use_io_uring ? get_io_uring_file_system() : get_unix_file_system();
+    const KeyImagePort *key_image = get_key_image();
 
-    if (tree == NULL)
+    // The arguments of a lookup or search are indexes, so no key is read
+    if (config.lookup_name || config.search_text)
     {
-        logger_error("Failed to parse JSON file: %s", json_file_path);
-        free(json_file_path);
-        return EXIT_FAILURE;
+        size_t num_matches = 0;
+        if (config.lookup_name)
+        {
+            error = lookup_species(key_paths, num_keys, config.lookup_name, get_species_index(), stdout, &num_matches);
+        }
+        else
+        {
+            error = search_species(key_paths, num_keys, config.search_text, get_species_index(), stdout, &num_matches);
+        }
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+        else if (num_matches == 0)
+        {
+            if (config.lookup_name)
+            {
+                logger_error("Species '%s' is not in the index", config.lookup_name);
+            }
+            else
+            {
+                logger_error("No species like '%s' in the index", config.search_text);
+            }
+            error = ERROR_FILE_NOT_FOUND;
+        }
+
+        free_key_paths(key_paths, num_keys);
+        free_queries(&config);
+        logger_cleanup();
+
+        return (error == SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Streamed keys are materialized while they are parsed, one after another
+    if (config.stream_input)
+    {
+        for (int i = 0; i < num_keys && error == SUCCESS; i++)
+        {
+            error = create_directory_structure_from_stream(
+                key_paths[i], &config, select_parser(key_paths[i], &config), file_system);
+        }
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+        else
+        {
+            logger_info("Directory structure created successfully");
+        }
+
+        free_key_paths(key_paths, num_keys);
+        logger_cleanup();
+
+        return (error == SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    // Validate the tree
-    if (!dicotomic_tree_validate(tree))
+    // Parse JSON files
+    DicotomicTree **trees = NULL;
+    int num_trees = 0;
+
+    if (load_keys(key_paths, num_keys, &config, key_image, &trees, &num_trees) != SUCCESS)
     {
-        logger_error("The dicotomic tree is invalid");
-        dicotomic_tree_free(tree);
-        free(json_file_path);
+        free_key_paths(key_paths, num_keys);
+        free_queries(&config);
         return EXIT_FAILURE;
     }
 
-    // Create directory structure
-    const FileSystemPort *file_system = get_unix_file_system();
-    error = create_directory_structure(tree, &config, file_system);
+    // Validate the trees
+    for (int i = 0; i < num_trees && error == SUCCESS; i++)
+    {
+        if (!dicotomic_tree_validate(trees[i], config.num_threads))
+        {
+            logger_error("The dicotomic tree '%s' is invalid", trees[i]->name);
+            error = ERROR_INVALID_JSON;
+        }
+    }
 
-    if (error != SUCCESS)
+    // Every later step, directories included, follows the new order
+    for (int i = 0; i < num_trees && error == SUCCESS && config.optimize_order; i++)
     {
-        handle_error(error, false);
+        error = optimize_question_order(trees[i], config.num_threads);
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
     }
-    else
+
+    // Compile the key, answer the queries or create directory structure
+    if (error == SUCCESS && config.compile_path)
     {
-        logger_info("Directory structure created successfully");
+        if (num_trees != 1)
+        {
+            logger_error("Only a single tree can be compiled, found %d", num_trees);
+            error = ERROR_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            error = key_image->save(trees[0], config.compile_path);
+        }
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+        else
+        {
+            logger_info("Key compiled to %s", config.compile_path);
+        }
+    }
+    else if (error == SUCCESS && config.num_queries > 0)
+    {
+        error = print_candidate_species(
+            trees, num_trees, config.query_questions, config.query_answers, config.num_queries);
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+    }
+    else if (error == SUCCESS && config.classify_path)
+    {
+        if (num_trees != 1)
+        {
+            logger_error("Observations can only be classified against a single tree, found %d", num_trees);
+            error = ERROR_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            error = classify_observation_file(trees[0], &config);
+        }
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+    }
+    else if (error == SUCCESS && config.diagnose)
+    {
+        size_t num_findings = 0;
+        error = diagnose_trees(trees, num_trees, config.num_threads, stdout, &num_findings);
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+        else if (num_findings > 0)
+        {
+            // A key with problems fails, so scripts can stop before creating it
+            logger_warning("Found %zu problems in the key", num_findings);
+            error = ERROR_INVALID_JSON;
+        }
+    }
+    else if (error == SUCCESS && config.emit_path)
+    {
+        if (num_trees != 1)
+        {
+            logger_error("Only a single tree can be emitted as C, found %d", num_trees);
+            error = ERROR_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            error = emit_classifier_file(trees[0], config.emit_path);
+        }
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+        else
+        {
+            logger_info("Classifier written to %s", config.emit_path);
+        }
+    }
+    else if (error == SUCCESS)
+    {
+        error = create_directory_structures(trees, num_trees, &config, file_system);
+
+        if (error != SUCCESS)
+        {
+            handle_error(error, false);
+        }
+        else
+        {
+            logger_info("Directory structure created successfully");
+        }
+
+        // The index only points to files that were created
+        if (error == SUCCESS && config.index_path)
+        {
+            error = index_species(trees, num_trees, &config, get_species_index());
+
+            if (error != SUCCESS)
+            {
+                handle_error(error, false);
+            }
+            else
+            {
+                logger_info("Species index written to %s", config.index_path);
+            }
+        }
     }
 
     // Clean up
-    dicotomic_tree_free(tree);
-    free(json_file_path);
+    for (int i = 0; i < num_trees; i++)
+    {
+        dicotomic_tree_free(trees[i]);
+    }
+    free(trees);
+    free_key_paths(key_paths, num_keys);
+    free_queries(&config);
     logger_cleanup();
 
     return (error == SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
-}
\ No newline at end of file
+}
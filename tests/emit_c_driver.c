@@ -0,0 +1,101 @@
+/*
+ * Driver for a classifier generated with -e key.c: writes random
+ * observations of the key as CSV to the given file and prints what
+ * key_identify says of each one, in the format of -k.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_OBSERVATIONS 5000
+
+extern const char *const key_questions[];
+extern const char *const key_species[];
+size_t key_identify(const signed char *answers, size_t *first);
+
+static uint32_t next_random(uint32_t *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 16;
+}
+
+static void write_field(FILE *output, const char *text)
+{
+    fputc('"', output);
+    for (; *text; text++)
+    {
+        if (*text == '"')
+        {
+            fputc('"', output);
+        }
+        fputc(*text, output);
+    }
+    fputc('"', output);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <observations.csv>\n", argv[0]);
+        return 1;
+    }
+
+    size_t num_questions = 0;
+    while (key_questions[num_questions])
+    {
+        num_questions++;
+    }
+
+    FILE *output = fopen(argv[1], "w");
+    signed char *answers = malloc(num_questions ? num_questions : 1);
+    if (!output || !answers)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    for (size_t q = 0; q < num_questions; q++)
+    {
+        if (q > 0)
+        {
+            fputc(',', output);
+        }
+        write_field(output, key_questions[q]);
+    }
+    fputc('\n', output);
+
+    // Mostly answered, so observations reach the leaves as well as stopping
+    // at unanswered questions
+    uint32_t state = 1;
+    for (int i = 0; i < NUM_OBSERVATIONS; i++)
+    {
+        for (size_t q = 0; q < num_questions; q++)
+        {
+            uint32_t value = next_random(&state) % 8;
+            answers[q] = value == 0 ? -1 : (signed char)(value % 2);
+
+            if (q > 0)
+            {
+                fputc(',', output);
+            }
+            fputs(answers[q] < 0 ? "" : answers[q] ? "si" : "no", output);
+        }
+        fputc('\n', output);
+
+        size_t first = 0;
+        size_t count = key_identify(answers, &first);
+        printf("%zu", count);
+        for (size_t j = first; j < first + count; j++)
+        {
+            printf("\t%s", key_species[j]);
+        }
+        printf("\n");
+    }
+
+    fclose(output);
+    free(answers);
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Check that the C classifier written by -e identifies the same species as
+# -k: each key is emitted, compiled strictly and linked with a driver that
+# classifies random observations, whose output must match dicotodir -k on
+# the same observations.
+#
+# Usage: tests/emit_c_test.sh [dicotodir] [cc] [keys...]
+
+BIN=${1:-bin/dicotodir}
+[ $# -gt 0 ] && shift
+CC=${1:-cc}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- input_files/*.json
+
+CFLAGS="-std=c99 -pedantic -Wall -Wextra -Werror"
+DRIVER=$(dirname "$0")/emit_c_driver.c
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+status=0
+for key in "$@"; do
+    rm -f "$TMP"/*
+
+    if ! "$BIN" "$key" -e "$TMP/key.c" >/dev/null 2>&1; then
+        echo "FAIL $key: dicotodir -e failed"
+        status=1
+        continue
+    fi
+
+    if ! $CC $CFLAGS -c "$TMP/key.c" -o "$TMP/key.o" ||
+        ! $CC $CFLAGS "$DRIVER" "$TMP/key.o" -o "$TMP/driver"; then
+        echo "FAIL $key: the generated classifier does not compile"
+        status=1
+        continue
+    fi
+
+    "$TMP/driver" "$TMP/observations.csv" >"$TMP/expected"
+    "$BIN" "$key" -k "$TMP/observations.csv" >"$TMP/actual" 2>/dev/null
+
+    if cmp -s "$TMP/expected" "$TMP/actual"; then
+        echo "ok   $key: the generated classifier agrees with -k on $(wc -l <"$TMP/expected") observations"
+    else
+        echo "FAIL $key: the generated classifier disagrees with -k"
+        diff "$TMP/expected" "$TMP/actual" | head -5
+        status=1
+    fi
+done
+
+exit $status
@@ -0,0 +1,42 @@
+/*
+ * Generator of a large key for tests/large_key_test.sh: writes to standard
+ * output a tree "T" of 2^bits + 1 species answering the same 32 questions,
+ * A to Z then a to f. Species k, named s<k>, answers question j with bit j
+ * of k, so every species has its own path and only the last one answers
+ * question <bits> yes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_QUESTIONS 32
+
+static const char QUESTIONS[NUM_QUESTIONS + 1] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef";
+
+int main(int argc, char **argv)
+{
+    int bits = argc > 1 ? atoi(argv[1]) : 26;
+    if (bits < 1 || bits >= NUM_QUESTIONS)
+    {
+        fprintf(stderr, "Usage: %s [bits, 1 to %d]\n", argv[0], NUM_QUESTIONS - 1);
+        return 1;
+    }
+
+    static char buffer[1 << 20];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    unsigned long long num_species = (1ULL << bits) + 1;
+    fputs("{\"T\":[\n", stdout);
+    for (unsigned long long k = 0; k < num_species; k++)
+    {
+        printf("%s{\"s%llu\":[", k ? ",\n" : "", k);
+        for (int j = 0; j < NUM_QUESTIONS; j++)
+        {
+            printf("%s{\"%c\":%s}", j ? "," : "", QUESTIONS[j], (k >> j) & 1 ? "true" : "false");
+        }
+        fputs("]}", stdout);
+    }
+    fputs("\n]}\n", stdout);
+
+    return ferror(stdout) ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Check that a key with more than 2^31 characteristics in total is read and
+# answered right: a key of 2^26 + 1 species with 32 answers each (2^31 + 32
+# characteristics) is generated and queried for the answers of the last
+# species, whose characteristics start past 2^31, which must be the only
+# match. Queries need the whole tree, and standard input is always
+# streamed, so the key goes through a file of about 24 GB under $TMPDIR, and
+# holding the tree takes tens of gigabytes of memory. It takes long, so it only
+# runs with make test-large. A smaller bits argument checks the test itself.
+#
+# Usage: tests/large_key_test.sh [dicotodir] [cc] [bits]
+
+BIN=${1:-bin/dicotodir}
+CC=${2:-cc}
+BITS=${3:-26}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+if ! $CC -std=c99 -pedantic -Wall -Wextra -Werror -O2 \
+    "$(dirname "$0")/large_key_generator.c" -o "$TMP/generator"; then
+    echo "FAIL the key generator does not compile"
+    exit 1
+fi
+
+# The answers of the last species, 2^BITS: only question BITS is yes
+QUESTIONS=ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef
+set --
+j=0
+while [ $j -lt 32 ]; do
+    question=$(printf '%s' "$QUESTIONS" | cut -c $((j + 1)))
+    if [ $j -eq "$BITS" ]; then
+        set -- "$@" -q "$question=si"
+    else
+        set -- "$@" -q "$question=no"
+    fi
+    j=$((j + 1))
+done
+
+if ! "$TMP/generator" "$BITS" >"$TMP/key.json"; then
+    echo "FAIL the key of 2^$BITS + 1 species could not be written"
+    exit 1
+fi
+
+if ! "$BIN" "$TMP/key.json" -j 0 "$@" >"$TMP/actual" 2>"$TMP/log"; then
+    echo "FAIL dicotodir failed on the key of 2^$BITS + 1 species"
+    tail -5 "$TMP/log"
+    exit 1
+fi
+
+# Matches are printed as tree/species, along with a count of the species
+echo "T/s$((1 << BITS))" >"$TMP/expected"
+grep '^T/' "$TMP/actual" >"$TMP/matches"
+if cmp -s "$TMP/expected" "$TMP/matches" &&
+    grep -q "1 of $(((1 << BITS) + 1)) species" "$TMP/actual"; then
+    echo "ok   the key of 2^$BITS + 1 species, $(((1 << BITS) * 32 + 32)) characteristics, finds its last species"
+else
+    echo "FAIL the key of 2^$BITS + 1 species does not find its last species"
+    head -5 "$TMP/actual"
+    exit 1
+fi
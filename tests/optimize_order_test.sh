@@ -0,0 +1,53 @@
+#!/bin/sh
+# Check that -O (reordering the questions) keeps the key dichotomous: it must
+# not add directories whose subdirectories answer more than one question,
+# nor add directories at all.
+#
+# Usage: tests/optimize_order_test.sh [dicotodir] [keys...]
+
+BIN=${1:-bin/dicotodir}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- input_files/*.json
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Count the directories whose subdirectories answer more than one question
+count_mixed()
+{
+    find "$1" -mindepth 1 -type d | while IFS= read -r dir; do
+        questions=$(find "$dir" -mindepth 1 -maxdepth 1 -type d -exec basename {} \; |
+            sed -e 's/^si tiene //' -e 's/^no tiene //' | sort -u | wc -l)
+        [ "$questions" -le 1 ] || echo "$dir"
+    done | wc -l
+}
+
+status=0
+for key in "$@"; do
+    rm -rf "$TMP/plain" "$TMP/optimized"
+    mkdir -p "$TMP/plain" "$TMP/optimized"
+
+    if ! "$BIN" "$key" -d "$TMP/plain" >/dev/null 2>&1 ||
+        ! "$BIN" "$key" -O -d "$TMP/optimized" >/dev/null 2>&1; then
+        echo "FAIL $key: dicotodir failed"
+        status=1
+        continue
+    fi
+
+    plain_mixed=$(count_mixed "$TMP/plain")
+    optimized_mixed=$(count_mixed "$TMP/optimized")
+    plain_dirs=$(find "$TMP/plain" -type d | wc -l)
+    optimized_dirs=$(find "$TMP/optimized" -type d | wc -l)
+
+    if [ "$optimized_mixed" -gt "$plain_mixed" ]; then
+        echo "FAIL $key: -O mixes questions in $optimized_mixed directories, $plain_mixed without it"
+        status=1
+    elif [ "$optimized_dirs" -gt "$plain_dirs" ]; then
+        echo "FAIL $key: -O creates $optimized_dirs directories, $plain_dirs without it"
+        status=1
+    else
+        echo "ok   $key: -O keeps the key dichotomous"
+    fi
+done
+
+exit $status
@@ -0,0 +1,114 @@
+#!/bin/sh
+# Check the species index written by -x -T: -l must print the file of every
+# species created, -z must find every name, even misspelt, and truncated or
+# corrupted indexes must be rejected, or at least read without crashing.
+#
+# Usage: tests/species_index_test.sh [dicotodir] [keys...]
+
+BIN=${1:-bin/dicotodir}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- input_files/*.json
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+INDEX=$TMP/species.idx
+BROKEN=$TMP/broken.idx
+
+# Run dicotodir, which must exit instead of being killed, and whose
+# sanitizers, when it was built with them, must report nothing
+runs_cleanly()
+{
+    "$BIN" "$@" >"$TMP/stdout" 2>"$TMP/stderr"
+    code=$?
+    [ $code -lt 128 ] && ! grep -q -e 'runtime error' -e 'Sanitizer' "$TMP/stderr"
+}
+
+if ! "$BIN" "$@" -d "$TMP/dirs" -x "$INDEX" -T >/dev/null 2>&1; then
+    echo "FAIL dicotodir -x -T failed"
+    exit 1
+fi
+
+(cd "$TMP/dirs" && find . -name '*.txt' | sed 's|^\./||' | sort) >"$TMP/files"
+
+status=0
+lookups=0
+searches=0
+while IFS= read -r file; do
+    name=$(basename "$file" .txt)
+
+    if "$BIN" "$INDEX" -l "$name" 2>/dev/null | grep -Fxq "$file"; then
+        lookups=$((lookups + 1))
+    else
+        echo "FAIL -l '$name' does not print $file"
+        status=1
+    fi
+
+    best=$("$BIN" "$INDEX" -z "$name" 2>/dev/null | head -n 1 | cut -f 1,2)
+    if [ "$best" = "$(printf '1.00\t%s' "$name")" ]; then
+        searches=$((searches + 1))
+    else
+        echo "FAIL -z '$name' finds '$best' first"
+        status=1
+    fi
+done <"$TMP/files"
+echo "ok   -l prints the file of $lookups species, -z finds their names first"
+
+# The misspelling in the README
+if grep -q '/Castanna\.txt$' "$TMP/files"; then
+    best=$("$BIN" "$INDEX" -z Castana 2>/dev/null | head -n 1 | cut -f 2)
+    if [ "$best" = "Castanna" ]; then
+        echo "ok   -z Castana finds Castanna"
+    else
+        echo "FAIL -z Castana finds '$best' first"
+        status=1
+    fi
+fi
+
+if runs_cleanly "$INDEX" -l "No es una especie" && [ $code -ne 0 ] && [ ! -s "$TMP/stdout" ] &&
+    runs_cleanly "$INDEX" -z qqqxxx && [ $code -ne 0 ] && [ ! -s "$TMP/stdout" ]; then
+    echo "ok   a missing species and a search without matches fail and print nothing"
+else
+    echo "FAIL a missing species or a search without matches does not fail cleanly"
+    status=1
+fi
+
+size=$(wc -c <"$INDEX")
+
+# Every truncated index must be rejected
+truncated=0
+for length in 0 1 7 8 16 32 64 $((size / 2)) $((size - 64)) $((size - 1)); do
+    head -c "$length" "$INDEX" >"$BROKEN"
+    if runs_cleanly "$BROKEN" -l Castanna && [ $code -ne 0 ] &&
+        runs_cleanly "$BROKEN" -z Castana && [ $code -ne 0 ]; then
+        truncated=$((truncated + 1))
+    else
+        echo "FAIL an index truncated to $length of $size bytes is not rejected cleanly"
+        status=1
+    fi
+done
+echo "ok   $truncated truncated indexes are rejected"
+
+# A corrupted byte may go unnoticed, in a name for instance, but must never
+# crash: every byte of the header is corrupted, then bytes spread over the rest
+corrupted=0
+offset=0
+while [ "$offset" -lt "$size" ]; do
+    cp "$INDEX" "$BROKEN"
+    printf '\377' | dd of="$BROKEN" bs=1 seek="$offset" conv=notrunc 2>/dev/null
+    if runs_cleanly "$BROKEN" -l Castanna && runs_cleanly "$BROKEN" -z Castana; then
+        corrupted=$((corrupted + 1))
+    else
+        echo "FAIL an index with byte $offset corrupted is not read cleanly"
+        status=1
+    fi
+
+    if [ "$offset" -lt 128 ]; then
+        offset=$((offset + 1))
+    else
+        offset=$((offset + size / 128 + 1))
+    fi
+done
+echo "ok   $corrupted corrupted indexes are read without crashing"
+
+exit $status